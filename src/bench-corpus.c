@@ -0,0 +1,300 @@
+/*
+ * Deterministic Benchmark Corpora
+ *
+ * The generator emits tokens in different quoting styles, and separates them
+ * by whitespace and comments. It never uses the library to produce the raw
+ * tokens, so the recorded unquoted values can be used to verify the library.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <c-stdaux.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench-corpus.h"
+
+enum {
+        BENCH_STYLE_PLAIN,
+        BENCH_STYLE_SINGLE,
+        BENCH_STYLE_DOUBLE,
+        BENCH_STYLE_BACKSLASH,
+        BENCH_STYLE_JSON,
+};
+
+typedef struct BenchGenerator {
+        uint64_t state;
+        BenchCorpus *corpus;
+        size_t z_data;
+        size_t z_words;
+        size_t z_tokens;
+} BenchGenerator;
+
+static const struct {
+        const char *name;
+        size_t n_data;
+} bench_corpus_types[_BENCH_CORPUS_N] = {
+        [BENCH_CORPUS_WORDS] = { "words", 1024 * 1024 },
+        [BENCH_CORPUS_SINGLE] = { "single", 1024 * 1024 },
+        [BENCH_CORPUS_DOUBLE] = { "double", 1024 * 1024 },
+        [BENCH_CORPUS_COMMENTS] = { "comments", 1024 * 1024 },
+        [BENCH_CORPUS_SCRIPT] = { "script", 8 * 1024 * 1024 },
+        [BENCH_CORPUS_ESCAPES] = { "escapes", 1024 * 1024 },
+};
+
+static uint64_t bench_generator_rand(BenchGenerator *g) {
+        g->state ^= g->state << 13;
+        g->state ^= g->state >> 7;
+        g->state ^= g->state << 17;
+        return g->state;
+}
+
+static size_t bench_generator_range(BenchGenerator *g, size_t min, size_t max) {
+        return min + bench_generator_rand(g) % (max - min + 1);
+}
+
+static char bench_generator_pick(BenchGenerator *g, const char *alphabet) {
+        return alphabet[bench_generator_rand(g) % strlen(alphabet)];
+}
+
+static void bench_generator_reserve(char **datap, size_t *z_datap, size_t n_data, size_t n) {
+        if (n_data + n <= *z_datap)
+                return;
+
+        *z_datap = c_max(*z_datap * 2, n_data + n);
+        *datap = realloc(*datap, *z_datap);
+        c_assert(*datap);
+}
+
+static void bench_generator_raw(BenchGenerator *g, char c) {
+        BenchCorpus *corpus = g->corpus;
+
+        bench_generator_reserve(&corpus->data, &g->z_data, corpus->n_data, 1);
+        corpus->data[corpus->n_data++] = c;
+}
+
+static void bench_generator_word(BenchGenerator *g, char c) {
+        BenchCorpus *corpus = g->corpus;
+
+        bench_generator_reserve(&corpus->words, &g->z_words, corpus->n_words, 1);
+        corpus->words[corpus->n_words++] = c;
+}
+
+static void bench_generator_separator(BenchGenerator *g, size_t n_whitespace, size_t n_comment) {
+        for (size_t i = 0; i < n_whitespace; ++i)
+                bench_generator_raw(g, bench_generator_pick(g, "    \t\t\n"));
+
+        if (n_comment) {
+                bench_generator_raw(g, '#');
+                for (size_t i = 0; i < n_comment; ++i)
+                        bench_generator_raw(g, bench_generator_pick(g, "abcdefghijklmnop     '\"\\$#"));
+                bench_generator_raw(g, '\n');
+        }
+}
+
+static void bench_generator_token(BenchGenerator *g, unsigned int style) {
+        BenchCorpus *corpus = g->corpus;
+        BenchToken *token;
+        size_t n;
+
+        if (corpus->n_tokens >= g->z_tokens) {
+                g->z_tokens = c_max(g->z_tokens * 2, (size_t)1024);
+                corpus->tokens = realloc(corpus->tokens, g->z_tokens * sizeof(*corpus->tokens));
+                c_assert(corpus->tokens);
+        }
+
+        token = &corpus->tokens[corpus->n_tokens++];
+        token->i_raw = corpus->n_data;
+        token->i_word = corpus->n_words;
+
+        switch (style) {
+        case BENCH_STYLE_PLAIN:
+                n = bench_generator_range(g, 1, 12);
+                for (size_t i = 0; i < n; ++i) {
+                        char c = bench_generator_pick(g, "abcdefghijklmnopqrstuvwxyz0123456789_./-=");
+
+                        bench_generator_raw(g, c);
+                        bench_generator_word(g, c);
+                }
+                break;
+        case BENCH_STYLE_SINGLE:
+                n = bench_generator_range(g, 1, 24);
+                bench_generator_raw(g, '\'');
+                for (size_t i = 0; i < n; ++i) {
+                        char c = bench_generator_pick(g, "abcdefgh  '\"\\$");
+
+                        if (c == '\'') {
+                                bench_generator_raw(g, '\'');
+                                bench_generator_raw(g, '\\');
+                                bench_generator_raw(g, '\'');
+                        }
+                        bench_generator_raw(g, c);
+                        bench_generator_word(g, c);
+                }
+                bench_generator_raw(g, '\'');
+                break;
+        case BENCH_STYLE_DOUBLE:
+                n = bench_generator_range(g, 1, 24);
+                bench_generator_raw(g, '"');
+                for (size_t i = 0; i < n; ++i) {
+                        char c = bench_generator_pick(g, "abcd \\\\\"\"$`'");
+
+                        if (strchr("\\\"$`", c))
+                                bench_generator_raw(g, '\\');
+                        bench_generator_raw(g, c);
+                        bench_generator_word(g, c);
+                }
+                bench_generator_raw(g, '"');
+                break;
+        case BENCH_STYLE_BACKSLASH:
+                n = bench_generator_range(g, 1, 16);
+                for (size_t i = 0; i < n; ++i) {
+                        char c = bench_generator_pick(g, "abcdefgh \\\"'$#");
+
+                        if (strchr(" \\\"'$#", c))
+                                bench_generator_raw(g, '\\');
+                        bench_generator_raw(g, c);
+                        bench_generator_word(g, c);
+                }
+                break;
+        case BENCH_STYLE_JSON:
+                /*
+                 * JSON documents passed as double-quoted arguments, which
+                 * escape every quote of the document, and every backslash of
+                 * its escape sequences.
+                 */
+                n = bench_generator_range(g, 32, 512);
+                bench_generator_raw(g, '"');
+                for (size_t i = 0; i < n; ++i) {
+                        char c = bench_generator_pick(g, "abcdefgh:,{} \"\"\"\\\\$\n");
+
+                        if (strchr("\\\"$", c))
+                                bench_generator_raw(g, '\\');
+                        bench_generator_raw(g, c);
+                        bench_generator_word(g, c);
+                }
+                bench_generator_raw(g, '"');
+                break;
+        default:
+                c_assert(0);
+        }
+
+        token->n_raw = corpus->n_data - token->i_raw;
+        token->n_word = corpus->n_words - token->i_word;
+        bench_generator_word(g, '\0');
+}
+
+static void bench_generator_run(BenchGenerator *g, unsigned int type, size_t n_data) {
+        BenchCorpus *corpus = g->corpus;
+        size_t n_line = 0;
+
+        while (corpus->n_data < n_data) {
+                switch (type) {
+                case BENCH_CORPUS_WORDS:
+                        if (corpus->n_tokens)
+                                bench_generator_raw(g, corpus->n_tokens % 8 ? ' ' : '\n');
+                        bench_generator_token(g, BENCH_STYLE_PLAIN);
+                        break;
+                case BENCH_CORPUS_SINGLE:
+                        if (corpus->n_tokens)
+                                bench_generator_raw(g, ' ');
+                        bench_generator_token(g, BENCH_STYLE_SINGLE);
+                        break;
+                case BENCH_CORPUS_DOUBLE:
+                        if (corpus->n_tokens)
+                                bench_generator_raw(g, ' ');
+                        bench_generator_token(g, BENCH_STYLE_DOUBLE);
+                        break;
+                case BENCH_CORPUS_COMMENTS:
+                        if (corpus->n_tokens)
+                                bench_generator_separator(g,
+                                                          bench_generator_range(g, 1, 32),
+                                                          bench_generator_rand(g) % 4 ? 0 : bench_generator_range(g, 40, 400));
+                        bench_generator_token(g, BENCH_STYLE_PLAIN);
+                        break;
+                case BENCH_CORPUS_SCRIPT: {
+                        size_t p = bench_generator_rand(g) % 100;
+
+                        /*
+                         * Lines of a shell script: mostly plain words, with
+                         * some quoted arguments, and an occasional comment.
+                         */
+                        if (!n_line) {
+                                if (corpus->n_tokens)
+                                        bench_generator_separator(g, 1, bench_generator_rand(g) % 8 ? 0 : bench_generator_range(g, 10, 80));
+                                n_line = bench_generator_range(g, 2, 16);
+                        } else {
+                                bench_generator_raw(g, ' ');
+                        }
+                        --n_line;
+
+                        bench_generator_token(g,
+                                              p < 60 ? BENCH_STYLE_PLAIN :
+                                              p < 75 ? BENCH_STYLE_SINGLE :
+                                              p < 90 ? BENCH_STYLE_DOUBLE :
+                                              BENCH_STYLE_BACKSLASH);
+                        break;
+                }
+                case BENCH_CORPUS_ESCAPES:
+                        if (corpus->n_tokens)
+                                bench_generator_raw(g, '\n');
+                        bench_generator_token(g, BENCH_STYLE_JSON);
+                        break;
+                default:
+                        c_assert(0);
+                }
+        }
+
+        bench_generator_raw(g, '\0');
+        --corpus->n_data;
+}
+
+/**
+ * bench_corpus_new() - Generate corpus
+ * @corpusp:            output variable for the new corpus
+ * @type:               type of the corpus
+ *
+ * This generates the corpus of the given type. The result only depends on
+ * @type, and is identical on every call.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+int bench_corpus_new(BenchCorpus **corpusp, unsigned int type) {
+        _c_cleanup_(bench_corpus_freep) BenchCorpus *corpus = NULL;
+        BenchGenerator g = {};
+
+        c_assert(type < _BENCH_CORPUS_N);
+
+        corpus = calloc(1, sizeof(*corpus));
+        if (!corpus)
+                return -ENOMEM;
+
+        corpus->name = bench_corpus_types[type].name;
+
+        g.state = UINT64_C(0x9e3779b97f4a7c15) + type;
+        g.corpus = corpus;
+        bench_generator_run(&g, type, bench_corpus_types[type].n_data);
+
+        *corpusp = corpus;
+        corpus = NULL;
+        return 0;
+}
+
+/**
+ * bench_corpus_free() - Destroy corpus
+ * @corpus:             corpus to destroy, or NULL
+ *
+ * Return: NULL is returned.
+ */
+BenchCorpus *bench_corpus_free(BenchCorpus *corpus) {
+        if (!corpus)
+                return NULL;
+
+        free(corpus->tokens);
+        free(corpus->words);
+        free(corpus->data);
+        free(corpus);
+
+        return NULL;
+}
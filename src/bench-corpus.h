@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+ * Deterministic Benchmark Corpora
+ *
+ * This generates reproducible command-line corpora for benchmarks. Every
+ * corpus is generated from a fixed seed, so results are comparable across
+ * runs and machines. Along with the command-line, the generator records the
+ * position of every raw token and its unquoted value.
+ */
+
+#include <stddef.h>
+
+typedef struct BenchCorpus BenchCorpus;
+typedef struct BenchToken BenchToken;
+
+enum {
+        BENCH_CORPUS_WORDS,
+        BENCH_CORPUS_SINGLE,
+        BENCH_CORPUS_DOUBLE,
+        BENCH_CORPUS_COMMENTS,
+        BENCH_CORPUS_SCRIPT,
+        BENCH_CORPUS_ESCAPES,
+        _BENCH_CORPUS_N,
+};
+
+struct BenchToken {
+        size_t i_raw;
+        size_t n_raw;
+        size_t i_word;
+        size_t n_word;
+};
+
+struct BenchCorpus {
+        const char *name;
+        char *data;
+        size_t n_data;
+        char *words;
+        size_t n_words;
+        BenchToken *tokens;
+        size_t n_tokens;
+};
+
+int bench_corpus_new(BenchCorpus **corpusp, unsigned int type);
+BenchCorpus *bench_corpus_free(BenchCorpus *corpus);
+
+static inline void bench_corpus_freep(BenchCorpus **corpus) {
+        if (*corpus)
+                bench_corpus_free(*corpus);
+}
@@ -0,0 +1,381 @@
+/*
+ * Benchmarks for the Public API
+ *
+ * This measures c_shquote_quote(), c_shquote_unquote(), c_shquote_parse_next(),
+ * c_shquote_validate() and c_shquote_parse_argv() on the deterministic
+ * corpora, and reports the throughput, the time per token, and the number of
+ * allocations per call.
+ * c_shquote_parse_lines() is measured on a single thread ("parse_lines"), and
+ * on one thread per CPU ("parse_lines*"). The inline version of
+ * c_shquote_parse_next() from c-shquote-inline.h is measured as "parse_next/i",
+ * and c_shquote_parse_argv_blob() as "parse_argv/b".
+ * Allocations are counted by wrapping the allocator at link-time, if the
+ * linker supports it.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <c-stdaux.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench-corpus.h"
+#include "c-shquote.h"
+#include "c-shquote-inline.h"
+
+#define BENCH_NSEC_MIN (UINT64_C(200) * 1000 * 1000)
+
+static size_t bench_n_allocs;
+
+#ifdef BENCH_WRAP_MALLOC
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size) {
+        ++bench_n_allocs;
+        return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+        ++bench_n_allocs;
+        return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+        ++bench_n_allocs;
+        return __real_realloc(p, size);
+}
+
+#endif
+
+typedef struct BenchResult {
+        uint64_t nsec;
+        size_t n_bytes;
+        size_t n_tokens;
+        size_t n_calls;
+        size_t n_allocs;
+} BenchResult;
+
+static uint64_t bench_now(void) {
+        struct timespec ts;
+        int r;
+
+        r = clock_gettime(CLOCK_MONOTONIC, &ts);
+        c_assert(!r);
+
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_report(const char *function, BenchCorpus *corpus, BenchResult *result) {
+        char allocs[32];
+
+#ifdef BENCH_WRAP_MALLOC
+        snprintf(allocs, sizeof(allocs), "%.2f", (double)result->n_allocs / result->n_calls);
+#else
+        snprintf(allocs, sizeof(allocs), "n/a");
+#endif
+
+        printf("%-12s %-10s %10.1f MiB/s %8.2f ns/token %8s allocs/call\n",
+               function,
+               corpus->name,
+               (double)result->n_bytes / (1024 * 1024) / ((double)result->nsec / 1e9),
+               (double)result->nsec / result->n_tokens,
+               allocs);
+}
+
+static void bench_quote(BenchCorpus *corpus, BenchResult *result) {
+        _c_cleanup_(c_freep) char *buffer = NULL;
+        size_t n_buffer = 0;
+        char *out;
+        size_t n_out;
+        int r;
+
+        for (size_t i = 0; i < corpus->n_tokens; ++i)
+                n_buffer = c_max(n_buffer, corpus->tokens[i].n_word * 4 + 2);
+
+        buffer = malloc(n_buffer);
+        c_assert(buffer);
+
+        bench_n_allocs = 0;
+        result->nsec = bench_now();
+
+        do {
+                for (size_t i = 0; i < corpus->n_tokens; ++i) {
+                        out = buffer;
+                        n_out = n_buffer;
+                        r = c_shquote_quote(&out,
+                                            &n_out,
+                                            corpus->words + corpus->tokens[i].i_word,
+                                            corpus->tokens[i].n_word);
+                        c_assert(!r);
+                }
+
+                result->n_bytes += corpus->n_words - corpus->n_tokens;
+                result->n_tokens += corpus->n_tokens;
+                result->n_calls += corpus->n_tokens;
+        } while (bench_now() - result->nsec < BENCH_NSEC_MIN);
+
+        result->nsec = bench_now() - result->nsec;
+        result->n_allocs = bench_n_allocs;
+}
+
+static void bench_unquote(BenchCorpus *corpus, BenchResult *result) {
+        _c_cleanup_(c_freep) char *buffer = NULL;
+        size_t n_raw = 0;
+        char *out;
+        size_t n_out;
+        int r;
+
+        buffer = malloc(corpus->n_data);
+        c_assert(buffer);
+
+        for (size_t i = 0; i < corpus->n_tokens; ++i)
+                n_raw += corpus->tokens[i].n_raw;
+
+        bench_n_allocs = 0;
+        result->nsec = bench_now();
+
+        do {
+                for (size_t i = 0; i < corpus->n_tokens; ++i) {
+                        out = buffer;
+                        n_out = corpus->n_data;
+                        r = c_shquote_unquote(&out,
+                                              &n_out,
+                                              corpus->data + corpus->tokens[i].i_raw,
+                                              corpus->tokens[i].n_raw);
+                        c_assert(!r);
+                }
+
+                result->n_bytes += n_raw;
+                result->n_tokens += corpus->n_tokens;
+                result->n_calls += corpus->n_tokens;
+        } while (bench_now() - result->nsec < BENCH_NSEC_MIN);
+
+        result->nsec = bench_now() - result->nsec;
+        result->n_allocs = bench_n_allocs;
+}
+
+static void bench_parse_next(BenchCorpus *corpus, BenchResult *result) {
+        _c_cleanup_(c_freep) char *buffer = NULL;
+        const char *in;
+        size_t n_in, n_out;
+        char *out;
+        int r;
+
+        buffer = malloc(corpus->n_data);
+        c_assert(buffer);
+
+        bench_n_allocs = 0;
+        result->nsec = bench_now();
+
+        do {
+                in = corpus->data;
+                n_in = corpus->n_data;
+
+                for (;;) {
+                        out = buffer;
+                        n_out = corpus->n_data;
+                        r = c_shquote_parse_next(&out, &n_out, &in, &n_in);
+                        if (r == C_SHQUOTE_E_EOF)
+                                break;
+
+                        c_assert(!r);
+                        ++result->n_calls;
+                }
+
+                result->n_bytes += corpus->n_data;
+                result->n_tokens += corpus->n_tokens;
+        } while (bench_now() - result->nsec < BENCH_NSEC_MIN);
+
+        result->nsec = bench_now() - result->nsec;
+        result->n_allocs = bench_n_allocs;
+}
+
+static void bench_parse_next_inline(BenchCorpus *corpus, BenchResult *result) {
+        _c_cleanup_(c_freep) char *buffer = NULL;
+        const char *in;
+        size_t n_in, n_out;
+        char *out;
+        int r;
+
+        buffer = malloc(corpus->n_data);
+        c_assert(buffer);
+
+        bench_n_allocs = 0;
+        result->nsec = bench_now();
+
+        do {
+                in = corpus->data;
+                n_in = corpus->n_data;
+
+                for (;;) {
+                        out = buffer;
+                        n_out = corpus->n_data;
+                        r = c_shquote_inline_parse_next(&out, &n_out, &in, &n_in);
+                        if (r == C_SHQUOTE_E_EOF)
+                                break;
+
+                        c_assert(!r);
+                        ++result->n_calls;
+                }
+
+                result->n_bytes += corpus->n_data;
+                result->n_tokens += corpus->n_tokens;
+        } while (bench_now() - result->nsec < BENCH_NSEC_MIN);
+
+        result->nsec = bench_now() - result->nsec;
+        result->n_allocs = bench_n_allocs;
+}
+
+static void bench_validate(BenchCorpus *corpus, BenchResult *result) {
+        size_t n_tokens, n_bytes, n_error;
+        int r;
+
+        bench_n_allocs = 0;
+        result->nsec = bench_now();
+
+        do {
+                r = c_shquote_validate(&n_tokens, &n_bytes, &n_error, corpus->data, corpus->n_data);
+                c_assert(!r);
+                c_assert(n_tokens == corpus->n_tokens);
+
+                result->n_bytes += corpus->n_data;
+                result->n_tokens += corpus->n_tokens;
+                ++result->n_calls;
+        } while (bench_now() - result->nsec < BENCH_NSEC_MIN);
+
+        result->nsec = bench_now() - result->nsec;
+        result->n_allocs = bench_n_allocs;
+}
+
+static void bench_parse_argv(BenchCorpus *corpus, BenchResult *result) {
+        char **argv;
+        size_t argc;
+        int r;
+
+        bench_n_allocs = 0;
+        result->nsec = bench_now();
+
+        do {
+                r = c_shquote_parse_argv(&argv, &argc, corpus->data, corpus->n_data);
+                c_assert(!r);
+                c_assert(argc == corpus->n_tokens);
+                free(argv);
+
+                result->n_bytes += corpus->n_data;
+                result->n_tokens += corpus->n_tokens;
+                ++result->n_calls;
+        } while (bench_now() - result->nsec < BENCH_NSEC_MIN);
+
+        result->nsec = bench_now() - result->nsec;
+        result->n_allocs = bench_n_allocs;
+}
+
+static void bench_parse_argv_blob(BenchCorpus *corpus, BenchResult *result) {
+        CShquoteBlob *blob;
+        size_t n_blob;
+        int r;
+
+        bench_n_allocs = 0;
+        result->nsec = bench_now();
+
+        do {
+                r = c_shquote_parse_argv_blob(&blob, &n_blob, corpus->data, corpus->n_data);
+                c_assert(!r);
+                c_assert(c_shquote_blob_get_argc(blob) == corpus->n_tokens);
+                free(blob);
+
+                result->n_bytes += corpus->n_data;
+                result->n_tokens += corpus->n_tokens;
+                ++result->n_calls;
+        } while (bench_now() - result->nsec < BENCH_NSEC_MIN);
+
+        result->nsec = bench_now() - result->nsec;
+        result->n_allocs = bench_n_allocs;
+}
+
+static void bench_parse_lines(BenchCorpus *corpus, BenchResult *result, unsigned int n_threads) {
+        CShquoteLine *lines;
+        size_t n_lines;
+        int r;
+
+        bench_n_allocs = 0;
+        result->nsec = bench_now();
+
+        do {
+                r = c_shquote_parse_lines(&lines, &n_lines, corpus->data, corpus->n_data, n_threads);
+                c_assert(!r);
+                free(lines);
+
+                result->n_bytes += corpus->n_data;
+                result->n_tokens += corpus->n_tokens;
+                ++result->n_calls;
+        } while (bench_now() - result->nsec < BENCH_NSEC_MIN);
+
+        result->nsec = bench_now() - result->nsec;
+        result->n_allocs = bench_n_allocs;
+}
+
+static void bench_parse_lines_single(BenchCorpus *corpus, BenchResult *result) {
+        bench_parse_lines(corpus, result, 1);
+}
+
+static void bench_parse_lines_parallel(BenchCorpus *corpus, BenchResult *result) {
+        bench_parse_lines(corpus, result, 0);
+}
+
+static void bench_verify(BenchCorpus *corpus) {
+        char **argv;
+        size_t argc;
+        int r;
+
+        /* the corpus must parse into exactly the generated tokens */
+        r = c_shquote_parse_argv(&argv, &argc, corpus->data, corpus->n_data);
+        c_assert(!r);
+        c_assert(argc == corpus->n_tokens);
+
+        for (size_t i = 0; i < argc; ++i)
+                c_assert(!strcmp(argv[i], corpus->words + corpus->tokens[i].i_word));
+
+        free(argv);
+}
+
+int main(void) {
+        static const struct {
+                const char *name;
+                void (*fn)(BenchCorpus *corpus, BenchResult *result);
+        } functions[] = {
+                { "quote", bench_quote },
+                { "unquote", bench_unquote },
+                { "parse_next", bench_parse_next },
+                { "parse_next/i", bench_parse_next_inline },
+                { "validate", bench_validate },
+                { "parse_argv", bench_parse_argv },
+                { "parse_argv/b", bench_parse_argv_blob },
+                { "parse_lines", bench_parse_lines_single },
+                { "parse_lines*", bench_parse_lines_parallel },
+        };
+        int r;
+
+        for (unsigned int type = 0; type < _BENCH_CORPUS_N; ++type) {
+                _c_cleanup_(bench_corpus_freep) BenchCorpus *corpus = NULL;
+
+                r = bench_corpus_new(&corpus, type);
+                c_assert(!r);
+
+                bench_verify(corpus);
+
+                for (size_t i = 0; i < C_ARRAY_SIZE(functions); ++i) {
+                        BenchResult result = {};
+
+                        functions[i].fn(corpus, &result);
+                        bench_report(functions[i].name, corpus, &result);
+                }
+        }
+
+        return 0;
+}
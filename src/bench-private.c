@@ -0,0 +1,248 @@
+/*
+ * Benchmarks for private helper functions
+ *
+ * This measures the per-call cost of the character-class scanning helpers on
+ * escape-heavy input, where segments are short and the helpers are called
+ * once every few bytes. As a baseline, the previous string-based helper is
+ * included, which built a membership table on every call.
+ *
+ * Additionally, this measures c_shquote_unquote_double() on the same input,
+ * against the previous implementation which stopped at every escape sequence.
+ * Both are reported per escape sequence.
+ *
+ * Lastly, this measures the tokenizer of c_shquote_parse_next() when it steps
+ * the DFA over every byte, against the default which skips over runs of bytes
+ * that cannot change its state. Both are reported per token.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <c-stdaux.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "c-shquote.h"
+#include "c-shquote-private.h"
+
+#define BENCH_N_INPUT (1024 * 1024)
+#define BENCH_N_ROUNDS 32
+
+static size_t bench_strncspn_legacy(const char *string,
+                                    size_t n_string,
+                                    const char *reject) {
+        bool buffer[UCHAR_MAX + 1] = {};
+
+        for ( ; *reject; ++reject)
+                buffer[(unsigned char)*reject] = true;
+
+        for (size_t i = 0; i < n_string; ++i)
+                if (buffer[(unsigned char)string[i]])
+                        return i;
+
+        return n_string;
+}
+
+static uint64_t bench_now(void) {
+        struct timespec ts;
+        int r;
+
+        r = clock_gettime(CLOCK_MONOTONIC, &ts);
+        c_assert(!r);
+
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_input(char *input, size_t n_input, size_t density) {
+        /*
+         * Produce the body of a double-quoted string with an escape sequence
+         * every @density bytes, similar to JSON embedded in a command-line.
+         */
+        for (size_t i = 0; i < n_input; ++i) {
+                if (i % density == density - 2)
+                        input[i] = '\\';
+                else if (i % density == density - 1)
+                        input[i] = "\"\\$a"[(i / density) % 4];
+                else
+                        input[i] = 'a' + (i % 26);
+        }
+}
+
+static void bench_report(const char *name, size_t density, size_t n_calls, uint64_t nsec) {
+        printf("%-8s density=%-3zu %8.2f ns/call %10.1f MiB/s\n",
+               name,
+               density,
+               (double)nsec / n_calls,
+               (double)BENCH_N_INPUT * BENCH_N_ROUNDS / (1024 * 1024) / ((double)nsec / 1e9));
+}
+
+static void bench_strncspn(size_t density) {
+        _c_cleanup_(c_freep) char *input = NULL;
+        size_t i, n_calls;
+        uint64_t ts;
+
+        input = malloc(BENCH_N_INPUT);
+        c_assert(input);
+        bench_input(input, BENCH_N_INPUT, density);
+
+        /*
+         * Walk the input like c_shquote_unquote_double() does: scan to the
+         * next special character, then step over the escape sequence.
+         */
+
+        n_calls = 0;
+        ts = bench_now();
+        for (size_t round = 0; round < BENCH_N_ROUNDS; ++round) {
+                for (i = 0; i < BENCH_N_INPUT; i += 2, ++n_calls)
+                        i += bench_strncspn_legacy(input + i, BENCH_N_INPUT - i, "\\\"");
+        }
+        bench_report("legacy", density, n_calls, bench_now() - ts);
+
+        n_calls = 0;
+        ts = bench_now();
+        for (size_t round = 0; round < BENCH_N_ROUNDS; ++round) {
+                for (i = 0; i < BENCH_N_INPUT; i += 2, ++n_calls)
+                        i += c_shquote_strncspn(input + i, BENCH_N_INPUT - i, C_SHQUOTE_CLASS_DOUBLE);
+        }
+        bench_report("class", density, n_calls, bench_now() - ts);
+}
+
+static int bench_unquote_double_legacy(char **outp,
+                                       size_t *n_outp,
+                                       const char **inp,
+                                       size_t *n_inp) {
+        const char *in = *inp;
+        size_t n_in = *n_inp, len;
+        int r;
+
+        c_shquote_skip_char(&in, &n_in);
+
+        while (n_in > 0) {
+                switch (*in) {
+                case '\\':
+                        r = c_shquote_unescape_char_quoted(outp, n_outp, &in, &n_in);
+                        if (r)
+                                return r;
+
+                        break;
+                case '\"':
+                        c_shquote_skip_char(&in, &n_in);
+                        *inp = in;
+                        *n_inp = n_in;
+                        return 0;
+                default:
+                        len = c_shquote_strncspn(in, n_in, C_SHQUOTE_CLASS_DOUBLE);
+                        r = c_shquote_consume_str(outp, n_outp, &in, &n_in, len);
+                        if (r)
+                                return r;
+
+                        break;
+                }
+        }
+
+        return C_SHQUOTE_E_BAD_QUOTING;
+}
+
+static void bench_unquote_double(size_t density) {
+        _c_cleanup_(c_freep) char *input = NULL, *output = NULL;
+        size_t n_input = BENCH_N_INPUT + 2, n_calls, n_in, n_out;
+        const char *in;
+        char *out;
+        uint64_t ts;
+        int r;
+
+        input = malloc(n_input);
+        output = malloc(n_input);
+        c_assert(input && output);
+
+        input[0] = '"';
+        bench_input(input + 1, BENCH_N_INPUT, density);
+        input[n_input - 1] = '"';
+        n_calls = BENCH_N_INPUT / density * BENCH_N_ROUNDS;
+
+        ts = bench_now();
+        for (size_t round = 0; round < BENCH_N_ROUNDS; ++round) {
+                in = input;
+                n_in = n_input;
+                out = output;
+                n_out = n_input;
+                r = bench_unquote_double_legacy(&out, &n_out, &in, &n_in);
+                c_assert(!r && !n_in);
+        }
+        bench_report("legacy", density, n_calls, bench_now() - ts);
+
+        ts = bench_now();
+        for (size_t round = 0; round < BENCH_N_ROUNDS; ++round) {
+                in = input;
+                n_in = n_input;
+                out = output;
+                n_out = n_input;
+                r = c_shquote_unquote_double(&out, &n_out, &in, &n_in);
+                c_assert(!r && !n_in);
+        }
+        bench_report("block", density, n_calls, bench_now() - ts);
+}
+
+static void bench_parse_next_dfa(size_t density) {
+        _c_cleanup_(c_freep) char *input = NULL, *output = NULL;
+        size_t n_calls, n_in, n_out;
+        const char *in, *start, *end;
+        char *out;
+        uint64_t ts;
+        int r;
+
+        input = malloc(BENCH_N_INPUT);
+        output = malloc(BENCH_N_INPUT);
+        c_assert(input && output);
+
+        /*
+         * Produce a command-line with a token every @density bytes, which is
+         * alternately a plain word, a single-quoted, and a double-quoted one.
+         */
+        for (size_t i = 0; i < BENCH_N_INPUT; ++i) {
+                if (i % density == density - 1)
+                        input[i] = ' ';
+                else if (i % density == 0 || i % density == density - 2)
+                        input[i] = "a'\""[(i / density) % 3];
+                else
+                        input[i] = 'a' + (i % 26);
+        }
+
+        for (unsigned int skip_runs = 0; skip_runs < 2; ++skip_runs) {
+                n_calls = 0;
+                ts = bench_now();
+                for (size_t round = 0; round < BENCH_N_ROUNDS; ++round) {
+                        in = input;
+                        n_in = BENCH_N_INPUT;
+
+                        for (;;) {
+                                out = output;
+                                n_out = BENCH_N_INPUT;
+                                r = c_shquote_parse_next_dfa(&out, &n_out, &in, &n_in, &start, &end, 0, skip_runs);
+                                if (r == C_SHQUOTE_E_EOF)
+                                        break;
+
+                                c_assert(!r);
+                                ++n_calls;
+                        }
+                }
+                bench_report(skip_runs ? "dfa" : "stepped", density, n_calls, bench_now() - ts);
+        }
+}
+
+int main(void) {
+        bench_strncspn(2);
+        bench_strncspn(4);
+        bench_strncspn(16);
+        bench_strncspn(64);
+        bench_unquote_double(2);
+        bench_unquote_double(4);
+        bench_unquote_double(16);
+        bench_unquote_double(64);
+        bench_parse_next_dfa(4);
+        bench_parse_next_dfa(16);
+        bench_parse_next_dfa(64);
+        return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Benchmarks against glib
+ *
+ * This times c_shquote_quote(), c_shquote_unquote() and
+ * c_shquote_parse_argv() against their glib counterparts g_shell_quote(),
+ * g_shell_unquote() and g_shell_parse_argv() on the same deterministic
+ * corpora, and prints the speedup of this implementation over glib. Note
+ * that the glib functions always allocate their result, while the
+ * c-shquote functions write into caller-provided buffers, where the API
+ * allows for it.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <c-stdaux.h>
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench-corpus.h"
+#include "c-shquote.h"
+
+#define BENCH_NSEC_MIN (UINT64_C(200) * 1000 * 1000)
+
+typedef struct BenchResult {
+        uint64_t nsec;
+        size_t n_bytes;
+} BenchResult;
+
+static uint64_t bench_now(void) {
+        struct timespec ts;
+        int r;
+
+        r = clock_gettime(CLOCK_MONOTONIC, &ts);
+        c_assert(!r);
+
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+static double bench_rate(BenchResult *result) {
+        return (double)result->n_bytes / (1024 * 1024) / ((double)result->nsec / 1e9);
+}
+
+static void bench_report(const char *function, BenchCorpus *corpus, BenchResult *c_result, BenchResult *g_result) {
+        printf("%-12s %-10s %10.1f MiB/s %10.1f MiB/s %8.2fx\n",
+               function,
+               corpus->name,
+               bench_rate(c_result),
+               bench_rate(g_result),
+               bench_rate(c_result) / bench_rate(g_result));
+}
+
+static void bench_quote(BenchCorpus *corpus, BenchResult *c_result, BenchResult *g_result) {
+        _c_cleanup_(c_freep) char *buffer = NULL;
+        size_t n_buffer = 0, n_out;
+        char *out;
+        int r;
+
+        for (size_t i = 0; i < corpus->n_tokens; ++i)
+                n_buffer = c_max(n_buffer, corpus->tokens[i].n_word * 4 + 2);
+
+        buffer = malloc(n_buffer);
+        c_assert(buffer);
+
+        c_result->nsec = bench_now();
+        do {
+                for (size_t i = 0; i < corpus->n_tokens; ++i) {
+                        out = buffer;
+                        n_out = n_buffer;
+                        r = c_shquote_quote(&out,
+                                            &n_out,
+                                            corpus->words + corpus->tokens[i].i_word,
+                                            corpus->tokens[i].n_word);
+                        c_assert(!r);
+                }
+
+                c_result->n_bytes += corpus->n_words - corpus->n_tokens;
+        } while (bench_now() - c_result->nsec < BENCH_NSEC_MIN);
+        c_result->nsec = bench_now() - c_result->nsec;
+
+        g_result->nsec = bench_now();
+        do {
+                for (size_t i = 0; i < corpus->n_tokens; ++i) {
+                        gchar *quoted;
+
+                        quoted = g_shell_quote(corpus->words + corpus->tokens[i].i_word);
+                        c_assert(quoted);
+                        g_free(quoted);
+                }
+
+                g_result->n_bytes += corpus->n_words - corpus->n_tokens;
+        } while (bench_now() - g_result->nsec < BENCH_NSEC_MIN);
+        g_result->nsec = bench_now() - g_result->nsec;
+}
+
+static void bench_unquote(BenchCorpus *corpus, BenchResult *c_result, BenchResult *g_result) {
+        _c_cleanup_(c_freep) char *buffer = NULL;
+        _c_cleanup_(c_freep) char *raw = NULL;
+        size_t n_raw = 0, n_out;
+        char *out;
+        int r;
+
+        /*
+         * glib requires zero-terminated input, so place every raw token in
+         * its own zero-terminated string, and use those for both
+         * implementations.
+         */
+        raw = malloc(corpus->n_data + corpus->n_tokens);
+        buffer = malloc(corpus->n_data);
+        c_assert(raw && buffer);
+
+        for (size_t i = 0; i < corpus->n_tokens; ++i) {
+                c_memcpy(raw + n_raw, corpus->data + corpus->tokens[i].i_raw, corpus->tokens[i].n_raw);
+                n_raw += corpus->tokens[i].n_raw;
+                raw[n_raw++] = '\0';
+        }
+
+        c_result->nsec = bench_now();
+        do {
+                for (size_t i = 0, i_raw = 0; i < corpus->n_tokens; ++i) {
+                        out = buffer;
+                        n_out = corpus->n_data;
+                        r = c_shquote_unquote(&out, &n_out, raw + i_raw, corpus->tokens[i].n_raw);
+                        c_assert(!r);
+
+                        i_raw += corpus->tokens[i].n_raw + 1;
+                }
+
+                c_result->n_bytes += n_raw - corpus->n_tokens;
+        } while (bench_now() - c_result->nsec < BENCH_NSEC_MIN);
+        c_result->nsec = bench_now() - c_result->nsec;
+
+        g_result->nsec = bench_now();
+        do {
+                for (size_t i = 0, i_raw = 0; i < corpus->n_tokens; ++i) {
+                        gchar *unquoted;
+
+                        unquoted = g_shell_unquote(raw + i_raw, NULL);
+                        c_assert(unquoted);
+                        g_free(unquoted);
+
+                        i_raw += corpus->tokens[i].n_raw + 1;
+                }
+
+                g_result->n_bytes += n_raw - corpus->n_tokens;
+        } while (bench_now() - g_result->nsec < BENCH_NSEC_MIN);
+        g_result->nsec = bench_now() - g_result->nsec;
+}
+
+static void bench_parse_argv(BenchCorpus *corpus, BenchResult *c_result, BenchResult *g_result) {
+        char **argv;
+        size_t argc;
+        int r;
+
+        c_result->nsec = bench_now();
+        do {
+                r = c_shquote_parse_argv(&argv, &argc, corpus->data, corpus->n_data);
+                c_assert(!r);
+                c_assert(argc == corpus->n_tokens);
+                free(argv);
+
+                c_result->n_bytes += corpus->n_data;
+        } while (bench_now() - c_result->nsec < BENCH_NSEC_MIN);
+        c_result->nsec = bench_now() - c_result->nsec;
+
+        g_result->nsec = bench_now();
+        do {
+                gchar **g_argv;
+                gint g_argc;
+                gboolean b;
+
+                b = g_shell_parse_argv(corpus->data, &g_argc, &g_argv, NULL);
+                c_assert(b);
+                c_assert((size_t)g_argc == corpus->n_tokens);
+                g_strfreev(g_argv);
+
+                g_result->n_bytes += corpus->n_data;
+        } while (bench_now() - g_result->nsec < BENCH_NSEC_MIN);
+        g_result->nsec = bench_now() - g_result->nsec;
+}
+
+int main(void) {
+        static const struct {
+                const char *name;
+                void (*fn)(BenchCorpus *corpus, BenchResult *c_result, BenchResult *g_result);
+        } functions[] = {
+                { "quote", bench_quote },
+                { "unquote", bench_unquote },
+                { "parse_argv", bench_parse_argv },
+        };
+        int r;
+
+        printf("%-12s %-10s %16s %16s %9s\n", "function", "corpus", "c-shquote", "glib", "speedup");
+
+        for (unsigned int type = 0; type < _BENCH_CORPUS_N; ++type) {
+                _c_cleanup_(bench_corpus_freep) BenchCorpus *corpus = NULL;
+
+                r = bench_corpus_new(&corpus, type);
+                c_assert(!r);
+
+                for (size_t i = 0; i < C_ARRAY_SIZE(functions); ++i) {
+                        BenchResult c_result = {}, g_result = {};
+
+                        functions[i].fn(corpus, &c_result, &g_result);
+                        bench_report(functions[i].name, corpus, &c_result, &g_result);
+                }
+        }
+
+        return 0;
+}
@@ -0,0 +1,262 @@
+/*
+ * Argument Blobs
+ *
+ * This implements a compact, pointer-free alternative to the argument arrays
+ * of c_shquote_parse_argv(). A blob is a single, contiguous block of bytes:
+ *
+ *     | size | argc | "arg0\0" "arg1\0" ... | offset[0] ... offset[argc - 1] |
+ *
+ * All integers are unsigned 32-bit little-endian, and need not be aligned.
+ * @size is the size of the entire blob, @argc the number of arguments, and
+ * each offset is relative to the start of the blob. Nothing in a blob refers
+ * to its own address, so it can be copied, shared, and written to disk as is,
+ * and read back on any machine.
+ *
+ * Compared to an argument array, each argument costs 4 bytes rather than 8 on
+ * 64-bit machines, and there is no terminating NULL. The length of an argument
+ * follows from the offset of the next one, so it is not stored. The offsets
+ * are placed behind the strings, since the number of arguments is only known
+ * once the input is parsed. This allows parsing in a single pass.
+ */
+
+#include <c-stdaux.h>
+#include <endian.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-shquote.h"
+#include "c-shquote-private.h"
+
+#define C_SHQUOTE_BLOB_HEADER (2 * sizeof(uint32_t))
+
+static uint32_t c_shquote_blob_read(const CShquoteBlob *blob, size_t offset) {
+        uint32_t v;
+
+        c_memcpy(&v, (const char *)blob + offset, sizeof(v));
+        return le32toh(v);
+}
+
+static void c_shquote_blob_write(CShquoteBlob *blob, size_t offset, uint32_t v) {
+        v = htole32(v);
+        c_memcpy((char *)blob + offset, &v, sizeof(v));
+}
+
+/**
+ * c_shquote_parse_argv_blob() - Parse Shell Command-Line into blob
+ * @blobp:              output variable for the blob
+ * @n_blobp:            output variable for the size of the blob
+ * @input:              input string
+ * @n_input:            length of input string
+ *
+ * This is like c_shquote_parse_argv(), but returns the arguments as a blob
+ * rather than an argument array. A blob is a single allocation that contains
+ * the zero-terminated arguments and their offsets, but no pointers. It is
+ * position-independent and can thus be copied, shared, and stored without
+ * any fixups. Use c_shquote_blob_get_argc() and c_shquote_blob_get_arg() to
+ * access the arguments, and c_shquote_blob_verify() to check blobs that come
+ * from untrusted sources.
+ *
+ * On success, @blobp contains the allocated blob, which the caller must
+ * free(3) when done, and @n_blobp contains its size. The blob is allocated
+ * with the exact size.
+ *
+ * Since offsets are stored in 32 bits, blobs cannot exceed UINT32_MAX bytes.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         -EOVERFLOW if the blob would exceed UINT32_MAX bytes,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes,
+ *         C_SHQUOTE_E_CONTAINS_NULL if the input contains a literal embedded
+ *         NULL character.
+ */
+_c_public_ int c_shquote_parse_argv_blob(CShquoteBlob **blobp,
+                                         size_t *n_blobp,
+                                         const char *input,
+                                         size_t n_input) {
+        _c_cleanup_(c_freep) CShquoteBlob *blob = NULL;
+        size_t n_argv, n_blob, n_strings, n_out, argc = 0;
+        char *out, *strings, *offsets;
+        uint32_t offset;
+        CShquoteBlob *b;
+        int r;
+
+        if (n_input > 0 && memchr(input, '\0', n_input))
+                return C_SHQUOTE_E_CONTAINS_NULL;
+        if (n_input > UINT32_MAX)
+                return -EOVERFLOW;
+
+        /*
+         * Use the same upper bounds as c_shquote_parse_argv_with_allocator()
+         * for the number of arguments and the size of the strings. The
+         * offsets are collected in native order behind the largest possible
+         * string area, and moved right behind the actual strings at the end.
+         */
+        n_argv = c_shquote_strncount(input, n_input, C_SHQUOTE_CLASS_WHITESPACE) + 1;
+        n_argv = c_min(n_argv, n_input / 2 + 1);
+        n_strings = n_input + 1;
+
+        if (__builtin_mul_overflow(n_argv, sizeof(uint32_t), &n_blob) ||
+            __builtin_add_overflow(n_blob, C_SHQUOTE_BLOB_HEADER + n_strings, &n_blob))
+                return -ENOMEM;
+
+        blob = malloc(n_blob);
+        if (!blob)
+                return -ENOMEM;
+
+        strings = (char *)blob + C_SHQUOTE_BLOB_HEADER;
+        offsets = strings + n_strings;
+        out = strings;
+        n_out = n_strings;
+
+        for (;;) {
+                char *token = out;
+
+                r = c_shquote_parse_next(&out, &n_out, &input, &n_input);
+                if (r) {
+                        if (r == C_SHQUOTE_E_EOF)
+                                break;
+
+                        c_assert(r != C_SHQUOTE_E_NO_SPACE);
+                        return r;
+                }
+
+                c_assert(argc < n_argv);
+
+                /* see c_shquote_parse_argv_fill() why this always fits */
+                r = c_shquote_append_char(&out, &n_out, '\0');
+                c_assert(!r);
+
+                offset = token - (char *)blob;
+                c_memcpy(offsets + argc++ * sizeof(offset), &offset, sizeof(offset));
+        }
+
+        n_blob = out - (char *)blob + argc * sizeof(uint32_t);
+        if (n_blob > UINT32_MAX)
+                return -EOVERFLOW;
+
+        /* the offsets only ever move towards the front */
+        for (size_t i = 0; i < argc; ++i) {
+                c_memcpy(&offset, offsets + i * sizeof(offset), sizeof(offset));
+                c_shquote_blob_write(blob, out - (char *)blob + i * sizeof(offset), offset);
+        }
+
+        c_shquote_blob_write(blob, 0, n_blob);
+        c_shquote_blob_write(blob, sizeof(uint32_t), argc);
+
+        /* shrinking in place never fails, but might move the block */
+        b = realloc(blob, n_blob);
+        if (b)
+                blob = b;
+
+        *blobp = blob;
+        *n_blobp = n_blob;
+        blob = NULL;
+        return 0;
+}
+
+/**
+ * c_shquote_blob_verify() - Verify blob
+ * @blob:               blob to verify
+ * @n_blob:             number of bytes available at @blob
+ *
+ * This verifies that the @n_blob bytes at @blob form a valid blob, as created
+ * by c_shquote_parse_argv_blob(). All other blob functions assume a valid
+ * blob, so this must be called on blobs from untrusted sources, like files,
+ * before accessing them. @blob need not be aligned.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         -EBADMSG if the blob is invalid.
+ */
+_c_public_ int c_shquote_blob_verify(const CShquoteBlob *blob, size_t n_blob) {
+        size_t size, argc, end, next;
+        const char *p;
+
+        if (n_blob < C_SHQUOTE_BLOB_HEADER)
+                return -EBADMSG;
+
+        size = c_shquote_blob_read(blob, 0);
+        argc = c_shquote_blob_read(blob, sizeof(uint32_t));
+        if (size != n_blob || argc > (size - C_SHQUOTE_BLOB_HEADER) / (sizeof(uint32_t) + 1))
+                return -EBADMSG;
+
+        /*
+         * The strings must be tightly packed, and each must be terminated by
+         * the first zero. Hence, every offset is implied by the previous one,
+         * and lengths calculated from offsets always match strlen(3).
+         */
+        end = size - argc * sizeof(uint32_t);
+        next = C_SHQUOTE_BLOB_HEADER;
+
+        for (size_t i = 0; i < argc; ++i) {
+                if (c_shquote_blob_read(blob, end + i * sizeof(uint32_t)) != next)
+                        return -EBADMSG;
+
+                p = memchr((const char *)blob + next, '\0', end - next);
+                if (!p)
+                        return -EBADMSG;
+
+                next = p + 1 - (const char *)blob;
+        }
+
+        if (next != end)
+                return -EBADMSG;
+
+        return 0;
+}
+
+/**
+ * c_shquote_blob_get_size() - Query size of blob
+ * @blob:               blob to operate on
+ *
+ * Return: The size of the blob in bytes.
+ */
+_c_public_ size_t c_shquote_blob_get_size(const CShquoteBlob *blob) {
+        return c_shquote_blob_read(blob, 0);
+}
+
+/**
+ * c_shquote_blob_get_argc() - Query number of arguments in blob
+ * @blob:               blob to operate on
+ *
+ * Return: The number of arguments in the blob.
+ */
+_c_public_ size_t c_shquote_blob_get_argc(const CShquoteBlob *blob) {
+        return c_shquote_blob_read(blob, sizeof(uint32_t));
+}
+
+/**
+ * c_shquote_blob_get_arg() - Query argument of blob
+ * @blob:               blob to operate on
+ * @i:                  index of the argument
+ * @n_argp:             output variable for the length of the argument, or NULL
+ *
+ * This returns the argument at index @i, which must be smaller than the
+ * number of arguments in the blob. The argument is zero-terminated and points
+ * into the blob. If @n_argp is not NULL, the length of the argument, without
+ * the terminating zero, is returned in it. This takes constant time.
+ *
+ * Return: Pointer to the argument.
+ */
+_c_public_ const char *c_shquote_blob_get_arg(const CShquoteBlob *blob,
+                                              size_t i,
+                                              size_t *n_argp) {
+        size_t size, argc, end, offset;
+
+        size = c_shquote_blob_read(blob, 0);
+        argc = c_shquote_blob_read(blob, sizeof(uint32_t));
+        end = size - argc * sizeof(uint32_t);
+
+        c_assert(i < argc);
+
+        offset = c_shquote_blob_read(blob, end + i * sizeof(uint32_t));
+        if (n_argp) {
+                if (i + 1 < argc)
+                        *n_argp = c_shquote_blob_read(blob, end + (i + 1) * sizeof(uint32_t)) - offset - 1;
+                else
+                        *n_argp = end - offset - 1;
+        }
+
+        return (const char *)blob + offset;
+}
@@ -0,0 +1,594 @@
+/*
+ * Argument Cache
+ *
+ * This implements a file format for pre-parsed command-lines, which can be
+ * mapped into memory and used in place. A cache file maps command-lines to
+ * their argument blobs, as created by c_shquote_parse_argv_blob():
+ *
+ *     | header | entry[0] ... entry[n - 1] | record[0] ... record[n - 1] |
+ *
+ * The header consists of the magic "CSHQUOTE", a 32-bit version, 32 reserved
+ * bits, a 64-bit checksum of everything behind the checksum, the 64-bit size
+ * of the file, and the 64-bit number of entries. Each entry consists of the
+ * 64-bit hash of a command-line and the 64-bit offset of its record. Entries
+ * are sorted by hash. A record consists of the 32-bit length of the
+ * command-line, the command-line itself, and its blob. Records are tightly
+ * packed in the order of their entries. All integers are little-endian, and
+ * nothing is aligned.
+ *
+ * Lookups hash the command-line, bisect the entries, and compare the
+ * command-line with the one stored in the record. Hence, an entry is only
+ * ever used for exactly the command-line it was built from, and anything
+ * that changed since the file was built is simply not found. Files of other
+ * versions are rejected as a whole.
+ *
+ * A loaded cache is never modified. Command-lines that are not in the file
+ * are parsed into blobs owned by the caller, so the cache does not grow with
+ * the input, and lookups on a single cache may run concurrently in any number
+ * of threads without locking.
+ */
+
+#include <c-stdaux.h>
+#include <endian.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-shquote.h"
+#include "c-shquote-private.h"
+
+#define C_SHQUOTE_CACHE_MAGIC "CSHQUOTE"
+#define C_SHQUOTE_CACHE_VERSION 1
+#define C_SHQUOTE_CACHE_CHECKSUM 16
+#define C_SHQUOTE_CACHE_HEADER 40
+#define C_SHQUOTE_CACHE_ENTRY 16
+
+typedef struct CShquoteCacheBuilderEntry {
+        uint64_t hash;
+        char *source;
+        size_t n_source;
+        CShquoteBlob *blob;
+        size_t n_blob;
+} CShquoteCacheBuilderEntry;
+
+struct CShquoteCacheBuilder {
+        CShquoteCacheBuilderEntry *entries;
+        size_t n_entries;
+        size_t z_entries;
+};
+
+struct CShquoteCache {
+        const char *data;
+        size_t n_entries;
+};
+
+static uint64_t c_shquote_cache_read64(const char *p) {
+        uint64_t v;
+
+        c_memcpy(&v, p, sizeof(v));
+        return le64toh(v);
+}
+
+static void c_shquote_cache_write64(char *p, uint64_t v) {
+        v = htole64(v);
+        c_memcpy(p, &v, sizeof(v));
+}
+
+static uint32_t c_shquote_cache_read32(const char *p) {
+        uint32_t v;
+
+        c_memcpy(&v, p, sizeof(v));
+        return le32toh(v);
+}
+
+static void c_shquote_cache_write32(char *p, uint32_t v) {
+        v = htole32(v);
+        c_memcpy(p, &v, sizeof(v));
+}
+
+static uint64_t c_shquote_cache_mix(uint64_t h, uint64_t w) {
+        h = (h ^ w) * UINT64_C(0x9e3779b97f4a7c15);
+        return h ^ (h >> 32);
+}
+
+/*
+ * This hashes the given data a word at a time. It serves both as checksum of
+ * cache files and as hash of command-lines, so it must produce the same result
+ * on all machines. Every step is a bijection of the state for a given word,
+ * and of the word for a given state. Hence, changing a single word always
+ * changes the result. Long inputs are hashed in four independent lanes, which
+ * the CPU can interleave, so the checksum of a file is bound by memory rather
+ * than by the latency of the multiplication. The lanes are then folded into a
+ * single state, and the final mixing spreads all bits over all bits.
+ */
+static uint64_t c_shquote_cache_hash(const char *data, size_t n_data) {
+        uint64_t lanes[4], h = UINT64_C(0x6a09e667f3bcc908) ^ n_data, w;
+        size_t i;
+
+        if (n_data >= sizeof(lanes)) {
+                for (i = 0; i < 4; ++i)
+                        lanes[i] = h + i;
+
+                for ( ; n_data >= sizeof(lanes); data += sizeof(lanes), n_data -= sizeof(lanes)) {
+                        for (i = 0; i < 4; ++i) {
+                                c_memcpy(&w, data + i * sizeof(w), sizeof(w));
+                                lanes[i] = c_shquote_cache_mix(lanes[i], le64toh(w));
+                        }
+                }
+
+                for (i = 0; i < 4; ++i)
+                        h = c_shquote_cache_mix(h, lanes[i]);
+        }
+
+        for ( ; n_data >= sizeof(w); data += sizeof(w), n_data -= sizeof(w)) {
+                c_memcpy(&w, data, sizeof(w));
+                h = c_shquote_cache_mix(h, le64toh(w));
+        }
+
+        w = 0;
+        c_memcpy(&w, data, n_data);
+        h = (h ^ le64toh(w)) * UINT64_C(0x9e3779b97f4a7c15);
+
+        h ^= h >> 30;
+        h *= UINT64_C(0xbf58476d1ce4e5b9);
+        h ^= h >> 27;
+        h *= UINT64_C(0x94d049bb133111eb);
+        h ^= h >> 31;
+
+        return h;
+}
+
+/**
+ * c_shquote_cache_builder_new() - Create cache builder
+ * @builderp:           output variable for the new builder
+ *
+ * This allocates a new, empty builder for cache files. Use
+ * c_shquote_cache_builder_add() to add command-lines, and
+ * c_shquote_cache_builder_finish() to serialize them into a cache file.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+_c_public_ int c_shquote_cache_builder_new(CShquoteCacheBuilder **builderp) {
+        CShquoteCacheBuilder *builder;
+
+        builder = calloc(1, sizeof(*builder));
+        if (!builder)
+                return -ENOMEM;
+
+        *builderp = builder;
+        return 0;
+}
+
+/**
+ * c_shquote_cache_builder_free() - Destroy cache builder
+ * @builder:            builder to operate on, or NULL
+ *
+ * This destroys the builder and releases all its resources. If NULL is
+ * passed, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ CShquoteCacheBuilder *c_shquote_cache_builder_free(CShquoteCacheBuilder *builder) {
+        if (!builder)
+                return NULL;
+
+        for (size_t i = 0; i < builder->n_entries; ++i) {
+                free(builder->entries[i].blob);
+                free(builder->entries[i].source);
+        }
+        free(builder->entries);
+        free(builder);
+
+        return NULL;
+}
+
+/**
+ * c_shquote_cache_builder_add() - Add command-line to cache builder
+ * @builder:            builder to operate on
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This parses the given command-line with c_shquote_parse_argv_blob(), and
+ * adds it to the builder. The input is copied. Adding the same command-line
+ * more than once is allowed, but it is stored only once.
+ *
+ * Return: 0 on success, negative error code on failure, or any error of
+ *         c_shquote_parse_argv_blob().
+ */
+_c_public_ int c_shquote_cache_builder_add(CShquoteCacheBuilder *builder,
+                                           const char *in,
+                                           size_t n_in) {
+        _c_cleanup_(c_freep) CShquoteBlob *blob = NULL;
+        CShquoteCacheBuilderEntry *entries, *entry;
+        size_t n_blob;
+        char *source;
+        int r;
+
+        r = c_shquote_parse_argv_blob(&blob, &n_blob, in, n_in);
+        if (r)
+                return r;
+
+        if (builder->n_entries >= builder->z_entries) {
+                size_t z = c_max(builder->z_entries * 2, (size_t)16);
+
+                entries = realloc(builder->entries, z * sizeof(*entries));
+                if (!entries)
+                        return -ENOMEM;
+
+                builder->entries = entries;
+                builder->z_entries = z;
+        }
+
+        source = malloc(c_max(n_in, (size_t)1));
+        if (!source)
+                return -ENOMEM;
+
+        c_memcpy(source, in, n_in);
+
+        entry = &builder->entries[builder->n_entries++];
+        entry->hash = c_shquote_cache_hash(in, n_in);
+        entry->source = source;
+        entry->n_source = n_in;
+        entry->blob = blob;
+        entry->n_blob = n_blob;
+        blob = NULL;
+
+        return 0;
+}
+
+static int c_shquote_cache_builder_compare(const void *a, const void *b) {
+        const CShquoteCacheBuilderEntry *x = a, *y = b;
+        int r;
+
+        if (x->hash != y->hash)
+                return x->hash < y->hash ? -1 : 1;
+
+        r = memcmp(x->source, y->source, c_min(x->n_source, y->n_source));
+        if (r)
+                return r;
+
+        return (x->n_source > y->n_source) - (x->n_source < y->n_source);
+}
+
+/**
+ * c_shquote_cache_builder_finish() - Serialize cache builder
+ * @builder:            builder to operate on
+ * @datap:              output variable for the cache file
+ * @n_datap:            output variable for the size of the cache file
+ *
+ * This serializes all command-lines added to the builder into a cache file,
+ * which can be loaded with c_shquote_cache_new(). The result does not depend
+ * on the order the command-lines were added in. On success, @datap contains
+ * the allocated cache file, which the caller must free(3) when done, and
+ * @n_datap contains its size. The builder can still be used afterwards.
+ *
+ * Writing the cache file to its final location is up to the caller. To make
+ * sure concurrent loaders never observe partial files, it should be written
+ * to a temporary file first, and then renamed.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+_c_public_ int c_shquote_cache_builder_finish(CShquoteCacheBuilder *builder,
+                                              void **datap,
+                                              size_t *n_datap) {
+        CShquoteCacheBuilderEntry *entries = builder->entries, *entry;
+        size_t n_entries = 0, n_data, offset;
+        char *data;
+
+        if (builder->n_entries > 0)
+                qsort(entries, builder->n_entries, sizeof(*entries), c_shquote_cache_builder_compare);
+
+        /* drop duplicates, which are adjacent after sorting */
+        for (size_t i = 0; i < builder->n_entries; ++i) {
+                if (n_entries > 0 && !c_shquote_cache_builder_compare(&entries[n_entries - 1], &entries[i])) {
+                        free(entries[i].blob);
+                        free(entries[i].source);
+                        continue;
+                }
+
+                entries[n_entries++] = entries[i];
+        }
+        builder->n_entries = n_entries;
+
+        /* neither sources nor blobs can exceed 4GiB, so only the sum can overflow */
+        n_data = C_SHQUOTE_CACHE_HEADER;
+        for (size_t i = 0; i < n_entries; ++i) {
+                entry = &entries[i];
+                if (__builtin_add_overflow(n_data,
+                                           C_SHQUOTE_CACHE_ENTRY + sizeof(uint32_t) + entry->n_source + entry->n_blob,
+                                           &n_data))
+                        return -ENOMEM;
+        }
+
+        data = malloc(n_data);
+        if (!data)
+                return -ENOMEM;
+
+        c_memcpy(data, C_SHQUOTE_CACHE_MAGIC, 8);
+        c_shquote_cache_write32(data + 8, C_SHQUOTE_CACHE_VERSION);
+        c_shquote_cache_write32(data + 12, 0);
+        c_shquote_cache_write64(data + 24, n_data);
+        c_shquote_cache_write64(data + 32, n_entries);
+
+        offset = C_SHQUOTE_CACHE_HEADER + n_entries * C_SHQUOTE_CACHE_ENTRY;
+        for (size_t i = 0; i < n_entries; ++i) {
+                entry = &entries[i];
+
+                c_shquote_cache_write64(data + C_SHQUOTE_CACHE_HEADER + i * C_SHQUOTE_CACHE_ENTRY, entry->hash);
+                c_shquote_cache_write64(data + C_SHQUOTE_CACHE_HEADER + i * C_SHQUOTE_CACHE_ENTRY + 8, offset);
+
+                c_shquote_cache_write32(data + offset, entry->n_source);
+                offset += sizeof(uint32_t);
+                c_memcpy(data + offset, entry->source, entry->n_source);
+                offset += entry->n_source;
+                c_memcpy(data + offset, entry->blob, entry->n_blob);
+                offset += entry->n_blob;
+        }
+
+        c_assert(offset == n_data);
+
+        c_shquote_cache_write64(data + C_SHQUOTE_CACHE_CHECKSUM,
+                                c_shquote_cache_hash(data + C_SHQUOTE_CACHE_CHECKSUM + 8,
+                                                     n_data - C_SHQUOTE_CACHE_CHECKSUM - 8));
+
+        *datap = data;
+        *n_datap = n_data;
+        return 0;
+}
+
+static int c_shquote_cache_verify(const char *data, size_t n_data, size_t *n_entriesp) {
+        uint64_t n_entries, hash, prev = 0, offset;
+        size_t n_source, n_blob;
+        const char *record;
+        int r;
+
+        if (n_data < C_SHQUOTE_CACHE_HEADER || memcmp(data, C_SHQUOTE_CACHE_MAGIC, 8))
+                return -EBADMSG;
+        if (c_shquote_cache_read32(data + 8) != C_SHQUOTE_CACHE_VERSION)
+                return -ESTALE;
+        if (c_shquote_cache_read32(data + 12) != 0 ||
+            c_shquote_cache_read64(data + 24) != n_data)
+                return -EBADMSG;
+
+        /* this covers everything but the magic and the version */
+        if (c_shquote_cache_read64(data + C_SHQUOTE_CACHE_CHECKSUM) !=
+            c_shquote_cache_hash(data + C_SHQUOTE_CACHE_CHECKSUM + 8, n_data - C_SHQUOTE_CACHE_CHECKSUM - 8))
+                return -EBADMSG;
+
+        n_entries = c_shquote_cache_read64(data + 32);
+        if (n_entries > (n_data - C_SHQUOTE_CACHE_HEADER) / C_SHQUOTE_CACHE_ENTRY)
+                return -EBADMSG;
+
+        /*
+         * The checksum catches corruption, but the structure is verified as
+         * well, so lookups never need any bounds checks. Records must be
+         * tightly packed, so each offset is implied by the previous record.
+         */
+        offset = C_SHQUOTE_CACHE_HEADER + n_entries * C_SHQUOTE_CACHE_ENTRY;
+        for (size_t i = 0; i < n_entries; ++i) {
+                hash = c_shquote_cache_read64(data + C_SHQUOTE_CACHE_HEADER + i * C_SHQUOTE_CACHE_ENTRY);
+                if (i > 0 && hash < prev)
+                        return -EBADMSG;
+                if (c_shquote_cache_read64(data + C_SHQUOTE_CACHE_HEADER + i * C_SHQUOTE_CACHE_ENTRY + 8) != offset)
+                        return -EBADMSG;
+
+                prev = hash;
+                record = data + offset;
+
+                if (n_data - offset < sizeof(uint32_t))
+                        return -EBADMSG;
+
+                n_source = c_shquote_cache_read32(record);
+                offset += sizeof(uint32_t);
+                if (n_data - offset < n_source + 2 * sizeof(uint32_t))
+                        return -EBADMSG;
+
+                offset += n_source;
+                n_blob = c_shquote_blob_get_size((const CShquoteBlob *)(data + offset));
+                if (n_data - offset < n_blob)
+                        return -EBADMSG;
+
+                r = c_shquote_blob_verify((const CShquoteBlob *)(data + offset), n_blob);
+                if (r)
+                        return r;
+
+                offset += n_blob;
+        }
+
+        if (offset != n_data)
+                return -EBADMSG;
+
+        *n_entriesp = n_entries;
+        return 0;
+}
+
+/**
+ * c_shquote_cache_new() - Load cache
+ * @cachep:             output variable for the new cache
+ * @data:               cache file, or NULL
+ * @n_data:             size of the cache file
+ *
+ * This creates a new cache from a cache file, as created by
+ * c_shquote_cache_builder_finish(). The file is used in place, so it is
+ * suitable to mmap(2) it. The caller must keep @data valid and unmodified for
+ * the lifetime of the cache. @data need not be aligned. The cache is never
+ * modified after it was created, so it can be shared between threads.
+ *
+ * Loading never parses any command-line. Instead, the file is validated in a
+ * single, linear pass, which verifies its checksum and its structure. If
+ * @data is NULL, an empty cache is created, with which
+ * c_shquote_cache_parse_argv() parses every command-line. This is meant as
+ * fallback if the file is stale, or cannot be read:
+ *
+ *     r = c_shquote_cache_new(&cache, data, n_data);
+ *     if (r == -EBADMSG || r == -ESTALE)
+ *             r = c_shquote_cache_new(&cache, NULL, 0);
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         -EBADMSG if @data is not a valid cache file,
+ *         -ESTALE if @data is a cache file of an unsupported version.
+ */
+_c_public_ int c_shquote_cache_new(CShquoteCache **cachep, const void *data, size_t n_data) {
+        CShquoteCache *cache;
+        size_t n_entries = 0;
+        int r;
+
+        if (data) {
+                r = c_shquote_cache_verify(data, n_data, &n_entries);
+                if (r)
+                        return r;
+        }
+
+        cache = calloc(1, sizeof(*cache));
+        if (!cache)
+                return -ENOMEM;
+
+        cache->data = data;
+        cache->n_entries = n_entries;
+
+        *cachep = cache;
+        return 0;
+}
+
+/**
+ * c_shquote_cache_free() - Destroy cache
+ * @cache:              cache to operate on, or NULL
+ *
+ * This destroys the cache and releases all its resources. The cache file is
+ * not released, and neither are blobs returned by
+ * c_shquote_cache_parse_argv() for command-lines not in the file. If NULL is
+ * passed, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ CShquoteCache *c_shquote_cache_free(CShquoteCache *cache) {
+        if (!cache)
+                return NULL;
+
+        free(cache);
+
+        return NULL;
+}
+
+/**
+ * c_shquote_cache_lookup() - Look up command-line in cache
+ * @cache:              cache to operate on
+ * @blobp:              output variable for the blob
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This looks up the given command-line in the cache file, and returns its
+ * blob in @blobp, if found. The blob points into the cache file. Only
+ * command-lines that are byte-for-byte identical to one the cache file was
+ * built from are found. This never parses anything.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         -ENOENT if the command-line is not in the cache file.
+ */
+_c_public_ int c_shquote_cache_lookup(const CShquoteCache *cache,
+                                      const CShquoteBlob **blobp,
+                                      const char *in,
+                                      size_t n_in) {
+        const char *entries = cache->data + C_SHQUOTE_CACHE_HEADER, *record;
+        size_t n = cache->n_entries, lo, hi, mid, step = 1;
+        uint64_t hash;
+
+        if (!n)
+                return -ENOENT;
+
+        hash = c_shquote_cache_hash(in, n_in);
+
+        /*
+         * Hashes are uniformly distributed, so the position of the first
+         * entry with the given hash can be guessed from the hash itself. The
+         * guess is usually off by a few entries only, so rather than bisecting
+         * the entire table, gallop from the guess to find a small range around
+         * it, and bisect that. This touches far fewer cache lines.
+         */
+        mid = n <= UINT32_MAX ? ((hash >> 32) * n) >> 32 : n / 2;
+        if (c_shquote_cache_read64(entries + mid * C_SHQUOTE_CACHE_ENTRY) < hash) {
+                lo = mid + 1;
+                while (lo + step <= n && c_shquote_cache_read64(entries + (lo + step - 1) * C_SHQUOTE_CACHE_ENTRY) < hash) {
+                        lo += step;
+                        step *= 2;
+                }
+                hi = c_min(lo + step - 1, n);
+        } else {
+                hi = mid;
+                while (hi >= step && c_shquote_cache_read64(entries + (hi - step) * C_SHQUOTE_CACHE_ENTRY) >= hash) {
+                        hi -= step;
+                        step *= 2;
+                }
+                lo = hi >= step ? hi - step + 1 : 0;
+        }
+
+        while (lo < hi) {
+                mid = lo + (hi - lo) / 2;
+                if (c_shquote_cache_read64(entries + mid * C_SHQUOTE_CACHE_ENTRY) < hash)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        for ( ; lo < cache->n_entries; ++lo) {
+                if (c_shquote_cache_read64(entries + lo * C_SHQUOTE_CACHE_ENTRY) != hash)
+                        break;
+
+                record = cache->data + c_shquote_cache_read64(entries + lo * C_SHQUOTE_CACHE_ENTRY + 8);
+                if (c_shquote_cache_read32(record) == n_in &&
+                    (n_in == 0 || !memcmp(record + sizeof(uint32_t), in, n_in))) {
+                        *blobp = (const CShquoteBlob *)(record + sizeof(uint32_t) + n_in);
+                        return 0;
+                }
+        }
+
+        return -ENOENT;
+}
+
+/**
+ * c_shquote_cache_parse_argv() - Parse Shell Command-Line via cache
+ * @cache:              cache to operate on
+ * @blobp:              output variable for the blob
+ * @parsedp:            output variable for a blob to free
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This is like c_shquote_cache_lookup(), but falls back to parsing the
+ * command-line with c_shquote_parse_argv_blob() if it is not in the cache
+ * file. If the command-line was found, its blob points into the cache file
+ * and NULL is returned in @parsedp. Otherwise, the parsed blob is returned in
+ * both @blobp and @parsedp, and the caller must free(3) it when done. Hence,
+ * callers can unconditionally free @parsedp.
+ *
+ * The cache is not modified either way, so this may be called on the same
+ * cache from multiple threads concurrently.
+ *
+ * Return: 0 on success, negative error code on failure, or any error of
+ *         c_shquote_parse_argv_blob().
+ */
+_c_public_ int c_shquote_cache_parse_argv(const CShquoteCache *cache,
+                                          const CShquoteBlob **blobp,
+                                          CShquoteBlob **parsedp,
+                                          const char *in,
+                                          size_t n_in) {
+        CShquoteBlob *blob;
+        size_t n_blob;
+        int r;
+
+        r = c_shquote_cache_lookup(cache, blobp, in, n_in);
+        if (r != -ENOENT) {
+                if (!r)
+                        *parsedp = NULL;
+                return r;
+        }
+
+        r = c_shquote_parse_argv_blob(&blob, &n_blob, in, n_in);
+        if (r)
+                return r;
+
+        *blobp = blob;
+        *parsedp = blob;
+        return 0;
+}
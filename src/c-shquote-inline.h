@@ -0,0 +1,386 @@
+#pragma once
+
+/**
+ * POSIX Shell Compatible Argument Parser - Inline Fast Path
+ *
+ * This header provides static-inline versions of c_shquote_quote(),
+ * c_shquote_unquote(), and c_shquote_parse_next(). They behave exactly like
+ * their library counterparts, but are compiled into the caller. Hence, the
+ * compiler can inline the entire tokenizer at the call-site, and specialize
+ * it for the given arguments. This is meant for hot loops of consumers that
+ * link the library statically, or embed it as subproject.
+ *
+ * The inline versions scan a word at a time rather than using the vectorized
+ * scanning kernels of the library, so they are fastest on inputs with short
+ * tokens, which is the common case. Very long tokens are better served by the
+ * library. The inline versions never collect statistics.
+ *
+ * Nothing in this header is part of the ABI of the shared library.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "c-shquote.h"
+
+static inline int c_shquote_inline_append(char **outp,
+                                          size_t *n_outp,
+                                          const char *in,
+                                          size_t n_in) {
+        if (n_in > *n_outp)
+                return C_SHQUOTE_E_NO_SPACE;
+
+        /* see c_shquote_append_str() for NULL and overlapping buffers */
+        if (*outp) {
+                if (n_in > 0 && *outp != in)
+                        memmove(*outp, in, n_in);
+                *outp += n_in;
+        }
+
+        *n_outp -= n_in;
+        return 0;
+}
+
+#define C_SHQUOTE_INLINE_LOW7 UINT64_C(0x7f7f7f7f7f7f7f7f)
+#define C_SHQUOTE_INLINE_HIGH UINT64_C(0x8080808080808080)
+#define C_SHQUOTE_INLINE_ONES UINT64_C(0x0101010101010101)
+
+/*
+ * This returns the length of the prefix of @in that consists of characters of
+ * @set, if @reject is false, or of characters not in @set, if @reject is
+ * true. After inlining, the matching is specialized for @set, and done a word
+ * at a time like in c_shquote_scan_swar(), so short spans need a single,
+ * predictable branch.
+ */
+static inline size_t c_shquote_inline_span(const char *in,
+                                           size_t n_in,
+                                           const char *set,
+                                           size_t n_set,
+                                           bool reject) {
+        size_t i = 0;
+
+#if defined(__GNUC__)
+        for ( ; i + sizeof(uint64_t) <= n_in; i += sizeof(uint64_t)) {
+                uint64_t word, v, hits = 0;
+
+                memcpy(&word, in + i, sizeof(word));
+
+                for (size_t j = 0; j < n_set; ++j) {
+                        v = word ^ (C_SHQUOTE_INLINE_ONES * (unsigned char)set[j]);
+                        hits |= ~(((v & C_SHQUOTE_INLINE_LOW7) + C_SHQUOTE_INLINE_LOW7) | v | C_SHQUOTE_INLINE_LOW7);
+                }
+
+                if (!reject)
+                        hits = ~hits & C_SHQUOTE_INLINE_HIGH;
+                if (hits) {
+#  if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                        return i + __builtin_ctzll(hits) / 8;
+#  else
+                        return i + __builtin_clzll(hits) / 8;
+#  endif
+                }
+        }
+#endif
+
+        for ( ; i < n_in; ++i) {
+                bool hit = false;
+
+                for (size_t j = 0; j < n_set; ++j)
+                        hit |= in[i] == set[j];
+
+                if (hit == reject)
+                        break;
+        }
+
+        return i;
+}
+
+static inline size_t c_shquote_inline_span_char(const char *in, size_t n_in, char c) {
+        const char *p = NULL;
+
+        if (n_in > 0)
+                p = (const char *)memchr(in, c, n_in);
+
+        return p ? (size_t)(p - in) : n_in;
+}
+
+static inline int c_shquote_inline_unquote_single(char **outp,
+                                                  size_t *n_outp,
+                                                  const char **inp,
+                                                  size_t *n_inp) {
+        size_t len;
+        int r;
+
+        len = c_shquote_inline_span_char(*inp + 1, *n_inp - 1, '\'');
+        if (len == *n_inp - 1)
+                return C_SHQUOTE_E_BAD_QUOTING;
+
+        r = c_shquote_inline_append(outp, n_outp, *inp + 1, len);
+        if (r)
+                return r;
+
+        *inp += len + 2;
+        *n_inp -= len + 2;
+        return 0;
+}
+
+static inline int c_shquote_inline_unquote_double(char **outp,
+                                                  size_t *n_outp,
+                                                  const char **inp,
+                                                  size_t *n_inp) {
+        const char *in = *inp + 1;
+        size_t n_in = *n_inp - 1, len;
+        int r;
+
+        for (;;) {
+                len = c_shquote_inline_span(in, n_in, "\"\\", 2, true);
+                r = c_shquote_inline_append(outp, n_outp, in, len);
+                if (r)
+                        return r;
+
+                in += len;
+                n_in -= len;
+
+                if (n_in == 0)
+                        return C_SHQUOTE_E_BAD_QUOTING;
+
+                if (*in == '\"')
+                        break;
+
+                if (n_in == 1)
+                        return C_SHQUOTE_E_BAD_QUOTING;
+
+                /* see c_shquote_unescape_char_quoted() */
+                switch (in[1]) {
+                case '\"':
+                case '\\':
+                case '`':
+                case '$':
+                case '\n':
+                        r = c_shquote_inline_append(outp, n_outp, in + 1, 1);
+                        break;
+                default:
+                        r = c_shquote_inline_append(outp, n_outp, in, 2);
+                        break;
+                }
+                if (r)
+                        return r;
+
+                in += 2;
+                n_in -= 2;
+        }
+
+        *inp = in + 1;
+        *n_inp = n_in - 1;
+        return 0;
+}
+
+static inline int c_shquote_inline_unescape(char **outp,
+                                            size_t *n_outp,
+                                            const char **inp,
+                                            size_t *n_inp,
+                                            bool *got_outputp) {
+        int r;
+
+        /* see c_shquote_unescape_char_unquoted() */
+        if (*n_inp > 1 && (*inp)[1] != '\n') {
+                r = c_shquote_inline_append(outp, n_outp, *inp + 1, 1);
+                if (r)
+                        return r;
+
+                *got_outputp = true;
+        }
+
+        *inp += *n_inp > 1 ? 2 : 1;
+        *n_inp -= *n_inp > 1 ? 2 : 1;
+        return 0;
+}
+
+/**
+ * c_shquote_inline_quote() - Quote string
+ * @outp:               output buffer for quoted string
+ * @n_outp:             length of output buffer
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This is the inline version of c_shquote_quote().
+ *
+ * Return: See c_shquote_quote().
+ */
+static inline int c_shquote_inline_quote(char **outp,
+                                         size_t *n_outp,
+                                         const char *in,
+                                         size_t n_in) {
+        size_t n_out = *n_outp, len;
+        char *out = *outp;
+        int r;
+
+        r = c_shquote_inline_append(&out, &n_out, "'", 1);
+        if (r)
+                return r;
+
+        for (;;) {
+                len = c_shquote_inline_span_char(in, n_in, '\'');
+                r = c_shquote_inline_append(&out, &n_out, in, len);
+                if (r)
+                        return r;
+
+                in += len;
+                n_in -= len;
+
+                if (n_in == 0)
+                        break;
+
+                r = c_shquote_inline_append(&out, &n_out, "'\\''", 4);
+                if (r)
+                        return r;
+
+                ++in;
+                --n_in;
+        }
+
+        r = c_shquote_inline_append(&out, &n_out, "'", 1);
+        if (r)
+                return r;
+
+        *outp = out;
+        *n_outp = n_out;
+        return 0;
+}
+
+/**
+ * c_shquote_inline_unquote() - Unquote string
+ * @outp:               output buffer
+ * @n_outp:             length of output buffer
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This is the inline version of c_shquote_unquote().
+ *
+ * Return: See c_shquote_unquote().
+ */
+static inline int c_shquote_inline_unquote(char **outp,
+                                           size_t *n_outp,
+                                           const char *in,
+                                           size_t n_in) {
+        size_t n_out = *n_outp, len;
+        char *out = *outp;
+        bool got_output = false;
+        int r;
+
+        while (n_in > 0) {
+                switch (*in) {
+                case '\'':
+                        r = c_shquote_inline_unquote_single(&out, &n_out, &in, &n_in);
+                        break;
+                case '\"':
+                        r = c_shquote_inline_unquote_double(&out, &n_out, &in, &n_in);
+                        break;
+                case '\\':
+                        r = c_shquote_inline_unescape(&out, &n_out, &in, &n_in, &got_output);
+                        break;
+                default:
+                        len = c_shquote_inline_span(in, n_in, "'\"\\", 3, true);
+                        r = c_shquote_inline_append(&out, &n_out, in, len);
+                        in += len;
+                        n_in -= len;
+                        break;
+                }
+                if (r)
+                        return r;
+        }
+
+        *outp = out;
+        *n_outp = n_out;
+        return 0;
+}
+
+/**
+ * c_shquote_inline_parse_next() - Parse next argument
+ * @outp:               output buffer to place next token
+ * @n_outp:             length of the output buffer
+ * @inp:                input string
+ * @n_inp:              length of input string
+ *
+ * This is the inline version of c_shquote_parse_next().
+ *
+ * Return: See c_shquote_parse_next().
+ */
+static inline int c_shquote_inline_parse_next(char **outp,
+                                              size_t *n_outp,
+                                              const char **inp,
+                                              size_t *n_inp) {
+        const char *in = *inp;
+        size_t n_in = *n_inp, n_out = *n_outp, len;
+        char *out = *outp;
+        bool got_output = false;
+        int r;
+
+        while (n_in > 0) {
+                switch (*in) {
+                case '\'':
+                        r = c_shquote_inline_unquote_single(&out, &n_out, &in, &n_in);
+                        got_output = true;
+                        break;
+                case '\"':
+                        r = c_shquote_inline_unquote_double(&out, &n_out, &in, &n_in);
+                        got_output = true;
+                        break;
+                case '\\':
+                        r = c_shquote_inline_unescape(&out, &n_out, &in, &n_in, &got_output);
+                        break;
+                case ' ':
+                case '\t':
+                case '\n':
+                        len = c_shquote_inline_span(in, n_in, " \t\n", 3, false);
+                        in += len;
+                        n_in -= len;
+
+                        if (got_output)
+                                goto out;
+
+                        r = 0;
+                        break;
+                case '#':
+                        if (!got_output) {
+                                len = c_shquote_inline_span_char(in, n_in, '\n');
+                                in += len;
+                                n_in -= len;
+                                r = 0;
+                        } else {
+                                r = c_shquote_inline_append(&out, &n_out, in, 1);
+                                ++in;
+                                --n_in;
+                        }
+                        break;
+                default:
+                        len = c_shquote_inline_span(in, n_in, "'\"\\ \t\n#", 7, true);
+                        r = c_shquote_inline_append(&out, &n_out, in, len);
+                        in += len;
+                        n_in -= len;
+                        got_output = true;
+                        break;
+                }
+                if (r)
+                        return r;
+        }
+
+out:
+        if (!got_output)
+                return C_SHQUOTE_E_EOF;
+
+        *outp = out;
+        *n_outp = n_out;
+        *inp = in;
+        *n_inp = n_in;
+        return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Argument Iterator
+ *
+ * This implements a pull-based iterator over the arguments of a command-line.
+ * Unlike c_shquote_parse_argv(), nothing is parsed up-front. Each call
+ * consumes exactly one token, so callers that only look at the first few
+ * arguments never pay for the rest of the line.
+ *
+ * Tokens that need no unquoting are returned directly from the input. All
+ * other tokens are unquoted into an internal buffer, which thus never grows
+ * bigger than the longest token that was copied. Tokens can also be skipped,
+ * in which case their quoting is validated, but nothing is written anywhere.
+ */
+
+#include <c-stdaux.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "c-shquote.h"
+#include "c-shquote-private.h"
+
+struct CShquoteIter {
+        const char *in;
+        size_t n_in;
+
+        char *buffer;
+        size_t z_buffer;
+};
+
+/**
+ * c_shquote_iter_new() - Create argument iterator
+ * @iterp:              output variable for the new iterator
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This allocates a new iterator over the arguments of the given input string.
+ * The input is not copied, nor parsed. Instead, the caller must keep it valid
+ * and unmodified for the lifetime of the iterator. Use c_shquote_iter_next()
+ * to retrieve the arguments one by one, and c_shquote_iter_skip_token() to
+ * step over arguments that are not needed.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+_c_public_ int c_shquote_iter_new(CShquoteIter **iterp, const char *in, size_t n_in) {
+        CShquoteIter *iter;
+
+        iter = calloc(1, sizeof(*iter));
+        if (!iter)
+                return -ENOMEM;
+
+        iter->in = in;
+        iter->n_in = n_in;
+
+        *iterp = iter;
+        return 0;
+}
+
+/**
+ * c_shquote_iter_free() - Destroy argument iterator
+ * @iter:               iterator to operate on, or NULL
+ *
+ * This destroys the iterator and releases all its resources. If NULL is
+ * passed, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ CShquoteIter *c_shquote_iter_free(CShquoteIter *iter) {
+        if (!iter)
+                return NULL;
+
+        free(iter->buffer);
+        free(iter);
+
+        return NULL;
+}
+
+/**
+ * c_shquote_iter_next() - Retrieve next argument
+ * @iter:               iterator to operate on
+ * @tokenp:             output variable for the next token
+ * @n_tokenp:           output variable for the length of the next token
+ *
+ * This parses the next token from the input, following the same rules as
+ * c_shquote_parse_next(), and advances the iterator past it. Only the next
+ * token is looked at, so the cost is proportional to its length, rather than
+ * to the length of the input.
+ *
+ * On success, @tokenp points to the token, which is not zero-terminated, and
+ * @n_tokenp contains its length. The token either points into the input, or
+ * into the internal buffer of the iterator. It stays valid until the next call
+ * into the iterator.
+ *
+ * On failure, the iterator is left unchanged.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_EOF when
+ *         the end of the input is reached without any further token,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input is invalid.
+ */
+_c_public_ int c_shquote_iter_next(CShquoteIter *iter,
+                                   const char **tokenp,
+                                   size_t *n_tokenp) {
+        const char *in = iter->in;
+        size_t n_in = iter->n_in, n_out = iter->z_buffer;
+        char *out = iter->buffer;
+        unsigned int flags;
+        char *buffer;
+        int r;
+
+        r = c_shquote_parse_next_view(tokenp, n_tokenp, &flags, &out, &n_out, &in, &n_in);
+        if (r == C_SHQUOTE_E_NO_SPACE) {
+                /*
+                 * The token does not fit into the buffer. Rather than growing
+                 * the buffer step by step, measure the token with a dry run,
+                 * which stops at its end, and then unquote it once more.
+                 */
+                out = NULL;
+                n_out = SIZE_MAX;
+                r = c_shquote_parse_next(&out, &n_out, &in, &n_in);
+                if (r)
+                        return r;
+
+                buffer = realloc(iter->buffer, SIZE_MAX - n_out);
+                if (!buffer)
+                        return -ENOMEM;
+
+                iter->buffer = buffer;
+                iter->z_buffer = SIZE_MAX - n_out;
+
+                in = iter->in;
+                n_in = iter->n_in;
+                out = iter->buffer;
+                n_out = iter->z_buffer;
+                r = c_shquote_parse_next_view(tokenp, n_tokenp, &flags, &out, &n_out, &in, &n_in);
+        }
+        if (r)
+                return r;
+
+        /* empty tokens are copied into the buffer, even if there is none */
+        *tokenp = *tokenp ?: "";
+
+        iter->in = in;
+        iter->n_in = n_in;
+        return 0;
+}
+
+/**
+ * c_shquote_iter_skip_token() - Skip next argument
+ * @iter:               iterator to operate on
+ *
+ * This advances the iterator past the next token, like c_shquote_iter_next()
+ * does, but never unquotes it. The quoting of the token is still validated,
+ * so the same errors are reported. This is the cheapest way to step over
+ * arguments that are not needed, and it never allocates.
+ *
+ * On failure, the iterator is left unchanged.
+ *
+ * Return: 0 on success, C_SHQUOTE_E_EOF when the end of the input is reached
+ *         without any further token, C_SHQUOTE_E_BAD_QUOTING if the input is
+ *         invalid.
+ */
+_c_public_ int c_shquote_iter_skip_token(CShquoteIter *iter) {
+        size_t n_out = SIZE_MAX;
+        char *out = NULL;
+
+        /* without an output buffer, parse_next() only validates */
+        return c_shquote_parse_next(&out, &n_out, &iter->in, &iter->n_in);
+}
+
+/**
+ * c_shquote_iter_get_remaining() - Query remaining input
+ * @iter:               iterator to operate on
+ * @inp:                output variable for the remaining input
+ * @n_inp:              output variable for the length of the remaining input
+ *
+ * This returns the part of the input that was not consumed by the iterator,
+ * yet. This allows callers to route on the first arguments, and then hand the
+ * unparsed rest of the line to another parser, or pass it on verbatim.
+ */
+_c_public_ void c_shquote_iter_get_remaining(CShquoteIter *iter,
+                                             const char **inp,
+                                             size_t *n_inp) {
+        *inp = iter->in;
+        *n_inp = iter->n_in;
+}
@@ -8,9 +8,118 @@
  */
 
 #include <c-stdaux.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include "c-shquote.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define C_SHQUOTE_SCAN_X86 1
+#endif
+
+/* statistics */
+
+#ifdef C_SHQUOTE_STATS
+#  define C_SHQUOTE_STATS_ADD(_field, _n) (c_shquote_stats._field += (_n))
+extern _Thread_local CShquoteStats c_shquote_stats;
+void c_shquote_stats_merge(CShquoteStats *to, const CShquoteStats *from);
+#else
+#  define C_SHQUOTE_STATS_ADD(_field, _n) ((void)0)
+#endif
+
+/* character classes */
+
+enum {
+        C_SHQUOTE_CLASS_TOKEN,                  /* '"\\ \t\n# */
+        C_SHQUOTE_CLASS_WORD,                   /* '"\\ \t\n */
+        C_SHQUOTE_CLASS_DOUBLE,                 /* \\" */
+        C_SHQUOTE_CLASS_UNQUOTE,                /* '"\\ */
+        C_SHQUOTE_CLASS_WHITESPACE,             /* ' ' \t \n */
+        C_SHQUOTE_CLASS_SINGLE,                 /* ' */
+        C_SHQUOTE_CLASS_NEWLINE,                /* \n */
+        C_SHQUOTE_CLASS_DOUBLE_ESCAPE,          /* "\\$` */
+        C_SHQUOTE_CLASS_LINE,                   /* '"\\#\n */
+        C_SHQUOTE_CLASS_WORD_DOLLAR,            /* '"\\ \t\n$ */
+        C_SHQUOTE_CLASS_UNQUOTE_DOLLAR,         /* '"\\$ */
+        C_SHQUOTE_CLASS_ANSI_C,                 /* '\\ */
+        _C_SHQUOTE_CLASS_N,
+};
+
+#define C_SHQUOTE_CLASS_CHARS_MAX 8
+
+typedef struct CShquoteClass {
+        const char *chars;
+        size_t n_chars;
+} CShquoteClass;
+
+extern const uint16_t c_shquote_class_table[UCHAR_MAX + 1];
+extern const CShquoteClass c_shquote_classes[_C_SHQUOTE_CLASS_N];
+
+static inline bool c_shquote_class_test(char c, unsigned int class) {
+        return c_shquote_class_table[(unsigned char)c] & (1U << class);
+}
+
+/* scanning kernels */
+
+typedef size_t (*CShquoteScanFn)(const char *string,
+                                 size_t n_string,
+                                 unsigned int class,
+                                 bool reject);
+
+size_t c_shquote_scan_swar(const char *string,
+                           size_t n_string,
+                           unsigned int class,
+                           bool reject);
+#if defined(C_SHQUOTE_SCAN_X86)
+size_t c_shquote_scan_sse2(const char *string,
+                           size_t n_string,
+                           unsigned int class,
+                           bool reject);
+size_t c_shquote_scan_avx2(const char *string,
+                           size_t n_string,
+                           unsigned int class,
+                           bool reject);
+#endif
+size_t c_shquote_scan(const char *string,
+                      size_t n_string,
+                      unsigned int class,
+                      bool reject);
+size_t c_shquote_strncount(const char *string,
+                           size_t n_string,
+                           unsigned int class);
+
+/* double-quote masks */
+
+#define C_SHQUOTE_MASK_BLOCK 64
+
+typedef struct CShquoteMasks {
+        uint64_t backslashes;                   /* \\ */
+        uint64_t quotes;                        /* " */
+        uint64_t specials;                      /* "\\$` \n */
+} CShquoteMasks;
+
+typedef void (*CShquoteMaskFn)(CShquoteMasks *masks, const char *block);
+
+void c_shquote_mask_double_swar(CShquoteMasks *masks, const char *block);
+#if defined(C_SHQUOTE_SCAN_X86)
+void c_shquote_mask_double_sse2(CShquoteMasks *masks, const char *block);
+void c_shquote_mask_double_avx2(CShquoteMasks *masks, const char *block);
+#endif
+void c_shquote_mask_double(CShquoteMasks *masks, const char *block);
+uint64_t c_shquote_mask_escapes(uint64_t backslashes);
+
+/* ANSI-C escape scanning */
+
+typedef size_t (*CShquoteScanEscapeFn)(const char *string, size_t n_string);
+
+size_t c_shquote_scan_escape_swar(const char *string, size_t n_string);
+#if defined(C_SHQUOTE_SCAN_X86)
+size_t c_shquote_scan_escape_sse2(const char *string, size_t n_string);
+size_t c_shquote_scan_escape_avx2(const char *string, size_t n_string);
+#endif
+size_t c_shquote_scan_escape(const char *string, size_t n_string);
+
 /* string management */
 
 int c_shquote_append_str(char **outp,
@@ -36,13 +145,24 @@ int c_shquote_consume_char(char **outp,
                            size_t *n_inp);
 size_t c_shquote_strnspn(const char *string,
                          size_t n_string,
-                         const char *accept);
+                         unsigned int class);
 size_t c_shquote_strncspn(const char *string,
                           size_t n_string,
-                          const char *reject);
+                          unsigned int class);
 
 /* quoting */
 
+/*
+ * The quote-states of the line splitter. Behind a newline that does not
+ * follow a backslash, the tokenizer is always in one of these.
+ */
+enum {
+        C_SHQUOTE_SPLIT_NONE,
+        C_SHQUOTE_SPLIT_SINGLE,
+        C_SHQUOTE_SPLIT_DOUBLE,
+        _C_SHQUOTE_SPLIT_N,
+};
+
 void c_shquote_discard_comment(const char **inp,
                                size_t *n_inp);
 void c_shquote_discard_whitespace(const char **inp,
@@ -63,6 +183,61 @@ int c_shquote_unquote_double(char **outp,
                              size_t *n_outp,
                              const char **inp,
                              size_t *n_inp);
+int c_shquote_unquote_ansi_c_rest(char **outp,
+                                  size_t *n_outp,
+                                  const char **inp,
+                                  size_t *n_inp);
+int c_shquote_unquote_ansi_c(char **outp,
+                             size_t *n_outp,
+                             const char **inp,
+                             size_t *n_inp);
+int c_shquote_parse_next_span(char **outp,
+                              size_t *n_outp,
+                              const char **inp,
+                              size_t *n_inp,
+                              const char **startp,
+                              const char **endp,
+                              unsigned int flags);
+int c_shquote_parse_next_dfa(char **outp,
+                             size_t *n_outp,
+                             const char **inp,
+                             size_t *n_inp,
+                             const char **startp,
+                             const char **endp,
+                             unsigned int flags,
+                             bool skip_runs);
+int c_shquote_parse_argv_fill(char **argv,
+                              size_t n_argv,
+                              uint32_t *starts,
+                              uint32_t *ends,
+                              char *out,
+                              size_t n_out,
+                              const char *in,
+                              size_t n_in,
+                              size_t *argcp);
+size_t c_shquote_split_line(unsigned int *splitp, const char *in, size_t n_in);
+int c_shquote_quote_select(unsigned int *stylep,
+                           size_t *n_outp,
+                           const char *in,
+                           size_t n_in,
+                           unsigned int style);
+int c_shquote_quote_single(char **outp,
+                           size_t *n_outp,
+                           const char *in,
+                           size_t n_in);
+int c_shquote_quote_double(char **outp,
+                           size_t *n_outp,
+                           const char *in,
+                           size_t n_in);
+int c_shquote_quote_backslash(char **outp,
+                              size_t *n_outp,
+                              const char *in,
+                              size_t n_in);
+size_t c_shquote_utf8_len(const char *in, size_t n_in);
+int c_shquote_quote_ansi_c(char **outp,
+                           size_t *n_outp,
+                           const char *in,
+                           size_t n_in);
 
 /* inline helpers */
 
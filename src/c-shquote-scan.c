@@ -0,0 +1,565 @@
+/*
+ * Character-Class Scanning
+ *
+ * This implements the scanning kernels behind c_shquote_strnspn() and
+ * c_shquote_strncspn(). Every kernel searches for the first byte whose
+ * membership in one of the fixed character-classes of the parser matches the
+ * requested polarity. The kernels only differ in how many bytes they look at
+ * in one step.
+ *
+ * All character-classes are known at compile-time, so their membership table
+ * and their member lists are static constants. No setup is needed per call.
+ *
+ * A portable SWAR (SIMD-within-a-register) kernel is always available. On x86
+ * we additionally provide SSE2 and AVX2 kernels, which are selected at load
+ * time based on the features of the running CPU. Until the selection is done,
+ * the portable kernel is used, so early callers are always safe.
+ *
+ * The same applies to the masking kernels behind c_shquote_mask_double(),
+ * which classify a fixed-size block of a double-quoted string into bitmasks,
+ * rather than searching for a single byte, and to the kernels behind
+ * c_shquote_scan_escape(), which search for a range of bytes rather than a
+ * character-class.
+ */
+
+#include <c-stdaux.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-shquote-private.h"
+
+#if defined(C_SHQUOTE_SCAN_X86)
+#include <immintrin.h>
+#endif
+
+#define C_SHQUOTE_SWAR_ONES UINT64_C(0x0101010101010101)
+#define C_SHQUOTE_SWAR_LOW7 UINT64_C(0x7f7f7f7f7f7f7f7f)
+#define C_SHQUOTE_SWAR_HIGH UINT64_C(0x8080808080808080)
+
+#define C_SHQUOTE_CLASS_BIT(_class) (1U << (_class))
+
+const uint16_t c_shquote_class_table[UCHAR_MAX + 1] = {
+        ['\''] = C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_TOKEN) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_UNQUOTE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_SINGLE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_LINE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD_DOLLAR) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_UNQUOTE_DOLLAR) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_ANSI_C),
+        ['\"'] = C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_TOKEN) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_DOUBLE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_UNQUOTE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_DOUBLE_ESCAPE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_LINE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD_DOLLAR) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_UNQUOTE_DOLLAR),
+        ['\\'] = C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_TOKEN) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_DOUBLE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_UNQUOTE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_DOUBLE_ESCAPE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_LINE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD_DOLLAR) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_UNQUOTE_DOLLAR) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_ANSI_C),
+        [' '] = C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_TOKEN) |
+                C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD) |
+                C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WHITESPACE) |
+                C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD_DOLLAR),
+        ['\t'] = C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_TOKEN) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WHITESPACE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD_DOLLAR),
+        ['\n'] = C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_TOKEN) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WHITESPACE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_NEWLINE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_LINE) |
+                 C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD_DOLLAR),
+        ['#'] = C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_TOKEN) |
+                C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_LINE),
+        ['$'] = C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_DOUBLE_ESCAPE) |
+                C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_WORD_DOLLAR) |
+                C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_UNQUOTE_DOLLAR),
+        ['`'] = C_SHQUOTE_CLASS_BIT(C_SHQUOTE_CLASS_DOUBLE_ESCAPE),
+};
+
+const CShquoteClass c_shquote_classes[_C_SHQUOTE_CLASS_N] = {
+        [C_SHQUOTE_CLASS_TOKEN] = { "'\"\\ \t\n#", 7 },
+        [C_SHQUOTE_CLASS_WORD] = { "'\"\\ \t\n", 6 },
+        [C_SHQUOTE_CLASS_DOUBLE] = { "\\\"", 2 },
+        [C_SHQUOTE_CLASS_UNQUOTE] = { "'\"\\", 3 },
+        [C_SHQUOTE_CLASS_WHITESPACE] = { " \t\n", 3 },
+        [C_SHQUOTE_CLASS_SINGLE] = { "'", 1 },
+        [C_SHQUOTE_CLASS_NEWLINE] = { "\n", 1 },
+        [C_SHQUOTE_CLASS_DOUBLE_ESCAPE] = { "\"\\$`", 4 },
+        [C_SHQUOTE_CLASS_LINE] = { "'\"\\#\n", 5 },
+        [C_SHQUOTE_CLASS_WORD_DOLLAR] = { "'\"\\ \t\n$", 7 },
+        [C_SHQUOTE_CLASS_UNQUOTE_DOLLAR] = { "'\"\\$", 4 },
+        [C_SHQUOTE_CLASS_ANSI_C] = { "'\\", 2 },
+};
+
+static size_t c_shquote_scan_tail(const char *string,
+                                  size_t n_string,
+                                  unsigned int class,
+                                  bool reject) {
+        for (size_t i = 0; i < n_string; ++i)
+                if (c_shquote_class_test(string[i], class) == reject)
+                        return i;
+
+        return n_string;
+}
+
+static uint64_t c_shquote_swar_eq(uint64_t word, uint64_t pattern) {
+        uint64_t v = word ^ pattern;
+
+        /*
+         * Set the high bit of every byte of @word that equals the byte in
+         * @pattern, and clear everything else. Unlike the classic
+         * `(v - 1) & ~v` trick, this never produces false positives due to
+         * borrows, so the result is exact for every byte.
+         */
+        return ~(((v & C_SHQUOTE_SWAR_LOW7) + C_SHQUOTE_SWAR_LOW7) | v | C_SHQUOTE_SWAR_LOW7);
+}
+
+static size_t c_shquote_swar_first(uint64_t mask) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_ctzll(mask) / 8;
+#else
+        return __builtin_clzll(mask) / 8;
+#endif
+}
+
+size_t c_shquote_scan_swar(const char *string,
+                           size_t n_string,
+                           unsigned int class,
+                           bool reject) {
+        const char *set = c_shquote_classes[class].chars;
+        size_t n_set = c_shquote_classes[class].n_chars;
+        uint64_t patterns[C_SHQUOTE_CLASS_CHARS_MAX];
+        size_t i = 0;
+
+        for (size_t j = 0; j < n_set; ++j)
+                patterns[j] = C_SHQUOTE_SWAR_ONES * (unsigned char)set[j];
+
+        for ( ; i + sizeof(uint64_t) <= n_string; i += sizeof(uint64_t)) {
+                uint64_t word, hits = 0;
+
+                c_memcpy(&word, string + i, sizeof(word));
+
+                for (size_t j = 0; j < n_set; ++j)
+                        hits |= c_shquote_swar_eq(word, patterns[j]);
+
+                if (!reject)
+                        hits = ~hits & C_SHQUOTE_SWAR_HIGH;
+                if (hits)
+                        return i + c_shquote_swar_first(hits);
+        }
+
+        return i + c_shquote_scan_tail(string + i, n_string - i, class, reject);
+}
+
+/**
+ * c_shquote_strncount() - Count class members
+ * @string:             string to scan
+ * @n_string:           length of @string
+ * @class:              character-class to count
+ *
+ * This counts the bytes in @string that are part of @class. The input is
+ * processed a word at a time, counting the matches of each word with a single
+ * population count.
+ *
+ * Return: Number of bytes in @string that are part of @class.
+ */
+size_t c_shquote_strncount(const char *string,
+                           size_t n_string,
+                           unsigned int class) {
+        const char *set = c_shquote_classes[class].chars;
+        size_t n_set = c_shquote_classes[class].n_chars;
+        uint64_t patterns[C_SHQUOTE_CLASS_CHARS_MAX];
+        size_t i = 0, n = 0;
+
+        for (size_t j = 0; j < n_set; ++j)
+                patterns[j] = C_SHQUOTE_SWAR_ONES * (unsigned char)set[j];
+
+        for ( ; i + sizeof(uint64_t) <= n_string; i += sizeof(uint64_t)) {
+                uint64_t word, hits = 0;
+
+                c_memcpy(&word, string + i, sizeof(word));
+
+                for (size_t j = 0; j < n_set; ++j)
+                        hits |= c_shquote_swar_eq(word, patterns[j]);
+
+                n += __builtin_popcountll(hits);
+        }
+
+        for ( ; i < n_string; ++i)
+                n += c_shquote_class_test(string[i], class);
+
+        C_SHQUOTE_STATS_ADD(n_scanned, n_string);
+        return n;
+}
+
+static uint64_t c_shquote_swar_movemask(uint64_t hits) {
+        /*
+         * Gather the high bits of all bytes into the low 8 bits, ordered by
+         * the position of the byte in memory. Each byte is shifted to its
+         * target bit by its own term of the multiplier. No two terms land on
+         * the same bit, so there are no carries.
+         */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return ((hits >> 7) * UINT64_C(0x0102040810204080)) >> 56;
+#else
+        return ((hits >> 7) * UINT64_C(0x8040201008040201)) >> 56;
+#endif
+}
+
+void c_shquote_mask_double_swar(CShquoteMasks *masks, const char *block) {
+        *masks = (CShquoteMasks){};
+
+        for (size_t i = 0; i < C_SHQUOTE_MASK_BLOCK; i += sizeof(uint64_t)) {
+                uint64_t word, backslashes, quotes, specials;
+
+                c_memcpy(&word, block + i, sizeof(word));
+
+                backslashes = c_shquote_swar_eq(word, C_SHQUOTE_SWAR_ONES * '\\');
+                quotes = c_shquote_swar_eq(word, C_SHQUOTE_SWAR_ONES * '"');
+                specials = backslashes | quotes |
+                           c_shquote_swar_eq(word, C_SHQUOTE_SWAR_ONES * '$') |
+                           c_shquote_swar_eq(word, C_SHQUOTE_SWAR_ONES * '`') |
+                           c_shquote_swar_eq(word, C_SHQUOTE_SWAR_ONES * '\n');
+
+                masks->backslashes |= c_shquote_swar_movemask(backslashes) << i;
+                masks->quotes |= c_shquote_swar_movemask(quotes) << i;
+                masks->specials |= c_shquote_swar_movemask(specials) << i;
+        }
+}
+
+static bool c_shquote_escape_test(char c) {
+        unsigned char u = (unsigned char)c;
+
+        return u < 0x20 || u >= 0x7f || u == '\'' || u == '\\';
+}
+
+size_t c_shquote_scan_escape_swar(const char *string, size_t n_string) {
+        size_t i = 0;
+
+        for ( ; i + sizeof(uint64_t) <= n_string; i += sizeof(uint64_t)) {
+                uint64_t word, hits;
+
+                c_memcpy(&word, string + i, sizeof(word));
+
+                /*
+                 * Adding 0x60 to the low 7 bits of a byte sets its high bit
+                 * exactly if they are at least 0x20, and never carries into
+                 * the next byte. Bytes with the high bit set are hits anyway.
+                 */
+                hits = (word & C_SHQUOTE_SWAR_HIGH) |
+                       (~((word & C_SHQUOTE_SWAR_LOW7) + C_SHQUOTE_SWAR_ONES * 0x60) & C_SHQUOTE_SWAR_HIGH) |
+                       c_shquote_swar_eq(word, C_SHQUOTE_SWAR_ONES * 0x7f) |
+                       c_shquote_swar_eq(word, C_SHQUOTE_SWAR_ONES * '\'') |
+                       c_shquote_swar_eq(word, C_SHQUOTE_SWAR_ONES * '\\');
+                if (hits)
+                        return i + c_shquote_swar_first(hits);
+        }
+
+        for ( ; i < n_string; ++i)
+                if (c_shquote_escape_test(string[i]))
+                        break;
+
+        return i;
+}
+
+#if defined(C_SHQUOTE_SCAN_X86)
+
+__attribute__((__target__("sse2")))
+size_t c_shquote_scan_sse2(const char *string,
+                           size_t n_string,
+                           unsigned int class,
+                           bool reject) {
+        const char *set = c_shquote_classes[class].chars;
+        size_t n_set = c_shquote_classes[class].n_chars;
+        __m128i needles[C_SHQUOTE_CLASS_CHARS_MAX];
+        size_t i = 0;
+
+        for (size_t j = 0; j < n_set; ++j)
+                needles[j] = _mm_set1_epi8(set[j]);
+
+        for ( ; i + sizeof(__m128i) <= n_string; i += sizeof(__m128i)) {
+                __m128i block, hits = _mm_setzero_si128();
+                uint32_t mask;
+
+                block = _mm_loadu_si128((const __m128i *)(string + i));
+
+                for (size_t j = 0; j < n_set; ++j)
+                        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[j]));
+
+                mask = (uint32_t)_mm_movemask_epi8(hits);
+                if (!reject)
+                        mask = ~mask & 0xffffU;
+                if (mask)
+                        return i + __builtin_ctz(mask);
+        }
+
+        return i + c_shquote_scan_tail(string + i, n_string - i, class, reject);
+}
+
+__attribute__((__target__("avx2")))
+size_t c_shquote_scan_avx2(const char *string,
+                           size_t n_string,
+                           unsigned int class,
+                           bool reject) {
+        const char *set = c_shquote_classes[class].chars;
+        size_t n_set = c_shquote_classes[class].n_chars;
+        __m256i needles[C_SHQUOTE_CLASS_CHARS_MAX];
+        size_t i = 0;
+
+        for (size_t j = 0; j < n_set; ++j)
+                needles[j] = _mm256_set1_epi8(set[j]);
+
+        for ( ; i + sizeof(__m256i) <= n_string; i += sizeof(__m256i)) {
+                __m256i block, hits = _mm256_setzero_si256();
+                uint32_t mask;
+
+                block = _mm256_loadu_si256((const __m256i *)(string + i));
+
+                for (size_t j = 0; j < n_set; ++j)
+                        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, needles[j]));
+
+                mask = (uint32_t)_mm256_movemask_epi8(hits);
+                if (!reject)
+                        mask = ~mask;
+                if (mask)
+                        return i + __builtin_ctz(mask);
+        }
+
+        /*
+         * Let the SSE2 kernel handle the remainder, so at most 15 bytes are
+         * left for the byte-wise loop. The SSE2 kernel uses legacy encodings,
+         * so clear the upper halves of the vector registers first. The
+         * compiler does not do this for us before the call, and running
+         * legacy SSE code with dirty upper halves is very expensive on many
+         * CPUs.
+         */
+        _mm256_zeroupper();
+        return i + c_shquote_scan_sse2(string + i, n_string - i, class, reject);
+}
+
+__attribute__((__target__("sse2")))
+void c_shquote_mask_double_sse2(CShquoteMasks *masks, const char *block) {
+        *masks = (CShquoteMasks){};
+
+        for (size_t i = 0; i < C_SHQUOTE_MASK_BLOCK; i += sizeof(__m128i)) {
+                __m128i v, backslashes, quotes, specials;
+
+                v = _mm_loadu_si128((const __m128i *)(block + i));
+
+                backslashes = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+                quotes = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+                specials = _mm_or_si128(_mm_or_si128(backslashes, quotes),
+                                        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('$')),
+                                                     _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('`')),
+                                                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')))));
+
+                masks->backslashes |= (uint64_t)(uint32_t)_mm_movemask_epi8(backslashes) << i;
+                masks->quotes |= (uint64_t)(uint32_t)_mm_movemask_epi8(quotes) << i;
+                masks->specials |= (uint64_t)(uint32_t)_mm_movemask_epi8(specials) << i;
+        }
+}
+
+__attribute__((__target__("avx2")))
+void c_shquote_mask_double_avx2(CShquoteMasks *masks, const char *block) {
+        *masks = (CShquoteMasks){};
+
+        for (size_t i = 0; i < C_SHQUOTE_MASK_BLOCK; i += sizeof(__m256i)) {
+                __m256i v, backslashes, quotes, specials;
+
+                v = _mm256_loadu_si256((const __m256i *)(block + i));
+
+                backslashes = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+                quotes = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+                specials = _mm256_or_si256(_mm256_or_si256(backslashes, quotes),
+                                           _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('$')),
+                                                           _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('`')),
+                                                                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')))));
+
+                masks->backslashes |= (uint64_t)(uint32_t)_mm256_movemask_epi8(backslashes) << i;
+                masks->quotes |= (uint64_t)(uint32_t)_mm256_movemask_epi8(quotes) << i;
+                masks->specials |= (uint64_t)(uint32_t)_mm256_movemask_epi8(specials) << i;
+        }
+}
+
+__attribute__((__target__("sse2")))
+size_t c_shquote_scan_escape_sse2(const char *string, size_t n_string) {
+        size_t i = 0;
+
+        for ( ; i + sizeof(__m128i) <= n_string; i += sizeof(__m128i)) {
+                __m128i v, hits;
+                uint32_t mask;
+
+                v = _mm_loadu_si128((const __m128i *)(string + i));
+
+                /* as signed bytes, everything from 0x80 on is below 0x20 */
+                hits = _mm_or_si128(_mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x20)),
+                                                 _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f))),
+                                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')),
+                                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+
+                mask = (uint32_t)_mm_movemask_epi8(hits);
+                if (mask)
+                        return i + __builtin_ctz(mask);
+        }
+
+        return i + c_shquote_scan_escape_swar(string + i, n_string - i);
+}
+
+__attribute__((__target__("avx2")))
+size_t c_shquote_scan_escape_avx2(const char *string, size_t n_string) {
+        size_t i = 0;
+
+        for ( ; i + sizeof(__m256i) <= n_string; i += sizeof(__m256i)) {
+                __m256i v, hits;
+                uint32_t mask;
+
+                v = _mm256_loadu_si256((const __m256i *)(string + i));
+
+                hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), v),
+                                                       _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f))),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')),
+                                                       _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))));
+
+                mask = (uint32_t)_mm256_movemask_epi8(hits);
+                if (mask)
+                        return i + __builtin_ctz(mask);
+        }
+
+        /* see c_shquote_scan_avx2() */
+        _mm256_zeroupper();
+        return i + c_shquote_scan_escape_sse2(string + i, n_string - i);
+}
+
+#endif
+
+static CShquoteScanFn c_shquote_scan_kernel = c_shquote_scan_swar;
+static CShquoteMaskFn c_shquote_mask_kernel = c_shquote_mask_double_swar;
+static CShquoteScanEscapeFn c_shquote_scan_escape_kernel = c_shquote_scan_escape_swar;
+
+#if defined(C_SHQUOTE_SCAN_X86)
+
+__attribute__((__constructor__))
+static void c_shquote_scan_init(void) {
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2")) {
+                c_shquote_scan_kernel = c_shquote_scan_avx2;
+                c_shquote_mask_kernel = c_shquote_mask_double_avx2;
+                c_shquote_scan_escape_kernel = c_shquote_scan_escape_avx2;
+        } else if (__builtin_cpu_supports("sse2")) {
+                c_shquote_scan_kernel = c_shquote_scan_sse2;
+                c_shquote_mask_kernel = c_shquote_mask_double_sse2;
+                c_shquote_scan_escape_kernel = c_shquote_scan_escape_sse2;
+        }
+}
+
+#endif
+
+/**
+ * c_shquote_scan() - Find first byte with given class-membership
+ * @string:             string to scan
+ * @n_string:           length of @string
+ * @class:              character-class to match against
+ * @reject:             polarity of the match
+ *
+ * This scans @string for the first byte whose membership in @class equals
+ * @reject. That is, if @reject is true, this returns the offset of the first
+ * byte that is part of @class, otherwise it returns the offset of the first
+ * byte that is not part of @class. If no such byte exists, @n_string is
+ * returned.
+ *
+ * The scan is performed by the fastest kernel supported by the running
+ * machine. Since the parser often calls this right in front of a special
+ * character, the first byte is checked via the class table before calling
+ * into the kernel.
+ *
+ * Return: Offset of the first matching byte, or @n_string if none.
+ */
+size_t c_shquote_scan(const char *string,
+                      size_t n_string,
+                      unsigned int class,
+                      bool reject) {
+        if (n_string == 0 || c_shquote_class_test(string[0], class) == reject)
+                return 0;
+
+        return 1 + c_shquote_scan_kernel(string + 1, n_string - 1, class, reject);
+}
+
+/**
+ * c_shquote_mask_double() - Classify block of double-quoted string
+ * @masks:              output variable for the masks
+ * @block:              block of C_SHQUOTE_MASK_BLOCK bytes
+ *
+ * This classifies every byte of @block, and sets bit N of each mask in @masks
+ * if byte N of @block is part of the respective set. The masks cover the bytes
+ * that c_shquote_unquote_double() must look at: backslashes, double quotes,
+ * and the characters that lose the backslash in front of them.
+ *
+ * The classification is performed by the fastest kernel supported by the
+ * running machine.
+ */
+void c_shquote_mask_double(CShquoteMasks *masks, const char *block) {
+        c_shquote_mask_kernel(masks, block);
+}
+
+/**
+ * c_shquote_mask_escapes() - Find escaping backslashes
+ * @backslashes:        mask of backslashes
+ *
+ * This takes the mask of backslashes of a block, and returns the mask of the
+ * backslashes that escape the byte following them. In a run of backslashes,
+ * the first one escapes the second, the third escapes the fourth, and so on.
+ * If a run has odd length, its last backslash escapes the byte after the run.
+ * The block must not start in the middle of an escape sequence.
+ *
+ * This handles all runs at once, rather than looking at them one by one:
+ * Adding the starts of the runs that start at odd bits to the mask clears
+ * exactly those runs, since the carry ripples through them. Of the bytes that
+ * follow a backslash, every other one is escaped, and the remaining runs tell
+ * for every such byte whether its run started at an even or an odd bit.
+ *
+ * Return: Mask of backslashes that escape the byte following them.
+ */
+uint64_t c_shquote_mask_escapes(uint64_t backslashes) {
+        const uint64_t even = UINT64_C(0x5555555555555555);
+        uint64_t follows, odd_starts, even_runs, escaped;
+
+        follows = backslashes << 1;
+        odd_starts = backslashes & ~even & ~follows;
+        even_runs = odd_starts + backslashes;
+        escaped = (even ^ (even_runs << 1)) & follows;
+
+        return backslashes & ~escaped;
+}
+
+/**
+ * c_shquote_scan_escape() - Find first byte that needs an ANSI-C escape
+ * @string:             string to scan
+ * @n_string:           length of @string
+ *
+ * This scans @string for the first byte that cannot be put verbatim into an
+ * ANSI-C quoted string, if the result must be line-safe, plain ASCII. These
+ * are all control characters, DEL, all bytes from 0x80 on, single quotes, and
+ * backslashes.
+ *
+ * The scan is performed by the fastest kernel supported by the running
+ * machine.
+ *
+ * Return: Offset of the first byte that needs escaping, or @n_string if none.
+ */
+size_t c_shquote_scan_escape(const char *string, size_t n_string) {
+        return c_shquote_scan_escape_kernel(string, n_string);
+}
@@ -0,0 +1,400 @@
+/*
+ * Streaming Tokenizer
+ *
+ * This implements a resumable variant of c_shquote_parse_next(). Input is fed
+ * in chunks of arbitrary size, and tokens are returned as soon as they are
+ * complete. All parser state (open quotes, pending escapes, comments, and
+ * whether the current token produced output already) is carried across
+ * chunks, so tokens can span any number of chunk boundaries.
+ *
+ * Tokens that are entirely contained in a single chunk and need no unquoting
+ * are returned directly from the chunk. Everything else is unquoted into an
+ * internal buffer, which thus never grows bigger than the longest token.
+ */
+
+#include <c-stdaux.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-shquote.h"
+#include "c-shquote-private.h"
+
+enum {
+        C_SHQUOTE_TOKENIZER_UNQUOTED,
+        C_SHQUOTE_TOKENIZER_SINGLE,
+        C_SHQUOTE_TOKENIZER_DOUBLE,
+        C_SHQUOTE_TOKENIZER_DOUBLE_ESCAPE,
+        C_SHQUOTE_TOKENIZER_ESCAPE,
+        C_SHQUOTE_TOKENIZER_COMMENT,
+};
+
+struct CShquoteTokenizer {
+        const char *in;
+        size_t n_in;
+
+        char *buffer;
+        size_t n_buffer;
+        size_t z_buffer;
+
+        unsigned int state;
+        bool got_output : 1;
+        bool finished : 1;
+        bool flushed : 1;
+};
+
+/**
+ * c_shquote_tokenizer_new() - Create streaming tokenizer
+ * @tokenizerp:         output variable for the new tokenizer
+ *
+ * This allocates a new streaming tokenizer. The tokenizer starts out without
+ * any input. Use c_shquote_tokenizer_feed() to provide input, and
+ * c_shquote_tokenizer_next_token() to retrieve tokens.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+_c_public_ int c_shquote_tokenizer_new(CShquoteTokenizer **tokenizerp) {
+        CShquoteTokenizer *tokenizer;
+
+        tokenizer = calloc(1, sizeof(*tokenizer));
+        if (!tokenizer)
+                return -ENOMEM;
+
+        tokenizer->state = C_SHQUOTE_TOKENIZER_UNQUOTED;
+
+        *tokenizerp = tokenizer;
+        return 0;
+}
+
+/**
+ * c_shquote_tokenizer_free() - Destroy streaming tokenizer
+ * @tokenizer:          tokenizer to operate on, or NULL
+ *
+ * This destroys the tokenizer and releases all its resources. If NULL is
+ * passed, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ CShquoteTokenizer *c_shquote_tokenizer_free(CShquoteTokenizer *tokenizer) {
+        if (!tokenizer)
+                return NULL;
+
+        free(tokenizer->buffer);
+        free(tokenizer);
+
+        return NULL;
+}
+
+/**
+ * c_shquote_tokenizer_feed() - Provide next input chunk
+ * @tokenizer:          tokenizer to operate on
+ * @in:                 input chunk
+ * @n_in:               length of input chunk
+ *
+ * This provides the next chunk of input to the tokenizer. The chunk is not
+ * copied. Instead, the caller must keep it valid and unmodified until
+ * c_shquote_tokenizer_next_token() returned C_SHQUOTE_E_EOF, which signals
+ * that the chunk was fully consumed and the next chunk can be fed.
+ *
+ * It is a programming error to feed a new chunk before the previous one was
+ * consumed, or after c_shquote_tokenizer_finish() was called.
+ */
+_c_public_ void c_shquote_tokenizer_feed(CShquoteTokenizer *tokenizer,
+                                         const char *in,
+                                         size_t n_in) {
+        c_assert(!tokenizer->finished);
+        c_assert(!tokenizer->n_in);
+
+        tokenizer->in = in;
+        tokenizer->n_in = n_in;
+}
+
+/**
+ * c_shquote_tokenizer_finish() - Mark end of input
+ * @tokenizer:          tokenizer to operate on
+ *
+ * This marks the end of the input. Once the current chunk is consumed,
+ * c_shquote_tokenizer_next_token() returns the final token, if any, and
+ * verifies that no quote is left open.
+ */
+_c_public_ void c_shquote_tokenizer_finish(CShquoteTokenizer *tokenizer) {
+        tokenizer->finished = true;
+}
+
+static int c_shquote_tokenizer_append(CShquoteTokenizer *tokenizer,
+                                      const char *in,
+                                      size_t n_in) {
+        size_t n_buffer;
+        char *buffer;
+
+        if (n_in > tokenizer->z_buffer - tokenizer->n_buffer) {
+                if (__builtin_add_overflow(tokenizer->n_buffer, n_in, &n_buffer))
+                        return -ENOMEM;
+
+                n_buffer = c_max(n_buffer, 2 * tokenizer->z_buffer);
+                n_buffer = c_max(n_buffer, (size_t)64);
+
+                buffer = realloc(tokenizer->buffer, n_buffer);
+                if (!buffer)
+                        return -ENOMEM;
+
+                tokenizer->buffer = buffer;
+                tokenizer->z_buffer = n_buffer;
+        }
+
+        c_memcpy(tokenizer->buffer + tokenizer->n_buffer, in, n_in);
+        tokenizer->n_buffer += n_in;
+        return 0;
+}
+
+static int c_shquote_tokenizer_consume(CShquoteTokenizer *tokenizer, size_t len) {
+        int r;
+
+        r = c_shquote_tokenizer_append(tokenizer, tokenizer->in, len);
+        if (r)
+                return r;
+
+        c_shquote_skip_str(&tokenizer->in, &tokenizer->n_in, len);
+        return 0;
+}
+
+static bool c_shquote_tokenizer_view(CShquoteTokenizer *tokenizer,
+                                     const char **tokenp,
+                                     size_t *n_tokenp) {
+        size_t len;
+
+        /*
+         * If a plain word starts a token and ends within the current chunk, we
+         * can return it verbatim. This is the same as
+         * c_shquote_parse_next_view() does, but we must not treat the end of
+         * the chunk as the end of the token, since the token might continue in
+         * the next chunk.
+         */
+
+        if (tokenizer->got_output ||
+            tokenizer->state != C_SHQUOTE_TOKENIZER_UNQUOTED ||
+            *tokenizer->in == '#')
+                return false;
+
+        len = c_shquote_strncspn(tokenizer->in, tokenizer->n_in, C_SHQUOTE_CLASS_WORD);
+        if (len == 0 || len == tokenizer->n_in ||
+            !c_shquote_class_test(tokenizer->in[len], C_SHQUOTE_CLASS_WHITESPACE))
+                return false;
+
+        *tokenp = tokenizer->in;
+        *n_tokenp = len;
+
+        c_shquote_skip_str(&tokenizer->in, &tokenizer->n_in, len);
+        c_shquote_discard_whitespace(&tokenizer->in, &tokenizer->n_in);
+        return true;
+}
+
+static int c_shquote_tokenizer_step(CShquoteTokenizer *tokenizer, bool *donep) {
+        size_t len;
+        int r;
+
+        switch (tokenizer->state) {
+        case C_SHQUOTE_TOKENIZER_UNQUOTED:
+                switch (*tokenizer->in) {
+                case '\'':
+                        c_shquote_skip_char(&tokenizer->in, &tokenizer->n_in);
+                        tokenizer->state = C_SHQUOTE_TOKENIZER_SINGLE;
+                        tokenizer->got_output = true;
+                        break;
+                case '\"':
+                        c_shquote_skip_char(&tokenizer->in, &tokenizer->n_in);
+                        tokenizer->state = C_SHQUOTE_TOKENIZER_DOUBLE;
+                        tokenizer->got_output = true;
+                        break;
+                case '\\':
+                        c_shquote_skip_char(&tokenizer->in, &tokenizer->n_in);
+                        tokenizer->state = C_SHQUOTE_TOKENIZER_ESCAPE;
+                        break;
+                case ' ':
+                case '\t':
+                case '\n':
+                        c_shquote_discard_whitespace(&tokenizer->in, &tokenizer->n_in);
+
+                        if (tokenizer->got_output)
+                                *donep = true;
+
+                        break;
+                case '#':
+                        if (!tokenizer->got_output) {
+                                tokenizer->state = C_SHQUOTE_TOKENIZER_COMMENT;
+                                break;
+                        }
+
+                        /* fallthrough */
+                default:
+                        /*
+                         * Consume until the next special character. Once we
+                         * produced output, comment characters are no longer
+                         * special.
+                         */
+                        len = c_shquote_strncspn(tokenizer->in, tokenizer->n_in, C_SHQUOTE_CLASS_WORD);
+                        r = c_shquote_tokenizer_consume(tokenizer, len);
+                        if (r)
+                                return r;
+
+                        tokenizer->got_output = true;
+                        break;
+                }
+
+                break;
+        case C_SHQUOTE_TOKENIZER_SINGLE:
+                len = c_shquote_strncspn(tokenizer->in, tokenizer->n_in, C_SHQUOTE_CLASS_SINGLE);
+                r = c_shquote_tokenizer_consume(tokenizer, len);
+                if (r)
+                        return r;
+
+                if (tokenizer->n_in > 0) {
+                        c_shquote_skip_char(&tokenizer->in, &tokenizer->n_in);
+                        tokenizer->state = C_SHQUOTE_TOKENIZER_UNQUOTED;
+                }
+
+                break;
+        case C_SHQUOTE_TOKENIZER_DOUBLE:
+                len = c_shquote_strncspn(tokenizer->in, tokenizer->n_in, C_SHQUOTE_CLASS_DOUBLE);
+                r = c_shquote_tokenizer_consume(tokenizer, len);
+                if (r)
+                        return r;
+
+                if (tokenizer->n_in > 0) {
+                        if (*tokenizer->in == '\"')
+                                tokenizer->state = C_SHQUOTE_TOKENIZER_UNQUOTED;
+                        else
+                                tokenizer->state = C_SHQUOTE_TOKENIZER_DOUBLE_ESCAPE;
+
+                        c_shquote_skip_char(&tokenizer->in, &tokenizer->n_in);
+                }
+
+                break;
+        case C_SHQUOTE_TOKENIZER_DOUBLE_ESCAPE:
+                /* See c_shquote_unescape_char_quoted() for the rules. */
+                switch (*tokenizer->in) {
+                case '"':
+                case '\\':
+                case '`':
+                case '$':
+                case '\n':
+                        break;
+                default:
+                        r = c_shquote_tokenizer_append(tokenizer, "\\", 1);
+                        if (r)
+                                return r;
+
+                        break;
+                }
+
+                r = c_shquote_tokenizer_consume(tokenizer, 1);
+                if (r)
+                        return r;
+
+                tokenizer->state = C_SHQUOTE_TOKENIZER_DOUBLE;
+                break;
+        case C_SHQUOTE_TOKENIZER_ESCAPE:
+                /* See c_shquote_unescape_char_unquoted() for the rules. */
+                if (*tokenizer->in == '\n') {
+                        c_shquote_skip_char(&tokenizer->in, &tokenizer->n_in);
+                } else {
+                        r = c_shquote_tokenizer_consume(tokenizer, 1);
+                        if (r)
+                                return r;
+
+                        tokenizer->got_output = true;
+                }
+
+                tokenizer->state = C_SHQUOTE_TOKENIZER_UNQUOTED;
+                break;
+        case C_SHQUOTE_TOKENIZER_COMMENT:
+                /* Skip up-to, but excluding, the next newline. */
+                len = c_shquote_strncspn(tokenizer->in, tokenizer->n_in, C_SHQUOTE_CLASS_NEWLINE);
+                c_shquote_skip_str(&tokenizer->in, &tokenizer->n_in, len);
+
+                if (tokenizer->n_in > 0)
+                        tokenizer->state = C_SHQUOTE_TOKENIZER_UNQUOTED;
+
+                break;
+        default:
+                return -ENOTRECOVERABLE;
+        }
+
+        return 0;
+}
+
+/**
+ * c_shquote_tokenizer_next_token() - Retrieve next token
+ * @tokenizer:          tokenizer to operate on
+ * @tokenp:             output variable for the next token
+ * @n_tokenp:           output variable for the length of the next token
+ *
+ * This parses the next token from the input fed to the tokenizer, following
+ * the same rules as c_shquote_parse_next(). If the current chunk is consumed
+ * before the next token is complete, the parser state is saved and
+ * C_SHQUOTE_E_EOF is returned. The caller should then feed the next chunk via
+ * c_shquote_tokenizer_feed(), or call c_shquote_tokenizer_finish() if there
+ * is no more input.
+ *
+ * Once the end of the input was marked, the final token is returned, and
+ * any further call returns C_SHQUOTE_E_EOF.
+ *
+ * On success, @tokenp points to the token, which is not zero-terminated, and
+ * @n_tokenp contains its length. The token either points into the current
+ * chunk, or into the internal buffer of the tokenizer. It stays valid until
+ * the next call into the tokenizer.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_EOF when
+ *         the current chunk was consumed without any further token,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input is invalid.
+ */
+_c_public_ int c_shquote_tokenizer_next_token(CShquoteTokenizer *tokenizer,
+                                              const char **tokenp,
+                                              size_t *n_tokenp) {
+        bool done = false;
+        int r;
+
+        if (tokenizer->flushed)
+                return C_SHQUOTE_E_EOF;
+
+        /* Drop the previous token, unless it is still being assembled. */
+        if (!tokenizer->got_output)
+                tokenizer->n_buffer = 0;
+
+        while (tokenizer->n_in > 0 && !done) {
+                if (c_shquote_tokenizer_view(tokenizer, tokenp, n_tokenp))
+                        return 0;
+
+                r = c_shquote_tokenizer_step(tokenizer, &done);
+                if (r)
+                        return r;
+        }
+
+        if (!done) {
+                if (!tokenizer->finished)
+                        return C_SHQUOTE_E_EOF;
+
+                switch (tokenizer->state) {
+                case C_SHQUOTE_TOKENIZER_SINGLE:
+                case C_SHQUOTE_TOKENIZER_DOUBLE:
+                case C_SHQUOTE_TOKENIZER_DOUBLE_ESCAPE:
+                        return C_SHQUOTE_E_BAD_QUOTING;
+                }
+
+                /*
+                 * A trailing unquoted backslash is dropped silently, and a
+                 * trailing comment needs no termination.
+                 */
+                tokenizer->state = C_SHQUOTE_TOKENIZER_UNQUOTED;
+                tokenizer->flushed = true;
+
+                if (!tokenizer->got_output)
+                        return C_SHQUOTE_E_EOF;
+        }
+
+        *tokenp = tokenizer->buffer ?: "";
+        *n_tokenp = tokenizer->n_buffer;
+        tokenizer->got_output = false;
+        return 0;
+}
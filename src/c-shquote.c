@@ -21,16 +21,34 @@
 #include "c-shquote.h"
 #include "c-shquote-private.h"
 
+#ifdef C_SHQUOTE_STATS
+_Thread_local CShquoteStats c_shquote_stats;
+#endif
+
 int c_shquote_append_str(char **outp,
                          size_t *n_outp,
                          const char *in,
                          size_t n_in) {
-        if (n_in > *n_outp)
+        if (n_in > *n_outp) {
+                C_SHQUOTE_STATS_ADD(n_no_space, 1);
                 return C_SHQUOTE_E_NO_SPACE;
+        }
 
-        c_memcpy(*outp, in, n_in);
+        /*
+         * A NULL output buffer is used to only calculate the size of the
+         * output. We still account for the space, but never write anything.
+         *
+         * When unquoting in place, the output trails the input and the two
+         * can overlap, so we must use memmove(3). As long as nothing was
+         * removed from the input, the output is the input, and we can skip
+         * the copy entirely.
+         */
+        if (*outp) {
+                if (n_in > 0 && *outp != in)
+                        memmove(*outp, in, n_in);
+                *outp += n_in;
+        }
 
-        *outp += n_in;
         *n_outp -= n_in;
 
         return 0;
@@ -71,6 +89,7 @@ int c_shquote_consume_str(char **outp,
                 return r;
 
         c_shquote_skip_str(inp, n_inp, len);
+        C_SHQUOTE_STATS_ADD(n_segments, 1);
 
         return 0;
 }
@@ -83,44 +102,31 @@ int c_shquote_consume_char(char **outp,
 }
 
 size_t c_shquote_strnspn(const char *string,
-                        size_t n_string,
-                        const char *accept) {
-        bool buffer[UCHAR_MAX + 1] = {};
-
-        for ( ; *accept; ++accept)
-                buffer[(unsigned char)*accept] = true;
-
-        for (size_t i = 0; i < n_string; ++i)
-                if (!buffer[(unsigned char)string[i]])
-                        return i;
+                         size_t n_string,
+                         unsigned int class) {
+        size_t len;
 
-        return n_string;
+        len = c_shquote_scan(string, n_string, class, false);
+        C_SHQUOTE_STATS_ADD(n_scanned, len);
+        return len;
 }
 
 size_t c_shquote_strncspn(const char *string,
                           size_t n_string,
-                          const char *reject) {
-        bool buffer[UCHAR_MAX + 1] = {};
-
-        if (strlen(reject) == 1) {
-                const char *p = NULL;
+                          unsigned int class) {
+        const char *p = NULL;
+        size_t len;
 
+        if (c_shquote_classes[class].n_chars == 1) {
                 if (n_string > 0)
-                        p = memchr(string, reject[0], n_string);
-                if (!p)
-                        return n_string;
-                else
-                        return p - string;
+                        p = memchr(string, c_shquote_classes[class].chars[0], n_string);
+                len = p ? (size_t)(p - string) : n_string;
+        } else {
+                len = c_shquote_scan(string, n_string, class, true);
         }
 
-        for ( ; *reject; ++reject)
-                buffer[(unsigned char)*reject] = true;
-
-        for (size_t i = 0; i < n_string; ++i)
-                if (buffer[(unsigned char)string[i]])
-                        return i;
-
-        return n_string;
+        C_SHQUOTE_STATS_ADD(n_scanned, len);
+        return len;
 }
 
 void c_shquote_discard_comment(const char **inp,
@@ -128,9 +134,10 @@ void c_shquote_discard_comment(const char **inp,
         size_t len;
 
         c_assert(**inp == '#');
+        C_SHQUOTE_STATS_ADD(n_comments, 1);
 
         /* Skip up-to, but excluding, the next newline. */
-        len = c_shquote_strncspn(*inp, *n_inp, "\n");
+        len = c_shquote_strncspn(*inp, *n_inp, C_SHQUOTE_CLASS_NEWLINE);
         c_shquote_skip_str(inp, n_inp, len);
 }
 
@@ -139,7 +146,7 @@ void c_shquote_discard_whitespace(const char **inp,
         size_t len;
 
         /* Skip until the next non-whitespace character. */
-        len = c_shquote_strnspn(*inp, *n_inp, " \t\n");
+        len = c_shquote_strnspn(*inp, *n_inp, C_SHQUOTE_CLASS_WHITESPACE);
         c_shquote_skip_str(inp, n_inp, len);
 }
 
@@ -157,6 +164,8 @@ int c_shquote_unescape_char_quoted(char **outp,
         if (n_in == 1)
                 return C_SHQUOTE_E_BAD_QUOTING;
 
+        C_SHQUOTE_STATS_ADD(n_escapes, 1);
+
         switch (in[1]) {
         case '"':
         case '\\':
@@ -202,6 +211,7 @@ int c_shquote_unescape_char_unquoted(char **outp,
         if (n_in == 0 || *in != '\\')
                 return -ENOTRECOVERABLE;
 
+        C_SHQUOTE_STATS_ADD(n_escapes, 1);
         c_shquote_skip_char(&in, &n_in);
 
         if (n_in > 0) {
@@ -219,6 +229,11 @@ int c_shquote_unescape_char_unquoted(char **outp,
         return 0;
 }
 
+/*
+ * The unquote helpers below consume the opening quote of their string, but do
+ * not count it in the statistics. Their callers do, since the tokenizer DFA
+ * counts quotes with its transitions, and only hands some strings over.
+ */
 int c_shquote_unquote_single(char **outp,
                              size_t *n_outp,
                              const char **inp,
@@ -233,7 +248,7 @@ int c_shquote_unquote_single(char **outp,
 
         c_shquote_skip_char(&in, &n_in);
 
-        len = c_shquote_strncspn(in, n_in, "'");
+        len = c_shquote_strncspn(in, n_in, C_SHQUOTE_CLASS_SINGLE);
         if (len == n_in)
                 return C_SHQUOTE_E_BAD_QUOTING;
 
@@ -263,30 +278,78 @@ int c_shquote_unquote_double(char **outp,
 
         c_shquote_skip_char(&in, &n_in);
 
+        /*
+         * Rather than stopping at every escape sequence, we classify a block
+         * of input at a time, resolve all escape sequences of the block with
+         * a few bit operations, and then copy everything between the
+         * backslashes we drop in bulk. The tail of the input is classified
+         * in a zero-padded copy, since zeroes are not special.
+         *
+         * A block never ends in the middle of an escape sequence. If the last
+         * byte of a block is an escaping backslash, it is left for the next
+         * block.
+         */
         while (n_in > 0) {
-                size_t len;
+                char tail[C_SHQUOTE_MASK_BLOCK];
+                CShquoteMasks masks;
+                uint64_t escapes, drops, ends, valid = UINT64_MAX;
+                size_t i, len, pos = 0;
 
-                switch (*in) {
-                case '\\':
-                        r = c_shquote_unescape_char_quoted(&out, &n_out, &in, &n_in);
+                if (n_in >= C_SHQUOTE_MASK_BLOCK) {
+                        c_shquote_mask_double(&masks, in);
+                } else {
+                        c_memzero(tail, sizeof(tail));
+                        c_memcpy(tail, in, n_in);
+                        c_shquote_mask_double(&masks, tail);
+                        valid = (UINT64_C(1) << n_in) - 1;
+                }
+
+                /* the first quote that is not escaped ends the string */
+                escapes = c_shquote_mask_escapes(masks.backslashes);
+                ends = masks.quotes & ~(escapes << 1) & valid;
+
+                if (ends) {
+                        len = __builtin_ctzll(ends);
+                        escapes &= (UINT64_C(1) << len) - 1;
+                } else {
+                        len = c_min(n_in, (size_t)C_SHQUOTE_MASK_BLOCK);
+                        escapes &= valid;
+                        if (escapes >> (len - 1)) {
+                                escapes &= ~(UINT64_C(1) << (len - 1));
+                                --len;
+                        }
+                }
+
+                /* drop backslashes in front of special characters */
+                drops = escapes & (masks.specials >> 1);
+
+                C_SHQUOTE_STATS_ADD(n_scanned, len);
+                C_SHQUOTE_STATS_ADD(n_escapes, __builtin_popcountll(escapes));
+                C_SHQUOTE_STATS_ADD(n_segments, __builtin_popcountll(drops) + 1);
+
+                for ( ; drops; drops &= drops - 1) {
+                        i = __builtin_ctzll(drops);
+                        r = c_shquote_append_str(&out, &n_out, in + pos, i - pos);
                         if (r)
                                 return r;
 
-                        break;
-                case '\"':
-                        c_shquote_skip_char(&in, &n_in);
+                        pos = i + 1;
+                }
+
+                r = c_shquote_append_str(&out, &n_out, in + pos, len - pos);
+                if (r)
+                        return r;
 
+                c_shquote_skip_str(&in, &n_in, len);
+
+                if (ends) {
+                        c_shquote_skip_char(&in, &n_in);
                         goto out;
-                default:
-                        /*
-                         * Consume until the next escape sequence or the next double
-                         * quote. If none exists, consume the rest of the string.
-                         */
-                        len = c_shquote_strncspn(in, n_in, "\\\"");
-                        r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
-                        if (r)
-                                return r;
                 }
+
+                /* the tail lacks a quote, or ends in a lone backslash */
+                if (valid != UINT64_MAX)
+                        break;
         }
 
         return C_SHQUOTE_E_BAD_QUOTING;
@@ -299,44 +362,316 @@ out:
         return 0;
 }
 
+static int c_shquote_unhex(char c) {
+        switch (c) {
+        case '0' ... '9':
+                return c - '0';
+        case 'a' ... 'f':
+                return c - 'a' + 10;
+        case 'A' ... 'F':
+                return c - 'A' + 10;
+        default:
+                return -1;
+        }
+}
+
+/*
+ * This decodes the escape sequence that follows a backslash in an ANSI-C
+ * quoted string. The decoded byte is returned in @cp, and the number of bytes
+ * the sequence spans after the backslash is returned. Unknown sequences, and
+ * "\x" without hex digits, return 0, and are kept verbatim by the caller, as
+ * other shells do. At most two hex digits, and three octal digits, are
+ * consumed.
+ */
+static size_t c_shquote_unescape_ansi_c(char *cp, const char *in, size_t n_in) {
+        unsigned int v = 0;
+        size_t i;
+
+        switch (in[0]) {
+        case 'a':
+                *cp = '\a';
+                return 1;
+        case 'b':
+                *cp = '\b';
+                return 1;
+        case 'e':
+        case 'E':
+                *cp = 0x1b;
+                return 1;
+        case 'f':
+                *cp = '\f';
+                return 1;
+        case 'n':
+                *cp = '\n';
+                return 1;
+        case 'r':
+                *cp = '\r';
+                return 1;
+        case 't':
+                *cp = '\t';
+                return 1;
+        case 'v':
+                *cp = '\v';
+                return 1;
+        case '\\':
+        case '\'':
+        case '"':
+        case '?':
+                *cp = in[0];
+                return 1;
+        case 'x':
+                for (i = 1; i < 3 && i < n_in && c_shquote_unhex(in[i]) >= 0; ++i)
+                        v = v * 16 + c_shquote_unhex(in[i]);
+                if (i == 1)
+                        return 0;
+
+                *cp = (char)v;
+                return i;
+        case '0' ... '7':
+                for (i = 0; i < 3 && i < n_in && in[i] >= '0' && in[i] <= '7'; ++i)
+                        v = v * 8 + (in[i] - '0');
+
+                *cp = (char)v;
+                return i;
+        default:
+                return 0;
+        }
+}
+
+/*
+ * This unquotes the remainder of an ANSI-C quoted string, whose opening "$'"
+ * was already consumed, up to and including the closing quote. Every escape
+ * sequence is at least as long as the byte it produces, so like with all
+ * other quotes, the output never outgrows the input.
+ */
+int c_shquote_unquote_ansi_c_rest(char **outp,
+                                  size_t *n_outp,
+                                  const char **inp,
+                                  size_t *n_inp) {
+        const char *in = *inp;
+        size_t n_in = *n_inp, n_out = *n_outp, len;
+        char *out = *outp, c;
+        int r;
+
+        for (;;) {
+                len = c_shquote_strncspn(in, n_in, C_SHQUOTE_CLASS_ANSI_C);
+                r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
+                if (r)
+                        return r;
+
+                if (n_in == 0)
+                        return C_SHQUOTE_E_BAD_QUOTING;
+
+                if (*in == '\'')
+                        break;
+
+                if (n_in == 1)
+                        return C_SHQUOTE_E_BAD_QUOTING;
+
+                C_SHQUOTE_STATS_ADD(n_escapes, 1);
+
+                len = c_shquote_unescape_ansi_c(&c, in + 1, n_in - 1);
+                if (len > 0) {
+                        r = c_shquote_append_char(&out, &n_out, c);
+                        ++len;
+                } else {
+                        r = c_shquote_append_str(&out, &n_out, in, 2);
+                        len = 2;
+                }
+                if (r)
+                        return r;
+
+                c_shquote_skip_str(&in, &n_in, len);
+        }
+
+        c_shquote_skip_char(&in, &n_in);
+
+        *outp = out;
+        *n_outp = n_out;
+        *inp = in;
+        *n_inp = n_in;
+        return 0;
+}
+
+int c_shquote_unquote_ansi_c(char **outp,
+                             size_t *n_outp,
+                             const char **inp,
+                             size_t *n_inp) {
+        const char *in = *inp;
+        size_t n_in = *n_inp;
+        int r;
+
+        if (n_in < 2 || in[0] != '$' || in[1] != '\'')
+                return -ENOTRECOVERABLE;
+
+        c_shquote_skip_str(&in, &n_in, 2);
+
+        r = c_shquote_unquote_ansi_c_rest(outp, n_outp, &in, &n_in);
+        if (r)
+                return r;
+
+        *inp = in;
+        *n_inp = n_in;
+        return 0;
+}
+
+/*
+ * Flags for every byte, used to classify strings before quoting them. Bytes
+ * without C_SHQUOTE_QUOTE_SAFE must be quoted or escaped. The set of safe
+ * bytes is deliberately conservative, and matches what other implementations
+ * consider safe. Note that '=' is not safe, since an unquoted '=' in the first
+ * word of a command-line denotes a variable assignment.
+ */
+enum {
+        C_SHQUOTE_QUOTE_SAFE                    = (1U << 0),
+        C_SHQUOTE_QUOTE_SINGLE                  = (1U << 1),
+        C_SHQUOTE_QUOTE_DOUBLE                  = (1U << 2),
+        C_SHQUOTE_QUOTE_NEWLINE                 = (1U << 3),
+};
+
+static const uint8_t c_shquote_quote_table[UCHAR_MAX + 1] = {
+        ['0' ... '9'] = C_SHQUOTE_QUOTE_SAFE,
+        ['A' ... 'Z'] = C_SHQUOTE_QUOTE_SAFE,
+        ['a' ... 'z'] = C_SHQUOTE_QUOTE_SAFE,
+        ['%'] = C_SHQUOTE_QUOTE_SAFE,
+        ['+'] = C_SHQUOTE_QUOTE_SAFE,
+        [','] = C_SHQUOTE_QUOTE_SAFE,
+        ['-'] = C_SHQUOTE_QUOTE_SAFE,
+        ['.'] = C_SHQUOTE_QUOTE_SAFE,
+        ['/'] = C_SHQUOTE_QUOTE_SAFE,
+        [':'] = C_SHQUOTE_QUOTE_SAFE,
+        ['@'] = C_SHQUOTE_QUOTE_SAFE,
+        ['_'] = C_SHQUOTE_QUOTE_SAFE,
+        ['\''] = C_SHQUOTE_QUOTE_SINGLE,
+        ['\"'] = C_SHQUOTE_QUOTE_DOUBLE,
+        ['\\'] = C_SHQUOTE_QUOTE_DOUBLE,
+        ['$'] = C_SHQUOTE_QUOTE_DOUBLE,
+        ['`'] = C_SHQUOTE_QUOTE_DOUBLE,
+        ['\n'] = C_SHQUOTE_QUOTE_NEWLINE,
+};
+
 /**
- * c_shquote_quote() - Quote string
- * @outp:               output buffer for quoted string
- * @n_outp:             length of output buffer
+ * c_shquote_quote_select() - Select quoting style
+ * @stylep:             output variable for the selected style
+ * @n_outp:             output variable for the length of the quoted string
  * @in:                 input string
  * @n_in:               length of input string
+ * @style:              requested style
  *
- * This takes an input string and quotes it according to the POSIX Shell
- * Quoting rules. The quoted string is written to @outp / @n_outp. The caller
- * is responsible to allocate a suitably sized buffer. If C_SHQUOTE_E_NO_SPACE
- * is returned, the caller should re-allocate a bigger buffer and retry the
- * operation.
- *
- * There is no canonical quoting result, but every string can be quoted in
- * several different ways. This function only ever uses single-quote quoting.
- * This will not neccessarily produce optimal output, but it produces
- * predictable and easy to parse results.
+ * This classifies the input string in a single pass, and calculates the
+ * length of the quoted string for every applicable quoting style. Then it
+ * resolves the requested style to the style actually used, and returns it
+ * together with the length of the quoted string.
  *
- * On success, @outp and @n_outp are adjusted to specify the remaining output
- * buffer and size.
+ * C_SHQUOTE_STYLE_BARE resolves to itself if the input needs no quoting at
+ * all, otherwise to C_SHQUOTE_STYLE_SINGLE. C_SHQUOTE_STYLE_BACKSLASH resolves
+ * to C_SHQUOTE_STYLE_SINGLE for the empty string. C_SHQUOTE_STYLE_AUTO resolves to
+ * the style with the shortest output, preferring the styles in the order
+ * bare, single, double, backslash, if their lengths are equal. It never
+ * resolves to C_SHQUOTE_STYLE_ANSI_C, since that needs C_SHQUOTE_FLAG_ANSI_C to
+ * be unquoted again. All other styles resolve to themselves.
  *
  * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_NO_SPACE
- *         if the output buffer is too small.
+ *         if the length of the quoted string exceeds the address space.
  */
-_c_public_ int c_shquote_quote(char **outp,
-                               size_t *n_outp,
-                               const char *in,
-                               size_t n_in) {
-        size_t n_out = *n_outp;
-        char *out = *outp;
-        int r;
+int c_shquote_quote_select(unsigned int *stylep,
+                           size_t *n_outp,
+                           const char *in,
+                           size_t n_in,
+                           unsigned int style) {
+        size_t n_unsafe = 0, n_single = 0, n_double = 0, n_newline = 0;
+        size_t n_styles[_C_SHQUOTE_STYLE_N];
+        bool valid[_C_SHQUOTE_STYLE_N] = {};
+
+        if (style == C_SHQUOTE_STYLE_ANSI_C) {
+                char *out = NULL;
+                size_t n_out = SIZE_MAX;
+
+                /*
+                 * The length depends on the UTF-8 sequences of the input, so
+                 * rather than classifying single bytes, do a dry run.
+                 */
+                if (c_shquote_quote_ansi_c(&out, &n_out, in, n_in))
+                        return C_SHQUOTE_E_NO_SPACE;
+
+                *stylep = style;
+                *n_outp = SIZE_MAX - n_out;
+                return 0;
+        }
+
+        for (size_t i = 0; i < n_in; ++i) {
+                uint8_t flags = c_shquote_quote_table[(unsigned char)in[i]];
+
+                n_unsafe += !(flags & C_SHQUOTE_QUOTE_SAFE);
+                n_single += !!(flags & C_SHQUOTE_QUOTE_SINGLE);
+                n_double += !!(flags & C_SHQUOTE_QUOTE_DOUBLE);
+                n_newline += !!(flags & C_SHQUOTE_QUOTE_NEWLINE);
+        }
 
         /*
-         * We always prepend and append a single quote. This will not produce
-         * optimal output, but ensures we produce the same output as other
-         * implementations do. If optimal output is needed, we can always
-         * provide an alternative implementation.
+         * Empty strings can only be represented with quotes. Apart from that,
+         * bare words must not contain any unsafe characters, and backslash
+         * escapes cannot represent newlines, so those are put in single
+         * quotes, costing two extra bytes each. All counts are bounded by
+         * @n_in, so we only need overflow checks for the quoted styles.
          */
+        valid[C_SHQUOTE_STYLE_BARE] = n_in > 0 && !n_unsafe;
+        n_styles[C_SHQUOTE_STYLE_BARE] = n_in;
+        valid[C_SHQUOTE_STYLE_BACKSLASH] = n_in > 0;
+        valid[C_SHQUOTE_STYLE_BACKSLASH] &= !__builtin_add_overflow(n_in, n_unsafe, &n_styles[C_SHQUOTE_STYLE_BACKSLASH]);
+        valid[C_SHQUOTE_STYLE_BACKSLASH] &= !__builtin_add_overflow(n_styles[C_SHQUOTE_STYLE_BACKSLASH], n_newline, &n_styles[C_SHQUOTE_STYLE_BACKSLASH]);
+        valid[C_SHQUOTE_STYLE_SINGLE] = !__builtin_mul_overflow(n_single, 3, &n_styles[C_SHQUOTE_STYLE_SINGLE]);
+        valid[C_SHQUOTE_STYLE_SINGLE] &= !__builtin_add_overflow(n_styles[C_SHQUOTE_STYLE_SINGLE], n_in, &n_styles[C_SHQUOTE_STYLE_SINGLE]);
+        valid[C_SHQUOTE_STYLE_SINGLE] &= !__builtin_add_overflow(n_styles[C_SHQUOTE_STYLE_SINGLE], 2, &n_styles[C_SHQUOTE_STYLE_SINGLE]);
+        valid[C_SHQUOTE_STYLE_DOUBLE] = !__builtin_add_overflow(n_in, n_double, &n_styles[C_SHQUOTE_STYLE_DOUBLE]);
+        valid[C_SHQUOTE_STYLE_DOUBLE] &= !__builtin_add_overflow(n_styles[C_SHQUOTE_STYLE_DOUBLE], 2, &n_styles[C_SHQUOTE_STYLE_DOUBLE]);
+
+        switch (style) {
+        case C_SHQUOTE_STYLE_SINGLE:
+        case C_SHQUOTE_STYLE_DOUBLE:
+                break;
+        case C_SHQUOTE_STYLE_BACKSLASH:
+                if (n_in == 0)
+                        style = C_SHQUOTE_STYLE_SINGLE;
+                break;
+        case C_SHQUOTE_STYLE_BARE:
+                if (!valid[C_SHQUOTE_STYLE_BARE])
+                        style = C_SHQUOTE_STYLE_SINGLE;
+                break;
+        case C_SHQUOTE_STYLE_AUTO: {
+                static const unsigned int order[] = {
+                        C_SHQUOTE_STYLE_BARE,
+                        C_SHQUOTE_STYLE_SINGLE,
+                        C_SHQUOTE_STYLE_DOUBLE,
+                        C_SHQUOTE_STYLE_BACKSLASH,
+                };
+
+                style = C_SHQUOTE_STYLE_SINGLE;
+                for (size_t i = 0; i < C_ARRAY_SIZE(order); ++i)
+                        if (valid[order[i]] && (!valid[style] || n_styles[order[i]] < n_styles[style]))
+                                style = order[i];
+
+                break;
+        }
+        default:
+                return -EINVAL;
+        }
+
+        if (!valid[style])
+                return C_SHQUOTE_E_NO_SPACE;
+
+        *stylep = style;
+        *n_outp = n_styles[style];
+        return 0;
+}
+
+int c_shquote_quote_single(char **outp,
+                           size_t *n_outp,
+                           const char *in,
+                           size_t n_in) {
+        size_t n_out = *n_outp;
+        char *out = *outp;
+        int r;
 
         r = c_shquote_append_char(&out, &n_out, '\'');
         if (r)
@@ -358,7 +693,7 @@ _c_public_ int c_shquote_quote(char **outp,
                          * Consume until the next single quote. If none exists,
                          * consume the rest of the string.
                          */
-                        len = c_shquote_strncspn(in, n_in, "'");
+                        len = c_shquote_strncspn(in, n_in, C_SHQUOTE_CLASS_SINGLE);
                         r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
                         if (r)
                                 return r;
@@ -374,185 +709,1671 @@ _c_public_ int c_shquote_quote(char **outp,
         return 0;
 }
 
-/**
- * c_shquote_unquote() - Unquote string
- * @outp:               output buffer
- * @n_outp:             length of output buffer
- * @in:                 input string
- * @n_in:               length of input string
- *
- * This unquotes the input string according to POSIX Shell Quoting rules. The
- * unquoted string is written to the output buffer @outp, which the caller must
- * pre-allocate. If C_SHQUOTE_E_NO_SPACE is returned, the caller must increase
- * the buffer size and retry the operation.
- *
- * This function guarantees that the produced output will never be bigger than
- * the given input. That is, if @n_outp is bigger than, or equal to, @n_in,
- * then this function will *NEVER* return C_SHQUOTE_E_NO_SPACE.
- *
- * The unquote operation *ALWAYS* produces a canonical output string. That is,
- * there is only one possible result of unquoting a given input string.
- *
- * On success, @outp and @n_outp are adjusted to specify the remaining output
- * buffer and size.
- *
- * Return: 0 on success, negative error code on failure,
- *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes,
- *         C_SHQUOTE_E_NO_SPACE if there is insufficient space in the output
- *         buffer.
- */
-_c_public_ int c_shquote_unquote(char **outp,
-                                 size_t *n_outp,
-                                 const char *in,
-                                 size_t n_in) {
+int c_shquote_quote_double(char **outp,
+                           size_t *n_outp,
+                           const char *in,
+                           size_t n_in) {
         size_t n_out = *n_outp;
         char *out = *outp;
         int r;
 
+        r = c_shquote_append_char(&out, &n_out, '\"');
+        if (r)
+                return r;
+
         while (n_in > 0) {
                 size_t len;
 
-                switch (*in) {
-                case '\'':
-                        r = c_shquote_unquote_single(&out, &n_out, &in, &n_in);
-                        if (r)
-                                return r;
-
-                        break;
-                case '\"':
-                        r = c_shquote_unquote_double(&out, &n_out, &in, &n_in);
-                        if (r)
-                                return r;
+                /*
+                 * Consume until the next character that is special within
+                 * double quotes, and prefix it with a backslash. Note that
+                 * newlines must not be escaped, since an escaped newline is a
+                 * line continuation and thus removed.
+                 */
+                len = c_shquote_strncspn(in, n_in, C_SHQUOTE_CLASS_DOUBLE_ESCAPE);
+                r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
+                if (r)
+                        return r;
 
-                        break;
-                case '\\':
-                        r = c_shquote_unescape_char_unquoted(&out, &n_out, &in, &n_in);
+                if (n_in > 0) {
+                        r = c_shquote_append_char(&out, &n_out, '\\');
                         if (r)
                                 return r;
 
-                        break;
-                default:
-                        /*
-                         * Consume until the next escape character. If none
-                         * exists, consume the rest of the string.
-                         */
-                        len = c_shquote_strncspn(in, n_in, "\'\"\\");
-                        r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
+                        r = c_shquote_consume_char(&out, &n_out, &in, &n_in);
                         if (r)
                                 return r;
                 }
         }
 
+        r = c_shquote_append_char(&out, &n_out, '\"');
+        if (r)
+                return r;
+
         *outp = out;
         *n_outp = n_out;
         return 0;
 }
 
-/**
- * c_shquote_parse_next() - Parse next argument
- * @outp:               output buffer to place next token
- * @n_outp:             length of the output buffer
- * @inp:                input string
- * @n_inp:              length of input string
- *
- * This parses the next argument of a concatenated argument string. That is, it
- * takes a Shell Command Line and splits of the next token. If the end of the
- * command line is reached, C_SHQUOTE_E_EOF is returned instead of the next
- * token.
- *
- * On success, @outp and @n_outp are adjusted to point to the remaining output
- * bufer, and @inp and @n_inp are adjusted to point to the remaining input
- * buffer.
- *
- * The caller is responsible to allocate a suitable output buffer. If the
- * output buffer is too small for the next element, C_SHQUOTE_E_NO_SPACE is
- * returned and the caller should retry the operation with a bigger output
- * buffer.
- *
- * Similarly to c_shquote_unquote(), the output is guaranteed to be shorter
- * than, or equal in length to, the input.
- *
- * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_EOF when
- *         the end of the input string is reached without any further token,
- *         C_SHQUOTE_E_BAD_QUOTING if the input is invalid,
- *         C_SHQUOTE_E_NO_SPACE if the output buffer is too short.
- */
-_c_public_ int c_shquote_parse_next(char **outp,
-                                    size_t *n_outp,
-                                    const char **inp,
+int c_shquote_quote_backslash(char **outp,
+                              size_t *n_outp,
+                              const char *in,
+                              size_t n_in) {
+        size_t n_out = *n_outp;
+        char *out = *outp;
+        int r;
+
+        if (n_in == 0)
+                return -ENOTRECOVERABLE;
+
+        while (n_in > 0) {
+                size_t len;
+
+                for (len = 0; len < n_in; ++len)
+                        if (!(c_shquote_quote_table[(unsigned char)in[len]] & C_SHQUOTE_QUOTE_SAFE))
+                                break;
+
+                r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
+                if (r)
+                        return r;
+
+                if (n_in > 0) {
+                        if (*in == '\n') {
+                                const char *escape = "'\n'";
+
+                                /*
+                                 * An escaped newline is a line continuation,
+                                 * so single-quote the newline instead.
+                                 */
+                                c_shquote_skip_char(&in, &n_in);
+
+                                r = c_shquote_append_str(&out, &n_out, escape, strlen(escape));
+                                if (r)
+                                        return r;
+                        } else {
+                                r = c_shquote_append_char(&out, &n_out, '\\');
+                                if (r)
+                                        return r;
+
+                                r = c_shquote_consume_char(&out, &n_out, &in, &n_in);
+                                if (r)
+                                        return r;
+                        }
+                }
+        }
+
+        *outp = out;
+        *n_outp = n_out;
+        return 0;
+}
+
+/**
+ * c_shquote_utf8_len() - Measure printable UTF-8 sequence
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This checks whether @in starts with a valid UTF-8 sequence that encodes a
+ * printable character. That is, overlong encodings, surrogates, code points
+ * past U+10FFFF, truncated sequences, and the C0 and C1 control characters
+ * are all rejected.
+ *
+ * Return: Length of the sequence, or 0 if it is invalid or not printable.
+ */
+size_t c_shquote_utf8_len(const char *in, size_t n_in) {
+        const unsigned char *u = (const unsigned char *)in;
+        unsigned char lo = 0x80, hi = 0xbf;
+        size_t len;
+
+        if (n_in == 0)
+                return 0;
+
+        if (u[0] < 0x80) {
+                return (u[0] >= 0x20 && u[0] < 0x7f) ? 1 : 0;
+        } else if (u[0] < 0xc2) {
+                return 0;
+        } else if (u[0] < 0xe0) {
+                len = 2;
+                if (u[0] == 0xc2)
+                        lo = 0xa0;
+        } else if (u[0] < 0xf0) {
+                len = 3;
+                if (u[0] == 0xe0)
+                        lo = 0xa0;
+                else if (u[0] == 0xed)
+                        hi = 0x9f;
+        } else if (u[0] < 0xf5) {
+                len = 4;
+                if (u[0] == 0xf0)
+                        lo = 0x90;
+                else if (u[0] == 0xf4)
+                        hi = 0x8f;
+        } else {
+                return 0;
+        }
+
+        if (n_in < len || u[1] < lo || u[1] > hi)
+                return 0;
+
+        for (size_t i = 2; i < len; ++i)
+                if (u[i] < 0x80 || u[i] > 0xbf)
+                        return 0;
+
+        return len;
+}
+
+int c_shquote_quote_ansi_c(char **outp,
+                           size_t *n_outp,
+                           const char *in,
+                           size_t n_in) {
+        static const char hex[] = "0123456789abcdef";
+        size_t n_out = *n_outp, len;
+        char *out = *outp, escape[4];
+        int r;
+
+        r = c_shquote_append_str(&out, &n_out, "$'", 2);
+        if (r)
+                return r;
+
+        while (n_in > 0) {
+                /*
+                 * Consume until the next byte that is not printable ASCII, or
+                 * needs escaping. Printable UTF-8 sequences are consumed as
+                 * well, everything else is escaped, so the result is always
+                 * a single, valid UTF-8 line.
+                 */
+                len = c_shquote_scan_escape(in, n_in);
+                r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
+                if (r)
+                        return r;
+
+                if (n_in == 0)
+                        break;
+
+                /* quotes and backslashes are printable, but still escaped */
+                len = ((unsigned char)*in >= 0x80) ? c_shquote_utf8_len(in, n_in) : 0;
+                if (len > 0) {
+                        r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
+                        if (r)
+                                return r;
+
+                        continue;
+                }
+
+                escape[0] = '\\';
+                len = 2;
+
+                switch (*in) {
+                case '\'':
+                case '\\':
+                        escape[1] = *in;
+                        break;
+                case '\a':
+                        escape[1] = 'a';
+                        break;
+                case '\b':
+                        escape[1] = 'b';
+                        break;
+                case '\t':
+                        escape[1] = 't';
+                        break;
+                case '\n':
+                        escape[1] = 'n';
+                        break;
+                case '\v':
+                        escape[1] = 'v';
+                        break;
+                case '\f':
+                        escape[1] = 'f';
+                        break;
+                case '\r':
+                        escape[1] = 'r';
+                        break;
+                default:
+                        escape[1] = 'x';
+                        escape[2] = hex[(unsigned char)*in >> 4];
+                        escape[3] = hex[(unsigned char)*in & 0xf];
+                        len = 4;
+                        break;
+                }
+
+                r = c_shquote_append_str(&out, &n_out, escape, len);
+                if (r)
+                        return r;
+
+                c_shquote_skip_char(&in, &n_in);
+        }
+
+        r = c_shquote_append_char(&out, &n_out, '\'');
+        if (r)
+                return r;
+
+        *outp = out;
+        *n_outp = n_out;
+        return 0;
+}
+
+/**
+ * c_shquote_quote() - Quote string
+ * @outp:               output buffer for quoted string
+ * @n_outp:             length of output buffer
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This takes an input string and quotes it according to the POSIX Shell
+ * Quoting rules. The quoted string is written to @outp / @n_outp. The caller
+ * is responsible to allocate a suitably sized buffer. If C_SHQUOTE_E_NO_SPACE
+ * is returned, the caller should re-allocate a bigger buffer and retry the
+ * operation.
+ *
+ * There is no canonical quoting result, but every string can be quoted in
+ * several different ways. This function only ever uses single-quote quoting.
+ * This will not neccessarily produce optimal output, but it produces
+ * predictable and easy to parse results. See c_shquote_quote_ex() for other
+ * quoting styles.
+ *
+ * On success, @outp and @n_outp are adjusted to specify the remaining output
+ * buffer and size.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_NO_SPACE
+ *         if the output buffer is too small.
+ */
+_c_public_ int c_shquote_quote(char **outp,
+                               size_t *n_outp,
+                               const char *in,
+                               size_t n_in) {
+        /*
+         * We always prepend and append a single quote. This will not produce
+         * optimal output, but ensures we produce the same output as other
+         * implementations do. If optimal output is needed, use
+         * c_shquote_quote_ex().
+         */
+        return c_shquote_quote_single(outp, n_outp, in, n_in);
+}
+
+/**
+ * c_shquote_quote_len() - Calculate length of quoted string
+ * @n_outp:             output variable for the length of the quoted string
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This calculates the exact number of bytes c_shquote_quote() produces when
+ * quoting the given input string. The caller can use this to allocate a
+ * suitable output buffer up-front, rather than retrying the operation on
+ * C_SHQUOTE_E_NO_SPACE.
+ *
+ * The quoted string is the input string wrapped in single quotes, with every
+ * single quote replaced by a 4-byte escape sequence. Hence, this only needs to
+ * count the single quotes in the input.
+ *
+ * On success, the length of the quoted string is returned in @n_outp.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_NO_SPACE
+ *         if the length of the quoted string exceeds the address space.
+ */
+_c_public_ int c_shquote_quote_len(size_t *n_outp,
+                                   const char *in,
+                                   size_t n_in) {
+        size_t n_out;
+
+        n_out = c_shquote_strncount(in, n_in, C_SHQUOTE_CLASS_SINGLE);
+        if (__builtin_mul_overflow(n_out, 3, &n_out) ||
+            __builtin_add_overflow(n_out, n_in, &n_out) ||
+            __builtin_add_overflow(n_out, 2, &n_out))
+                return C_SHQUOTE_E_NO_SPACE;
+
+        *n_outp = n_out;
+        return 0;
+}
+
+/**
+ * c_shquote_quote_ex() - Quote string with selectable style
+ * @outp:               output buffer for quoted string
+ * @n_outp:             length of output buffer
+ * @in:                 input string
+ * @n_in:               length of input string
+ * @style:              quoting style to use
+ *
+ * This is like c_shquote_quote(), but allows selecting the quoting style via
+ * @style:
+ *
+ *  * C_SHQUOTE_STYLE_SINGLE: The string is put in single quotes, and every
+ *    single quote is replaced by '\''. This is what c_shquote_quote() does.
+ *
+ *  * C_SHQUOTE_STYLE_DOUBLE: The string is put in double quotes, and every
+ *    double quote, backslash, dollar sign, and backtick is prefixed with a
+ *    backslash.
+ *
+ *  * C_SHQUOTE_STYLE_BACKSLASH: Every character that is not known to be safe
+ *    is prefixed with a backslash. Since escaped newlines are line
+ *    continuations, newlines are put in single quotes instead. The empty
+ *    string cannot be represented in this style, so single-quote quoting is
+ *    used for it.
+ *
+ *  * C_SHQUOTE_STYLE_BARE: If the string is not empty and consists of safe
+ *    characters only, it is written verbatim. Otherwise, single-quote quoting
+ *    is used.
+ *
+ *  * C_SHQUOTE_STYLE_AUTO: The style that produces the shortest output for
+ *    the given string is used.
+ *
+ *  * C_SHQUOTE_STYLE_ANSI_C: The string is put in ANSI-C quotes ($'...'), and
+ *    single quotes, backslashes, control characters, and bytes that are not
+ *    part of printable UTF-8 characters are escaped as \n, \t, \xHH, and
+ *    alike. The result is a single line of valid UTF-8, but can only be
+ *    unquoted with C_SHQUOTE_FLAG_ANSI_C, or by shells that support this
+ *    extension to POSIX.
+ *
+ * The input is classified in a single pass up-front, so if the output buffer
+ * is too small, C_SHQUOTE_E_NO_SPACE is returned without writing anything.
+ * Use c_shquote_quote_ex_len() to query the required size.
+ *
+ * On success, @outp and @n_outp are adjusted to specify the remaining output
+ * buffer and size.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_NO_SPACE
+ *         if the output buffer is too small.
+ */
+_c_public_ int c_shquote_quote_ex(char **outp,
+                                  size_t *n_outp,
+                                  const char *in,
+                                  size_t n_in,
+                                  unsigned int style) {
+        size_t n_out;
+        int r;
+
+        r = c_shquote_quote_select(&style, &n_out, in, n_in, style);
+        if (r)
+                return r;
+        if (n_out > *n_outp) {
+                C_SHQUOTE_STATS_ADD(n_no_space, 1);
+                return C_SHQUOTE_E_NO_SPACE;
+        }
+
+        switch (style) {
+        case C_SHQUOTE_STYLE_SINGLE:
+                r = c_shquote_quote_single(outp, n_outp, in, n_in);
+                break;
+        case C_SHQUOTE_STYLE_DOUBLE:
+                r = c_shquote_quote_double(outp, n_outp, in, n_in);
+                break;
+        case C_SHQUOTE_STYLE_BACKSLASH:
+                r = c_shquote_quote_backslash(outp, n_outp, in, n_in);
+                break;
+        case C_SHQUOTE_STYLE_BARE:
+                r = c_shquote_append_str(outp, n_outp, in, n_in);
+                break;
+        case C_SHQUOTE_STYLE_ANSI_C:
+                r = c_shquote_quote_ansi_c(outp, n_outp, in, n_in);
+                break;
+        default:
+                return -ENOTRECOVERABLE;
+        }
+
+        c_assert(!r);
+        return 0;
+}
+
+/**
+ * c_shquote_quote_ex_len() - Calculate length of quoted string
+ * @n_outp:             output variable for the length of the quoted string
+ * @in:                 input string
+ * @n_in:               length of input string
+ * @style:              quoting style to use
+ *
+ * This calculates the exact number of bytes c_shquote_quote_ex() produces
+ * when quoting the given input string with the given style.
+ *
+ * On success, the length of the quoted string is returned in @n_outp.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_NO_SPACE
+ *         if the length of the quoted string exceeds the address space.
+ */
+_c_public_ int c_shquote_quote_ex_len(size_t *n_outp,
+                                      const char *in,
+                                      size_t n_in,
+                                      unsigned int style) {
+        return c_shquote_quote_select(&style, n_outp, in, n_in, style);
+}
+
+/*
+ * The sizing pass of c_shquote_quote_argv() and c_shquote_quote_argv_alloc()
+ * remembers the length of each argument, and of its quoted form, so the
+ * quoting pass neither calls strlen(3) again, nor scans arguments without
+ * single quotes a second time. Command-lines rarely have more arguments than
+ * this, and any further arguments are simply measured again.
+ */
+#define C_SHQUOTE_ARGV_CACHE 32
+
+typedef struct CShquoteArgLen {
+        size_t n_in;
+        size_t n_out;
+} CShquoteArgLen;
+
+static int c_shquote_quote_argv_size(size_t *n_outp,
+                                     const char * const *argv,
+                                     size_t argc,
+                                     CShquoteArgLen *cache) {
+        size_t n_in, len, n_out = 0;
+        int r;
+
+        for (size_t i = 0; i < argc; ++i) {
+                n_in = strlen(argv[i]);
+                r = c_shquote_quote_len(&len, argv[i], n_in);
+                if (r)
+                        return r;
+
+                if (cache && i < C_SHQUOTE_ARGV_CACHE)
+                        cache[i] = (CShquoteArgLen){ .n_in = n_in, .n_out = len };
+
+                /* every argument but the first is preceded by a separator */
+                if (i > 0 && __builtin_add_overflow(len, 1, &len))
+                        return C_SHQUOTE_E_NO_SPACE;
+                if (__builtin_add_overflow(n_out, len, &n_out))
+                        return C_SHQUOTE_E_NO_SPACE;
+        }
+
+        *n_outp = n_out;
+        return 0;
+}
+
+static void c_shquote_quote_argv_emit(char **outp,
+                                      size_t *n_outp,
+                                      const char * const *argv,
+                                      size_t argc,
+                                      const CShquoteArgLen *cache) {
+        size_t n_in;
+        int r;
+
+        for (size_t i = 0; i < argc; ++i) {
+                if (i > 0) {
+                        r = c_shquote_append_char(outp, n_outp, ' ');
+                        c_assert(!r);
+                }
+
+                if (i >= C_SHQUOTE_ARGV_CACHE) {
+                        r = c_shquote_quote_single(outp, n_outp, argv[i], strlen(argv[i]));
+                        c_assert(!r);
+                        continue;
+                }
+
+                n_in = cache[i].n_in;
+                if (cache[i].n_out == n_in + 2) {
+                        /* no single quotes, so the argument is copied verbatim */
+                        r = c_shquote_append_char(outp, n_outp, '\'');
+                        c_assert(!r);
+                        r = c_shquote_append_str(outp, n_outp, argv[i], n_in);
+                        c_assert(!r);
+                        r = c_shquote_append_char(outp, n_outp, '\'');
+                        c_assert(!r);
+                } else {
+                        r = c_shquote_quote_single(outp, n_outp, argv[i], n_in);
+                        c_assert(!r);
+                }
+        }
+}
+
+/**
+ * c_shquote_quote_argv_len() - Calculate length of quoted command-line
+ * @n_outp:             output variable for the length of the command-line
+ * @argv:               argument array
+ * @argc:               number of arguments in @argv
+ *
+ * This calculates the exact number of bytes c_shquote_quote_argv() produces
+ * for the given argument array, excluding any terminating zero.
+ *
+ * On success, the length of the command-line is returned in @n_outp.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_NO_SPACE
+ *         if the length of the command-line exceeds the address space.
+ */
+_c_public_ int c_shquote_quote_argv_len(size_t *n_outp,
+                                        const char * const *argv,
+                                        size_t argc) {
+        return c_shquote_quote_argv_size(n_outp, argv, argc, NULL);
+}
+
+/**
+ * c_shquote_quote_argv() - Quote argument array into command-line
+ * @outp:               output buffer for the command-line
+ * @n_outp:             length of output buffer
+ * @argv:               argument array
+ * @argc:               number of arguments in @argv
+ *
+ * This quotes every argument in @argv with c_shquote_quote() and joins them
+ * with a single space into a Shell Command-Line. The result can be parsed
+ * back into the same argument array with c_shquote_parse_argv().
+ *
+ * The exact size of the command-line is calculated up-front, so if the output
+ * buffer is too small, C_SHQUOTE_E_NO_SPACE is returned without writing
+ * anything. Use c_shquote_quote_argv_len() to query the required size, or
+ * c_shquote_quote_argv_alloc() to have a suitable buffer allocated.
+ *
+ * The command-line is not zero-terminated. On success, @outp and @n_outp are
+ * adjusted to specify the remaining output buffer and size.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_NO_SPACE
+ *         if the output buffer is too small.
+ */
+_c_public_ int c_shquote_quote_argv(char **outp,
+                                    size_t *n_outp,
+                                    const char * const *argv,
+                                    size_t argc) {
+        CShquoteArgLen cache[C_SHQUOTE_ARGV_CACHE];
+        size_t len;
+        int r;
+
+        r = c_shquote_quote_argv_size(&len, argv, argc, cache);
+        if (r)
+                return r;
+        if (len > *n_outp) {
+                C_SHQUOTE_STATS_ADD(n_no_space, 1);
+                return C_SHQUOTE_E_NO_SPACE;
+        }
+
+        c_shquote_quote_argv_emit(outp, n_outp, argv, argc, cache);
+        return 0;
+}
+
+/**
+ * c_shquote_quote_argv_alloc() - Quote argument array into allocated buffer
+ * @linep:              output variable for the allocated command-line
+ * @n_linep:            output variable for the length of the command-line
+ * @argv:               argument array
+ * @argc:               number of arguments in @argv
+ *
+ * This is like c_shquote_quote_argv(), but allocates a suitably sized buffer
+ * for the command-line. The size is calculated up-front, so exactly one
+ * allocation is performed. The command-line is zero-terminated, and the
+ * caller is responsible to free(3) it when done.
+ *
+ * On success, @linep contains the allocated command-line and @n_linep its
+ * length, excluding the terminating zero.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+_c_public_ int c_shquote_quote_argv_alloc(char **linep,
+                                          size_t *n_linep,
+                                          const char * const *argv,
+                                          size_t argc) {
+        _c_cleanup_(c_shquote_freep) char *line = NULL;
+        CShquoteArgLen cache[C_SHQUOTE_ARGV_CACHE];
+        size_t n_line, n_out;
+        char *out;
+        int r;
+
+        r = c_shquote_quote_argv_size(&n_line, argv, argc, cache);
+        if (r)
+                return r == C_SHQUOTE_E_NO_SPACE ? -ENOMEM : r;
+        if (n_line == SIZE_MAX)
+                return -ENOMEM;
+
+        line = malloc(n_line + 1);
+        if (!line)
+                return -ENOMEM;
+
+        out = line;
+        n_out = n_line;
+        c_shquote_quote_argv_emit(&out, &n_out, argv, argc, cache);
+        c_assert(!n_out);
+        *out = '\0';
+
+        *linep = line;
+        *n_linep = n_line;
+        line = NULL;
+        return 0;
+}
+
+/**
+ * c_shquote_unquote() - Unquote string
+ * @outp:               output buffer
+ * @n_outp:             length of output buffer
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This unquotes the input string according to POSIX Shell Quoting rules. The
+ * unquoted string is written to the output buffer @outp, which the caller must
+ * pre-allocate. If C_SHQUOTE_E_NO_SPACE is returned, the caller must increase
+ * the buffer size and retry the operation.
+ *
+ * This function guarantees that the produced output will never be bigger than
+ * the given input. That is, if @n_outp is bigger than, or equal to, @n_in,
+ * then this function will *NEVER* return C_SHQUOTE_E_NO_SPACE. Furthermore,
+ * the output never gets ahead of the input, so the output buffer may be the
+ * input string itself. See c_shquote_unquote_inplace().
+ *
+ * The unquote operation *ALWAYS* produces a canonical output string. That is,
+ * there is only one possible result of unquoting a given input string.
+ *
+ * On success, @outp and @n_outp are adjusted to specify the remaining output
+ * buffer and size.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes,
+ *         C_SHQUOTE_E_NO_SPACE if there is insufficient space in the output
+ *         buffer.
+ */
+_c_public_ int c_shquote_unquote(char **outp,
+                                 size_t *n_outp,
+                                 const char *in,
+                                 size_t n_in) {
+        return c_shquote_unquote_ex(outp, n_outp, in, n_in, 0);
+}
+
+/**
+ * c_shquote_unquote_ex() - Unquote string with extensions
+ * @outp:               output buffer
+ * @n_outp:             length of output buffer
+ * @in:                 input string
+ * @n_in:               length of input string
+ * @flags:              extensions to enable
+ *
+ * This is like c_shquote_unquote(), but allows enabling extensions to the
+ * POSIX Shell Quoting rules via @flags:
+ *
+ *  * C_SHQUOTE_FLAG_ANSI_C: Outside of other quotes, "$'" starts an ANSI-C
+ *    quoted string, which is terminated by the next single quote that is not
+ *    escaped. Within, a backslash starts an escape sequence: \a, \b, \e,
+ *    \E, \f, \n, \r, \t, \v, \\, \', \", and \? resolve to the respective
+ *    character, \xHH to the byte with the value of one or two hex digits, and
+ *    \NNN to the byte with the value of one to three octal digits. Any other
+ *    backslash is kept verbatim, together with the character following it.
+ *    This reverts C_SHQUOTE_STYLE_ANSI_C of c_shquote_quote_ex().
+ *
+ * All guarantees of c_shquote_unquote() still hold.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes,
+ *         C_SHQUOTE_E_NO_SPACE if there is insufficient space in the output
+ *         buffer.
+ */
+_c_public_ int c_shquote_unquote_ex(char **outp,
+                                    size_t *n_outp,
+                                    const char *in,
+                                    size_t n_in,
+                                    unsigned int flags) {
+        size_t n_out = *n_outp;
+        char *out = *outp;
+        unsigned int class;
+        int r;
+
+        if (flags & ~C_SHQUOTE_FLAG_ANSI_C)
+                return -EINVAL;
+
+        class = (flags & C_SHQUOTE_FLAG_ANSI_C) ? C_SHQUOTE_CLASS_UNQUOTE_DOLLAR : C_SHQUOTE_CLASS_UNQUOTE;
+
+        while (n_in > 0) {
+                size_t len;
+
+                switch (*in) {
+                case '\'':
+                        C_SHQUOTE_STATS_ADD(n_quotes, 1);
+                        r = c_shquote_unquote_single(&out, &n_out, &in, &n_in);
+                        if (r)
+                                return r;
+
+                        break;
+                case '\"':
+                        C_SHQUOTE_STATS_ADD(n_quotes, 1);
+                        r = c_shquote_unquote_double(&out, &n_out, &in, &n_in);
+                        if (r)
+                                return r;
+
+                        break;
+                case '\\':
+                        r = c_shquote_unescape_char_unquoted(&out, &n_out, &in, &n_in);
+                        if (r)
+                                return r;
+
+                        break;
+                case '$':
+                        if ((flags & C_SHQUOTE_FLAG_ANSI_C) && n_in > 1 && in[1] == '\'') {
+                                C_SHQUOTE_STATS_ADD(n_quotes, 1);
+                                r = c_shquote_unquote_ansi_c(&out, &n_out, &in, &n_in);
+                                if (r)
+                                        return r;
+
+                                break;
+                        }
+
+                        /* fallthrough */
+                default:
+                        /*
+                         * Consume until the next escape character. If none
+                         * exists, consume the rest of the string. The first
+                         * character is never an escape character, but might
+                         * be a '$' that does not start a quote.
+                         */
+                        len = 1 + c_shquote_strncspn(in + 1, n_in - 1, class);
+                        r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
+                        if (r)
+                                return r;
+                }
+        }
+
+        *outp = out;
+        *n_outp = n_out;
+        return 0;
+}
+
+/**
+ * c_shquote_unquote_len() - Calculate length of unquoted string
+ * @n_outp:             output variable for the length of the unquoted string
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This calculates the exact number of bytes c_shquote_unquote() produces when
+ * unquoting the given input string. The input is fully validated, but no
+ * output is written.
+ *
+ * On success, the length of the unquoted string is returned in @n_outp.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes.
+ */
+_c_public_ int c_shquote_unquote_len(size_t *n_outp,
+                                     const char *in,
+                                     size_t n_in) {
+        char *out = NULL;
+        size_t n_out = n_in;
+        int r;
+
+        /*
+         * The output is never bigger than the input, so we can run the
+         * unquote operation without output buffer, and with the size of the
+         * input as available space.
+         */
+        r = c_shquote_unquote(&out, &n_out, in, n_in);
+        if (r) {
+                c_assert(r != C_SHQUOTE_E_NO_SPACE);
+                return r;
+        }
+
+        *n_outp = n_in - n_out;
+        return 0;
+}
+
+/**
+ * c_shquote_unquote_inplace() - Unquote string in place
+ * @string:             string to unquote
+ * @n_stringp:          length of @string
+ *
+ * This is like c_shquote_unquote(), but uses @string as both the input and
+ * the output buffer. Since the output is never longer than the input, this
+ * always fits, and no further buffer is needed. The unquoted string starts at
+ * @string and is not zero-terminated. Bytes of @string past the unquoted
+ * string are left in an unspecified state.
+ *
+ * On success, @n_stringp contains the length of the unquoted string. On
+ * failure, @n_stringp is left untouched, but @string might have been
+ * modified.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes.
+ */
+_c_public_ int c_shquote_unquote_inplace(char *string,
+                                         size_t *n_stringp) {
+        size_t n_out = *n_stringp;
+        char *out = string;
+        int r;
+
+        r = c_shquote_unquote(&out, &n_out, string, *n_stringp);
+        if (r) {
+                c_assert(r != C_SHQUOTE_E_NO_SPACE);
+                return r;
+        }
+
+        *n_stringp = out - string;
+        return 0;
+}
+
+/**
+ * c_shquote_parse_next() - Parse next argument
+ * @outp:               output buffer to place next token
+ * @n_outp:             length of the output buffer
+ * @inp:                input string
+ * @n_inp:              length of input string
+ *
+ * This parses the next argument of a concatenated argument string. That is, it
+ * takes a Shell Command Line and splits of the next token. If the end of the
+ * command line is reached, C_SHQUOTE_E_EOF is returned instead of the next
+ * token.
+ *
+ * On success, @outp and @n_outp are adjusted to point to the remaining output
+ * bufer, and @inp and @n_inp are adjusted to point to the remaining input
+ * buffer.
+ *
+ * The caller is responsible to allocate a suitable output buffer. If the
+ * output buffer is too small for the next element, C_SHQUOTE_E_NO_SPACE is
+ * returned and the caller should retry the operation with a bigger output
+ * buffer.
+ *
+ * Similarly to c_shquote_unquote(), the output is guaranteed to be shorter
+ * than, or equal in length to, the input, and the output buffer may be the
+ * input string itself. See c_shquote_parse_next_inplace().
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_EOF when
+ *         the end of the input string is reached without any further token,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input is invalid,
+ *         C_SHQUOTE_E_NO_SPACE if the output buffer is too short.
+ */
+_c_public_ int c_shquote_parse_next(char **outp,
+                                    size_t *n_outp,
+                                    const char **inp,
                                     size_t *n_inp) {
-        const char *in = *inp;
-        size_t n_in = *n_inp;
+        const char *start, *end;
+
+        return c_shquote_parse_next_span(outp, n_outp, inp, n_inp, &start, &end, 0);
+}
+
+/**
+ * c_shquote_parse_next_ex() - Parse next argument with extensions
+ * @outp:               output buffer to place next token
+ * @n_outp:             length of the output buffer
+ * @inp:                input string
+ * @n_inp:              length of input string
+ * @flags:              extensions to enable
+ *
+ * This is like c_shquote_parse_next(), but allows enabling extensions to the
+ * POSIX Shell Quoting rules via @flags. See c_shquote_unquote_ex() for the
+ * available flags. An ANSI-C quoted string is part of a token, just like any
+ * other quoted string.
+ *
+ * Return: See c_shquote_parse_next().
+ */
+_c_public_ int c_shquote_parse_next_ex(char **outp,
+                                       size_t *n_outp,
+                                       const char **inp,
+                                       size_t *n_inp,
+                                       unsigned int flags) {
+        const char *start, *end;
+
+        if (flags & ~C_SHQUOTE_FLAG_ANSI_C)
+                return -EINVAL;
+
+        return c_shquote_parse_next_span(outp, n_outp, inp, n_inp, &start, &end, flags);
+}
+
+/*
+ * The tokenizer of c_shquote_parse_next_span() is a DFA. Every byte of the
+ * input is mapped to one of the byte-classes below, and the transition table
+ * yields the next state and an action for the current state and byte-class.
+ * The states in front of C_SHQUOTE_STATE_WORD have not produced a token, yet.
+ *
+ * The output of a token is always a subsequence of its input, so rather than
+ * emitting bytes, the actions only tell which bytes are dropped. Kept bytes
+ * are copied in bulk whenever a byte is dropped. Nothing in front of or after
+ * a token is ever copied, so no action is needed to drop bytes there. The
+ * only case where a dropped byte turns out to be needed is a backslash in
+ * double quotes that does not escape the byte after it. Since the two are
+ * adjacent in the input, the backslash is restored by moving the start of the
+ * pending run back by one.
+ *
+ * With C_SHQUOTE_FLAG_ANSI_C, the ANSI-C dialect maps '$' to its own
+ * byte-class. Outside of quotes, its transitions check whether it starts an
+ * ANSI-C quoted string, which is then unquoted in one go, since its escape
+ * sequences have variable length. In all other states, it behaves like in
+ * the POSIX dialect.
+ */
+enum {
+        C_SHQUOTE_DIALECT_POSIX,
+        C_SHQUOTE_DIALECT_ANSI_C,
+        _C_SHQUOTE_DIALECT_N,
+};
+
+enum {
+        C_SHQUOTE_STATE_BLANK,                  /* whitespace in front of a token */
+        C_SHQUOTE_STATE_COMMENT,                /* comment in front of a token */
+        C_SHQUOTE_STATE_BLANK_ESCAPE,           /* backslash in front of a token */
+        C_SHQUOTE_STATE_WORD,                   /* unquoted part of a token */
+        C_SHQUOTE_STATE_WORD_ESCAPE,            /* backslash in a token */
+        C_SHQUOTE_STATE_SINGLE,                 /* single-quoted part of a token */
+        C_SHQUOTE_STATE_DOUBLE,                 /* double-quoted part of a token */
+        C_SHQUOTE_STATE_DOUBLE_ESCAPE,          /* backslash in double quotes */
+        C_SHQUOTE_STATE_TRAIL,                  /* whitespace after a token */
+        _C_SHQUOTE_STATE_N,
+};
+
+enum {
+        C_SHQUOTE_ACTION_NONE,                  /* keep the byte, or ignore it outside of a token */
+        C_SHQUOTE_ACTION_DROP,                  /* drop the byte */
+        C_SHQUOTE_ACTION_UNDROP,                /* keep the byte and the one before */
+        C_SHQUOTE_ACTION_START,                 /* the token starts at the byte */
+        C_SHQUOTE_ACTION_START_PREV,            /* the token starts at the byte before */
+        C_SHQUOTE_ACTION_START_DROP,            /* the token starts at the dropped byte */
+        C_SHQUOTE_ACTION_END,                   /* the token ends at the dropped byte */
+        C_SHQUOTE_ACTION_STOP,                  /* stop in front of the byte */
+        C_SHQUOTE_ACTION_DOLLAR,                /* the byte might open an ANSI-C quote */
+        C_SHQUOTE_ACTION_START_DOLLAR,          /* the token starts at the byte, which might open an ANSI-C quote */
+};
+
+#define C_SHQUOTE_T_STATE                       (0x0fU)
+#define C_SHQUOTE_T_ACTION_SHIFT                (4)
+
+/*
+ * These flags only feed the statistics. Without them, the transitions they
+ * mark carry no action, and thus stay on the fast path.
+ */
+#ifdef C_SHQUOTE_STATS
+#  define C_SHQUOTE_T_QUOTE                     (1U << 8)
+#  define C_SHQUOTE_T_ESCAPE                    (1U << 9)
+#  define C_SHQUOTE_T_COMMENT                   (1U << 10)
+#else
+#  define C_SHQUOTE_T_QUOTE                     (0U)
+#  define C_SHQUOTE_T_ESCAPE                    (0U)
+#  define C_SHQUOTE_T_COMMENT                   (0U)
+#endif
+
+#define C_SHQUOTE_T(_state, _action, _flags)                                    \
+        ((uint16_t)(C_SHQUOTE_STATE_ ## _state |                                \
+                    (C_SHQUOTE_ACTION_ ## _action << C_SHQUOTE_T_ACTION_SHIFT) | \
+                    (_flags)))
+
+/*
+ * Every row of the transition table lists the transitions of the byte-classes
+ * PLAIN, SINGLE ('), DOUBLE ("), BACKSLASH, BLANK (' ' \t), NEWLINE, HASH (#),
+ * SPECIAL ($`), and DOLLAR ($ in the ANSI-C dialect). They are spread to all
+ * bytes at compile-time, so a step costs a single load, and the table is
+ * usable before any constructor ran.
+ */
+#define C_SHQUOTE_DFA_ROW(_state, _dollar) {                                    \
+        [0 ... '\t' - 1] = C_SHQUOTE_DFA_ ## _state ## _PLAIN,                  \
+        ['\t'] = C_SHQUOTE_DFA_ ## _state ## _BLANK,                            \
+        ['\n'] = C_SHQUOTE_DFA_ ## _state ## _NEWLINE,                          \
+        ['\n' + 1 ... ' ' - 1] = C_SHQUOTE_DFA_ ## _state ## _PLAIN,            \
+        [' '] = C_SHQUOTE_DFA_ ## _state ## _BLANK,                             \
+        ['!'] = C_SHQUOTE_DFA_ ## _state ## _PLAIN,                             \
+        ['"'] = C_SHQUOTE_DFA_ ## _state ## _DOUBLE,                            \
+        ['#'] = C_SHQUOTE_DFA_ ## _state ## _HASH,                              \
+        ['$'] = C_SHQUOTE_DFA_ ## _state ## _ ## _dollar,                       \
+        ['%' ... '&'] = C_SHQUOTE_DFA_ ## _state ## _PLAIN,                     \
+        ['\''] = C_SHQUOTE_DFA_ ## _state ## _SINGLE,                           \
+        ['(' ... '\\' - 1] = C_SHQUOTE_DFA_ ## _state ## _PLAIN,                \
+        ['\\'] = C_SHQUOTE_DFA_ ## _state ## _BACKSLASH,                        \
+        ['\\' + 1 ... '`' - 1] = C_SHQUOTE_DFA_ ## _state ## _PLAIN,            \
+        ['`'] = C_SHQUOTE_DFA_ ## _state ## _SPECIAL,                           \
+        ['`' + 1 ... UCHAR_MAX] = C_SHQUOTE_DFA_ ## _state ## _PLAIN,           \
+}
+
+#define C_SHQUOTE_DFA_BLANK_PLAIN               C_SHQUOTE_T(WORD, START, 0)
+#define C_SHQUOTE_DFA_BLANK_SINGLE              C_SHQUOTE_T(SINGLE, START_DROP, C_SHQUOTE_T_QUOTE)
+#define C_SHQUOTE_DFA_BLANK_DOUBLE              C_SHQUOTE_T(DOUBLE, START_DROP, C_SHQUOTE_T_QUOTE)
+#define C_SHQUOTE_DFA_BLANK_BACKSLASH           C_SHQUOTE_T(BLANK_ESCAPE, NONE, C_SHQUOTE_T_ESCAPE)
+#define C_SHQUOTE_DFA_BLANK_BLANK               C_SHQUOTE_T(BLANK, NONE, 0)
+#define C_SHQUOTE_DFA_BLANK_NEWLINE             C_SHQUOTE_T(BLANK, NONE, 0)
+#define C_SHQUOTE_DFA_BLANK_HASH                C_SHQUOTE_T(COMMENT, NONE, C_SHQUOTE_T_COMMENT)
+#define C_SHQUOTE_DFA_BLANK_SPECIAL             C_SHQUOTE_T(WORD, START, 0)
+#define C_SHQUOTE_DFA_BLANK_DOLLAR              C_SHQUOTE_T(WORD, START_DOLLAR, 0)
+
+#define C_SHQUOTE_DFA_COMMENT_PLAIN             C_SHQUOTE_T(COMMENT, NONE, 0)
+#define C_SHQUOTE_DFA_COMMENT_SINGLE            C_SHQUOTE_T(COMMENT, NONE, 0)
+#define C_SHQUOTE_DFA_COMMENT_DOUBLE            C_SHQUOTE_T(COMMENT, NONE, 0)
+#define C_SHQUOTE_DFA_COMMENT_BACKSLASH         C_SHQUOTE_T(COMMENT, NONE, 0)
+#define C_SHQUOTE_DFA_COMMENT_BLANK             C_SHQUOTE_T(COMMENT, NONE, 0)
+#define C_SHQUOTE_DFA_COMMENT_NEWLINE           C_SHQUOTE_T(BLANK, NONE, 0)
+#define C_SHQUOTE_DFA_COMMENT_HASH              C_SHQUOTE_T(COMMENT, NONE, 0)
+#define C_SHQUOTE_DFA_COMMENT_SPECIAL           C_SHQUOTE_T(COMMENT, NONE, 0)
+#define C_SHQUOTE_DFA_COMMENT_DOLLAR            C_SHQUOTE_T(COMMENT, NONE, 0)
+
+#define C_SHQUOTE_DFA_BLANK_ESCAPE_PLAIN        C_SHQUOTE_T(WORD, START_PREV, 0)
+#define C_SHQUOTE_DFA_BLANK_ESCAPE_SINGLE       C_SHQUOTE_T(WORD, START_PREV, 0)
+#define C_SHQUOTE_DFA_BLANK_ESCAPE_DOUBLE       C_SHQUOTE_T(WORD, START_PREV, 0)
+#define C_SHQUOTE_DFA_BLANK_ESCAPE_BACKSLASH    C_SHQUOTE_T(WORD, START_PREV, 0)
+#define C_SHQUOTE_DFA_BLANK_ESCAPE_BLANK        C_SHQUOTE_T(WORD, START_PREV, 0)
+#define C_SHQUOTE_DFA_BLANK_ESCAPE_NEWLINE      C_SHQUOTE_T(BLANK, NONE, 0)
+#define C_SHQUOTE_DFA_BLANK_ESCAPE_HASH         C_SHQUOTE_T(WORD, START_PREV, 0)
+#define C_SHQUOTE_DFA_BLANK_ESCAPE_SPECIAL      C_SHQUOTE_T(WORD, START_PREV, 0)
+#define C_SHQUOTE_DFA_BLANK_ESCAPE_DOLLAR       C_SHQUOTE_T(WORD, START_PREV, 0)
+
+#define C_SHQUOTE_DFA_WORD_PLAIN                C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_SINGLE               C_SHQUOTE_T(SINGLE, DROP, C_SHQUOTE_T_QUOTE)
+#define C_SHQUOTE_DFA_WORD_DOUBLE               C_SHQUOTE_T(DOUBLE, DROP, C_SHQUOTE_T_QUOTE)
+#define C_SHQUOTE_DFA_WORD_BACKSLASH            C_SHQUOTE_T(WORD_ESCAPE, DROP, C_SHQUOTE_T_ESCAPE)
+#define C_SHQUOTE_DFA_WORD_BLANK                C_SHQUOTE_T(TRAIL, END, 0)
+#define C_SHQUOTE_DFA_WORD_NEWLINE              C_SHQUOTE_T(TRAIL, END, 0)
+#define C_SHQUOTE_DFA_WORD_HASH                 C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_SPECIAL              C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_DOLLAR               C_SHQUOTE_T(WORD, DOLLAR, 0)
+
+#define C_SHQUOTE_DFA_WORD_ESCAPE_PLAIN         C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_ESCAPE_SINGLE        C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_ESCAPE_DOUBLE        C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_ESCAPE_BACKSLASH     C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_ESCAPE_BLANK         C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_ESCAPE_NEWLINE       C_SHQUOTE_T(WORD, DROP, 0)
+#define C_SHQUOTE_DFA_WORD_ESCAPE_HASH          C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_ESCAPE_SPECIAL       C_SHQUOTE_T(WORD, NONE, 0)
+#define C_SHQUOTE_DFA_WORD_ESCAPE_DOLLAR        C_SHQUOTE_T(WORD, NONE, 0)
+
+#define C_SHQUOTE_DFA_SINGLE_PLAIN              C_SHQUOTE_T(SINGLE, NONE, 0)
+#define C_SHQUOTE_DFA_SINGLE_SINGLE             C_SHQUOTE_T(WORD, DROP, 0)
+#define C_SHQUOTE_DFA_SINGLE_DOUBLE             C_SHQUOTE_T(SINGLE, NONE, 0)
+#define C_SHQUOTE_DFA_SINGLE_BACKSLASH          C_SHQUOTE_T(SINGLE, NONE, 0)
+#define C_SHQUOTE_DFA_SINGLE_BLANK              C_SHQUOTE_T(SINGLE, NONE, 0)
+#define C_SHQUOTE_DFA_SINGLE_NEWLINE            C_SHQUOTE_T(SINGLE, NONE, 0)
+#define C_SHQUOTE_DFA_SINGLE_HASH               C_SHQUOTE_T(SINGLE, NONE, 0)
+#define C_SHQUOTE_DFA_SINGLE_SPECIAL            C_SHQUOTE_T(SINGLE, NONE, 0)
+#define C_SHQUOTE_DFA_SINGLE_DOLLAR             C_SHQUOTE_T(SINGLE, NONE, 0)
+
+#define C_SHQUOTE_DFA_DOUBLE_PLAIN              C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_SINGLE             C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_DOUBLE             C_SHQUOTE_T(WORD, DROP, 0)
+#define C_SHQUOTE_DFA_DOUBLE_BACKSLASH          C_SHQUOTE_T(DOUBLE_ESCAPE, DROP, C_SHQUOTE_T_ESCAPE)
+#define C_SHQUOTE_DFA_DOUBLE_BLANK              C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_NEWLINE            C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_HASH               C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_SPECIAL            C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_DOLLAR             C_SHQUOTE_T(DOUBLE, NONE, 0)
+
+#define C_SHQUOTE_DFA_DOUBLE_ESCAPE_PLAIN       C_SHQUOTE_T(DOUBLE, UNDROP, 0)
+#define C_SHQUOTE_DFA_DOUBLE_ESCAPE_SINGLE      C_SHQUOTE_T(DOUBLE, UNDROP, 0)
+#define C_SHQUOTE_DFA_DOUBLE_ESCAPE_DOUBLE      C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_ESCAPE_BACKSLASH   C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_ESCAPE_BLANK       C_SHQUOTE_T(DOUBLE, UNDROP, 0)
+#define C_SHQUOTE_DFA_DOUBLE_ESCAPE_NEWLINE     C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_ESCAPE_HASH        C_SHQUOTE_T(DOUBLE, UNDROP, 0)
+#define C_SHQUOTE_DFA_DOUBLE_ESCAPE_SPECIAL     C_SHQUOTE_T(DOUBLE, NONE, 0)
+#define C_SHQUOTE_DFA_DOUBLE_ESCAPE_DOLLAR      C_SHQUOTE_T(DOUBLE, NONE, 0)
+
+#define C_SHQUOTE_DFA_TRAIL_PLAIN               C_SHQUOTE_T(TRAIL, STOP, 0)
+#define C_SHQUOTE_DFA_TRAIL_SINGLE              C_SHQUOTE_T(TRAIL, STOP, 0)
+#define C_SHQUOTE_DFA_TRAIL_DOUBLE              C_SHQUOTE_T(TRAIL, STOP, 0)
+#define C_SHQUOTE_DFA_TRAIL_BACKSLASH           C_SHQUOTE_T(TRAIL, STOP, 0)
+#define C_SHQUOTE_DFA_TRAIL_BLANK               C_SHQUOTE_T(TRAIL, NONE, 0)
+#define C_SHQUOTE_DFA_TRAIL_NEWLINE             C_SHQUOTE_T(TRAIL, NONE, 0)
+#define C_SHQUOTE_DFA_TRAIL_HASH                C_SHQUOTE_T(TRAIL, STOP, 0)
+#define C_SHQUOTE_DFA_TRAIL_SPECIAL             C_SHQUOTE_T(TRAIL, STOP, 0)
+#define C_SHQUOTE_DFA_TRAIL_DOLLAR              C_SHQUOTE_T(TRAIL, STOP, 0)
+
+static const uint16_t c_shquote_dfa[_C_SHQUOTE_DIALECT_N][_C_SHQUOTE_STATE_N][UCHAR_MAX + 1] = {
+        [C_SHQUOTE_DIALECT_POSIX] = {
+                [C_SHQUOTE_STATE_BLANK] = C_SHQUOTE_DFA_ROW(BLANK, SPECIAL),
+                [C_SHQUOTE_STATE_COMMENT] = C_SHQUOTE_DFA_ROW(COMMENT, SPECIAL),
+                [C_SHQUOTE_STATE_BLANK_ESCAPE] = C_SHQUOTE_DFA_ROW(BLANK_ESCAPE, SPECIAL),
+                [C_SHQUOTE_STATE_WORD] = C_SHQUOTE_DFA_ROW(WORD, SPECIAL),
+                [C_SHQUOTE_STATE_WORD_ESCAPE] = C_SHQUOTE_DFA_ROW(WORD_ESCAPE, SPECIAL),
+                [C_SHQUOTE_STATE_SINGLE] = C_SHQUOTE_DFA_ROW(SINGLE, SPECIAL),
+                [C_SHQUOTE_STATE_DOUBLE] = C_SHQUOTE_DFA_ROW(DOUBLE, SPECIAL),
+                [C_SHQUOTE_STATE_DOUBLE_ESCAPE] = C_SHQUOTE_DFA_ROW(DOUBLE_ESCAPE, SPECIAL),
+                [C_SHQUOTE_STATE_TRAIL] = C_SHQUOTE_DFA_ROW(TRAIL, SPECIAL),
+        },
+        [C_SHQUOTE_DIALECT_ANSI_C] = {
+                [C_SHQUOTE_STATE_BLANK] = C_SHQUOTE_DFA_ROW(BLANK, DOLLAR),
+                [C_SHQUOTE_STATE_COMMENT] = C_SHQUOTE_DFA_ROW(COMMENT, DOLLAR),
+                [C_SHQUOTE_STATE_BLANK_ESCAPE] = C_SHQUOTE_DFA_ROW(BLANK_ESCAPE, DOLLAR),
+                [C_SHQUOTE_STATE_WORD] = C_SHQUOTE_DFA_ROW(WORD, DOLLAR),
+                [C_SHQUOTE_STATE_WORD_ESCAPE] = C_SHQUOTE_DFA_ROW(WORD_ESCAPE, DOLLAR),
+                [C_SHQUOTE_STATE_SINGLE] = C_SHQUOTE_DFA_ROW(SINGLE, DOLLAR),
+                [C_SHQUOTE_STATE_DOUBLE] = C_SHQUOTE_DFA_ROW(DOUBLE, DOLLAR),
+                [C_SHQUOTE_STATE_DOUBLE_ESCAPE] = C_SHQUOTE_DFA_ROW(DOUBLE_ESCAPE, DOLLAR),
+                [C_SHQUOTE_STATE_TRAIL] = C_SHQUOTE_DFA_ROW(TRAIL, DOLLAR),
+        },
+};
+
+#undef C_SHQUOTE_T
+
+/*
+ * Most bytes loop in their state without any action, and in some states these
+ * runs are long. Rather than stepping through them a byte at a time, they are
+ * skipped in bulk right after each transition into such a state: Whitespace
+ * and words with the scanning kernels, comments and single-quoted strings
+ * with memchr(3). Double-quoted strings are unquoted by the block-wise kernel
+ * of c_shquote_unquote_double(), which resolves the escape sequences of the
+ * double-quote states for an entire block at once, and always ends behind the
+ * closing quote. The word classes match the bytes that loop in the word
+ * state exactly, so '#' does not stop a run.
+ */
+static const unsigned int c_shquote_dfa_words[_C_SHQUOTE_DIALECT_N] = {
+        [C_SHQUOTE_DIALECT_POSIX] = C_SHQUOTE_CLASS_WORD,
+        [C_SHQUOTE_DIALECT_ANSI_C] = C_SHQUOTE_CLASS_WORD_DOLLAR,
+};
+
+static inline bool c_shquote_dfa_loops(const uint16_t (*dfa)[UCHAR_MAX + 1],
+                                       unsigned int state,
+                                       const char *in,
+                                       const char *in_end) {
+        return in < in_end && dfa[state][(unsigned char)*in] == state;
+}
+
+static inline __attribute__((__always_inline__)) int c_shquote_dfa_run(char **outp,
+                                                                       size_t *n_outp,
+                                                                       const char **inp,
+                                                                       size_t *n_inp,
+                                                                       const char **startp,
+                                                                       const char **endp,
+                                                                       unsigned int flags,
+                                                                       bool skip_runs) {
+        const char *in = *inp, *in_end = *inp + *n_inp, *run = *inp, *start = NULL, *end = NULL, *quote = NULL, *p;
+        unsigned int dialect = (flags & C_SHQUOTE_FLAG_ANSI_C) ? C_SHQUOTE_DIALECT_ANSI_C : C_SHQUOTE_DIALECT_POSIX;
+        const uint16_t (*dfa)[UCHAR_MAX + 1] = c_shquote_dfa[dialect];
+        unsigned int state = C_SHQUOTE_STATE_BLANK, t, action;
         char *out = *outp;
-        size_t n_out = *n_outp;
-        bool got_output = false;
+        size_t n_out = *n_outp, n_in;
         int r;
 
-        while (n_in > 0) {
-                size_t len;
+        while (in < in_end) {
+                C_SHQUOTE_STATS_ADD(n_scanned, 1);
+                t = dfa[state][(unsigned char)*in];
+                state = t & C_SHQUOTE_T_STATE;
 
-                switch (*in) {
-                case '\'':
-                        r = c_shquote_unquote_single(&out, &n_out, &in, &n_in);
-                        if (r)
-                                return r;
+                if (_c_unlikely_(t != state)) {
+                        C_SHQUOTE_STATS_ADD(n_quotes, !!(t & C_SHQUOTE_T_QUOTE));
+                        C_SHQUOTE_STATS_ADD(n_escapes, !!(t & C_SHQUOTE_T_ESCAPE));
+                        C_SHQUOTE_STATS_ADD(n_comments, !!(t & C_SHQUOTE_T_COMMENT));
+
+                        action = (t >> C_SHQUOTE_T_ACTION_SHIFT) & 0xf;
+                        switch (action) {
+                        case C_SHQUOTE_ACTION_NONE:
+                                break;
+                        case C_SHQUOTE_ACTION_DROP:
+                        case C_SHQUOTE_ACTION_END:
+                                if (in > run) {
+                                        r = c_shquote_append_str(&out, &n_out, run, in - run);
+                                        if (r)
+                                                return r;
+
+                                        C_SHQUOTE_STATS_ADD(n_segments, 1);
+                                }
+
+                                if (action == C_SHQUOTE_ACTION_END)
+                                        end = in;
+                                else if (!skip_runs && state == C_SHQUOTE_STATE_DOUBLE)
+                                        quote = in;
+                                run = in + 1;
+                                break;
+                        case C_SHQUOTE_ACTION_UNDROP:
+                                run = in - 1;
+                                break;
+                        case C_SHQUOTE_ACTION_START:
+                                start = in;
+                                run = in;
+                                break;
+                        case C_SHQUOTE_ACTION_START_PREV:
+                                start = in - 1;
+                                run = in;
+                                break;
+                        case C_SHQUOTE_ACTION_START_DROP:
+                                if (!skip_runs && state == C_SHQUOTE_STATE_DOUBLE)
+                                        quote = in;
+                                start = in;
+                                run = in + 1;
+                                break;
+                        case C_SHQUOTE_ACTION_STOP:
+                                goto stop;
+                        case C_SHQUOTE_ACTION_START_DOLLAR:
+                                start = in;
+                                run = in;
+                                /* fallthrough */
+                        case C_SHQUOTE_ACTION_DOLLAR:
+                                if (in_end - in < 2 || in[1] != '\'')
+                                        break;
+
+                                if (in > run) {
+                                        r = c_shquote_append_str(&out, &n_out, run, in - run);
+                                        if (r)
+                                                return r;
+
+                                        C_SHQUOTE_STATS_ADD(n_segments, 1);
+                                }
+
+                                C_SHQUOTE_STATS_ADD(n_quotes, 1);
+
+                                p = in + 2;
+                                n_in = in_end - p;
+                                r = c_shquote_unquote_ansi_c_rest(&out, &n_out, &p, &n_in);
+                                if (r) {
+                                        if (r == C_SHQUOTE_E_BAD_QUOTING)
+                                                *startp = in;
+                                        return r;
+                                }
+
+                                in = p;
+                                run = in;
+                                continue;
+                        }
+                }
+
+                ++in;
+
+                if (!skip_runs)
+                        continue;
 
-                        got_output = true;
+                /*
+                 * Scanning an empty run costs more than a table lookup, so
+                 * only start one if the next byte stays in the state. The
+                 * double-quote kernel must run right behind the opening
+                 * quote, though, since it flushes the output itself. The
+                 * whitespace states are entered on whitespace, so their scan
+                 * starts at that byte, like c_shquote_discard_whitespace().
+                 */
+                switch (state) {
+                case C_SHQUOTE_STATE_BLANK:
+                        if (c_shquote_dfa_loops(dfa, state, in, in_end))
+                                in += c_shquote_strnspn(in - 1, in_end - in + 1, C_SHQUOTE_CLASS_WHITESPACE) - 1;
                         break;
-                case '\"':
-                        r = c_shquote_unquote_double(&out, &n_out, &in, &n_in);
-                        if (r)
+                case C_SHQUOTE_STATE_COMMENT:
+                        if (c_shquote_dfa_loops(dfa, state, in, in_end)) {
+                                p = memchr(in, '\n', in_end - in) ?: in_end;
+                                C_SHQUOTE_STATS_ADD(n_scanned, p - in);
+                                in = p;
+                        }
+                        break;
+                case C_SHQUOTE_STATE_WORD:
+                        if (c_shquote_dfa_loops(dfa, state, in, in_end))
+                                in += c_shquote_strncspn(in, in_end - in, c_shquote_dfa_words[dialect]);
+                        break;
+                case C_SHQUOTE_STATE_SINGLE:
+                        if (c_shquote_dfa_loops(dfa, state, in, in_end)) {
+                                p = memchr(in, '\'', in_end - in) ?: in_end;
+                                C_SHQUOTE_STATS_ADD(n_scanned, p - in);
+                                in = p;
+                        }
+                        break;
+                case C_SHQUOTE_STATE_DOUBLE:
+                        /* everything in front of the opening quote was copied */
+                        p = in - 1;
+                        n_in = in_end - p;
+                        r = c_shquote_unquote_double(&out, &n_out, &p, &n_in);
+                        if (r) {
+                                if (r == C_SHQUOTE_E_BAD_QUOTING)
+                                        *startp = in - 1;
                                 return r;
+                        }
 
-                        got_output = true;
+                        in = p;
+                        state = C_SHQUOTE_STATE_WORD;
+                        run = in;
                         break;
-                case '\\':
-                        r = c_shquote_unescape_char_unquoted(&out, &n_out, &in, &n_in);
+                case C_SHQUOTE_STATE_TRAIL:
+                        /* anything but whitespace stops the token */
+                        if (c_shquote_dfa_loops(dfa, state, in, in_end))
+                                in += c_shquote_strnspn(in - 1, in_end - in + 1, C_SHQUOTE_CLASS_WHITESPACE) - 1;
+                        goto stop;
+                }
+        }
+
+stop:
+        switch (state) {
+        case C_SHQUOTE_STATE_BLANK:
+        case C_SHQUOTE_STATE_COMMENT:
+        case C_SHQUOTE_STATE_BLANK_ESCAPE:
+                return C_SHQUOTE_E_EOF;
+        case C_SHQUOTE_STATE_SINGLE:
+                /* an unterminated quote fails before its content is copied */
+                *startp = run - 1;
+                return C_SHQUOTE_E_BAD_QUOTING;
+        case C_SHQUOTE_STATE_WORD:
+        case C_SHQUOTE_STATE_WORD_ESCAPE:
+        case C_SHQUOTE_STATE_DOUBLE:
+        case C_SHQUOTE_STATE_DOUBLE_ESCAPE:
+                if (in > run) {
+                        r = c_shquote_append_str(&out, &n_out, run, in - run);
                         if (r)
                                 return r;
 
-                        if (n_out != *n_outp)
-                                got_output = true;
-                        break;
-                case ' ':
-                case '\t':
-                case '\n':
-                        c_shquote_discard_whitespace(&in, &n_in);
+                        C_SHQUOTE_STATS_ADD(n_segments, 1);
+                }
+
+                if (state == C_SHQUOTE_STATE_DOUBLE || state == C_SHQUOTE_STATE_DOUBLE_ESCAPE) {
+                        *startp = quote;
+                        return C_SHQUOTE_E_BAD_QUOTING;
+                }
+
+                end = in;
+                break;
+        default:
+                /* the whitespace after the token flushed it already */
+                break;
+        }
+
+        *outp = out;
+        *n_outp = n_out;
+        *inp = in;
+        *n_inp = in_end - in;
+        *startp = start;
+        *endp = end;
+        return 0;
+}
+
+/**
+ * c_shquote_parse_next_span() - Parse next argument and record its source
+ * @outp:               output buffer to place next token
+ * @n_outp:             length of the output buffer
+ * @inp:                input string
+ * @n_inp:              length of input string
+ * @startp:             output variable for the start of the token source
+ * @endp:               output variable for the end of the token source
+ * @flags:              extensions to enable
+ *
+ * This is c_shquote_parse_next_ex(), but additionally returns the part of the
+ * input that the token was parsed from, as @startp up to, but excluding,
+ * @endp. The source starts with the first quote, escape, or character that
+ * produced output, so leading whitespace, comments, and escaped newlines are
+ * not part of it. It ends with the whitespace that terminates the token, or
+ * the end of the input. On C_SHQUOTE_E_BAD_QUOTING, @startp instead points to
+ * the quote that is not terminated, and @endp is left untouched.
+ *
+ * The input is run through the tokenizer DFA. Transitions without an action
+ * never leave the fast path, runs are skipped in bulk as soon as their state
+ * is entered, and kept bytes are only copied when a byte is dropped, or at the
+ * end of the token.
+ *
+ * Return: See c_shquote_parse_next().
+ */
+int c_shquote_parse_next_span(char **outp,
+                              size_t *n_outp,
+                              const char **inp,
+                              size_t *n_inp,
+                              const char **startp,
+                              const char **endp,
+                              unsigned int flags) {
+        return c_shquote_dfa_run(outp, n_outp, inp, n_inp, startp, endp, flags, true);
+}
+
+/**
+ * c_shquote_parse_next_dfa() - Run tokenizer DFA
+ * @outp:               output buffer to place next token
+ * @n_outp:             length of the output buffer
+ * @inp:                input string
+ * @n_inp:              length of input string
+ * @startp:             output variable for the start of the token source
+ * @endp:               output variable for the end of the token source
+ * @flags:              extensions to enable
+ * @skip_runs:          whether to skip runs in bulk
+ *
+ * This implements c_shquote_parse_next_span(). If @skip_runs is false, every
+ * byte is stepped through the DFA, which is slow, but serves as reference for
+ * the bulk skipping in the tests. ANSI-C quoted strings are always unquoted in
+ * bulk.
+ *
+ * Return: See c_shquote_parse_next().
+ */
+int c_shquote_parse_next_dfa(char **outp,
+                             size_t *n_outp,
+                             const char **inp,
+                             size_t *n_inp,
+                             const char **startp,
+                             const char **endp,
+                             unsigned int flags,
+                             bool skip_runs) {
+        if (skip_runs)
+                return c_shquote_dfa_run(outp, n_outp, inp, n_inp, startp, endp, flags, true);
+        else
+                return c_shquote_dfa_run(outp, n_outp, inp, n_inp, startp, endp, flags, false);
+}
+
+/* the splitter does not care where tokens end, so the trailing state is blank */
+static inline unsigned int c_shquote_split_step(const uint16_t (*dfa)[UCHAR_MAX + 1],
+                                                unsigned int state,
+                                                char c) {
+        state = dfa[state][(unsigned char)c] & C_SHQUOTE_T_STATE;
+        return state == C_SHQUOTE_STATE_TRAIL ? C_SHQUOTE_STATE_BLANK : state;
+}
+
+/*
+ * Find the closing quote of a double-quoted string, without unquoting it. This
+ * classifies a block at a time like c_shquote_unquote_double(), and must not
+ * start in the middle of an escape sequence.
+ */
+static size_t c_shquote_split_double(const char *in, size_t n_in) {
+        size_t i = 0, len;
+
+        while (i < n_in) {
+                char tail[C_SHQUOTE_MASK_BLOCK];
+                CShquoteMasks masks;
+                uint64_t escapes, ends, valid = UINT64_MAX;
+
+                len = n_in - i;
+                if (len >= C_SHQUOTE_MASK_BLOCK) {
+                        c_shquote_mask_double(&masks, in + i);
+                        len = C_SHQUOTE_MASK_BLOCK;
+                } else {
+                        c_memzero(tail, sizeof(tail));
+                        c_memcpy(tail, in + i, len);
+                        c_shquote_mask_double(&masks, tail);
+                        valid = (UINT64_C(1) << len) - 1;
+                }
+
+                escapes = c_shquote_mask_escapes(masks.backslashes) & valid;
+                ends = masks.quotes & ~(escapes << 1) & valid;
+                if (ends)
+                        return i + __builtin_ctzll(ends);
+
+                /* the tail lacks a quote, or ends in a lone backslash */
+                if (valid != UINT64_MAX)
+                        break;
+
+                /* leave an escape sequence at the end for the next block */
+                i += len - (escapes >> (len - 1));
+        }
+
+        return n_in;
+}
+
+static const unsigned int c_shquote_split_states[_C_SHQUOTE_SPLIT_N] = {
+        [C_SHQUOTE_SPLIT_NONE] = C_SHQUOTE_STATE_BLANK,
+        [C_SHQUOTE_SPLIT_SINGLE] = C_SHQUOTE_STATE_SINGLE,
+        [C_SHQUOTE_SPLIT_DOUBLE] = C_SHQUOTE_STATE_DOUBLE,
+};
+
+/**
+ * c_shquote_split_line() - Find end of command-line
+ * @splitp:             quote-state at the start of @in, and at its end
+ * @in:                 input string
+ * @n_in:               length of input string
+ *
+ * This searches @in for the newline that terminates the first command-line.
+ * Newlines within quotes, escaped newlines, and newlines within tokens do not
+ * terminate a command-line. The newline that terminates a comment does. The
+ * search starts in the quote-state given in @splitp, which allows resuming it
+ * in the middle of a quoted string.
+ *
+ * The input is run through the tokenizer DFA of c_shquote_parse_next(), so
+ * parsing the input line by line yields the same tokens as parsing it as a
+ * whole. Comments and single-quoted strings are skipped like the DFA does,
+ * double-quoted strings with the block-wise classification that
+ * c_shquote_unquote_double() uses. Outside of quotes, the splitter does not
+ * care where tokens end, so it skips to the next byte that is special to it,
+ * and derives the state from the byte in front of it: Whitespace and plain
+ * bytes lead to the same state from both unquoted states.
+ *
+ * If a newline is found, @splitp is C_SHQUOTE_SPLIT_NONE behind it. Otherwise,
+ * @splitp is the quote-state at the end of @in. That state is only exact if
+ * @in ends in a newline that does not follow a backslash, since escape states
+ * are folded into their quote-state.
+ *
+ * Return: Offset of the terminating newline, or @n_in if none.
+ */
+size_t c_shquote_split_line(unsigned int *splitp, const char *in, size_t n_in) {
+        const uint16_t (*dfa)[UCHAR_MAX + 1] = c_shquote_dfa[C_SHQUOTE_DIALECT_POSIX];
+        const char *p = in, *in_end = in + n_in;
+        unsigned int state = c_shquote_split_states[*splitp], next;
+        size_t len;
+
+        for (;;) {
+                switch (state) {
+                case C_SHQUOTE_STATE_BLANK:
+                case C_SHQUOTE_STATE_WORD:
+                        len = c_shquote_strncspn(p, in_end - p, C_SHQUOTE_CLASS_LINE);
+                        if (len > 0) {
+                                state = c_shquote_split_step(dfa, state, p[len - 1]);
+                                p += len;
+                        }
+                        break;
+                case C_SHQUOTE_STATE_COMMENT:
+                        p = memchr(p, '\n', in_end - p) ?: in_end;
+                        break;
+                case C_SHQUOTE_STATE_SINGLE:
+                        p = memchr(p, '\'', in_end - p) ?: in_end;
+                        break;
+                case C_SHQUOTE_STATE_DOUBLE:
+                        p += c_shquote_split_double(p, in_end - p);
+                        break;
+                }
+
+                if (p >= in_end)
+                        break;
+
+                next = c_shquote_split_step(dfa, state, *p);
+
+                /* an escaped newline leads to the blank state as well */
+                if (*p == '\n' && next == C_SHQUOTE_STATE_BLANK && state != C_SHQUOTE_STATE_BLANK_ESCAPE) {
+                        *splitp = C_SHQUOTE_SPLIT_NONE;
+                        return p - in;
+                }
+
+                state = next;
+                ++p;
+        }
+
+        switch (state) {
+        case C_SHQUOTE_STATE_SINGLE:
+                *splitp = C_SHQUOTE_SPLIT_SINGLE;
+                break;
+        case C_SHQUOTE_STATE_DOUBLE:
+        case C_SHQUOTE_STATE_DOUBLE_ESCAPE:
+                *splitp = C_SHQUOTE_SPLIT_DOUBLE;
+                break;
+        default:
+                *splitp = C_SHQUOTE_SPLIT_NONE;
+                break;
+        }
+
+        return n_in;
+}
+
+/**
+ * c_shquote_parse_next_inplace() - Parse next argument in place
+ * @tokenp:             output variable for the next token
+ * @n_tokenp:           output variable for the length of the next token
+ * @inp:                input string
+ * @n_inp:              length of input string
+ *
+ * This works like c_shquote_parse_next(), but unquotes the next token into
+ * the input string itself, rather than a separate output buffer. The token is
+ * written to the start of the remaining input, which is returned in @tokenp,
+ * and its length in @n_tokenp. This never needs more space than the part of
+ * the input that is consumed, so callers holding a mutable buffer can
+ * tokenize it without any further allocation or copy.
+ *
+ * The token is not zero-terminated. However, if the token was terminated by
+ * whitespace, that whitespace was consumed as well, and the byte right after
+ * the token is no longer part of the remaining input. Callers can then place
+ * a terminating zero there.
+ *
+ * On success, @inp and @n_inp are adjusted to point to the remaining input
+ * buffer. On failure, they are left untouched, but the input might have been
+ * modified.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_EOF when
+ *         the end of the input string is reached without any further token,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input is invalid.
+ */
+_c_public_ int c_shquote_parse_next_inplace(char **tokenp,
+                                            size_t *n_tokenp,
+                                            char **inp,
+                                            size_t *n_inp) {
+        const char *in = *inp;
+        size_t n_in = *n_inp;
+        char *out = *inp;
+        size_t n_out = *n_inp;
+        int r;
+
+        r = c_shquote_parse_next(&out, &n_out, &in, &n_in);
+        if (r) {
+                c_assert(r != C_SHQUOTE_E_NO_SPACE);
+                return r;
+        }
+
+        *tokenp = *inp;
+        *n_tokenp = out - *inp;
+        *inp += *n_inp - n_in;
+        *n_inp = n_in;
+        return 0;
+}
 
-                        if (got_output)
-                                goto out;
+/**
+ * c_shquote_parse_next_view() - Parse next argument without copying
+ * @tokenp:             output variable for the next token
+ * @n_tokenp:           output variable for the length of the next token
+ * @flagsp:             output variable for token flags
+ * @outp:               scratch buffer to unquote the next token into
+ * @n_outp:             length of the scratch buffer
+ * @inp:                input string
+ * @n_inp:              length of input string
+ *
+ * This works like c_shquote_parse_next(), but avoids copying tokens that are
+ * not changed by unquoting. That is, if the next token is a plain word
+ * without any quotes or escapes, @tokenp is set to point directly into the
+ * input string, and the scratch buffer is left untouched. Only if the token
+ * needs unquoting, it is unquoted into the scratch buffer exactly like
+ * c_shquote_parse_next() does, and @tokenp points to its start in the scratch
+ * buffer. In this case C_SHQUOTE_TOKEN_COPIED is set in @flagsp, and @outp
+ * and @n_outp are adjusted to point to the remaining scratch buffer.
+ *
+ * The token is not zero-terminated. Its length is returned in @n_tokenp.
+ *
+ * On success, @inp and @n_inp are adjusted to point to the remaining input
+ * buffer.
+ *
+ * Return: 0 on success, negative error code on failure, C_SHQUOTE_E_EOF when
+ *         the end of the input string is reached without any further token,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input is invalid,
+ *         C_SHQUOTE_E_NO_SPACE if the scratch buffer is too short.
+ */
+_c_public_ int c_shquote_parse_next_view(const char **tokenp,
+                                         size_t *n_tokenp,
+                                         unsigned int *flagsp,
+                                         char **outp,
+                                         size_t *n_outp,
+                                         const char **inp,
+                                         size_t *n_inp) {
+        const char *in = *inp;
+        size_t n_in = *n_inp;
+        char *out = *outp;
+        size_t n_out = *n_outp;
+        size_t len;
+        int r;
 
+        /* Skip everything in front of the next token. */
+        for (;;) {
+                c_shquote_discard_whitespace(&in, &n_in);
+                if (n_in == 0 || *in != '#')
                         break;
-                case '#':
-                        if (!got_output) {
-                                c_shquote_discard_comment(&in, &n_in);
-                        } else {
-                                r = c_shquote_consume_char(&out, &n_out, &in, &n_in);
-                                if (r)
-                                        return r;
-                        }
 
-                        break;
-                default:
-                        /*
-                         * Consume until the next escape character. If none
-                         * exists, consume the rest of the string.
-                         */
-                        len = c_shquote_strncspn(in, n_in, "'\"\\ \t\n#");
-                        c_assert(len > 0);
+                c_shquote_discard_comment(&in, &n_in);
+        }
 
-                        r = c_shquote_consume_str(&out, &n_out, &in, &n_in, len);
-                        if (r)
-                                return r;
+        if (n_in == 0)
+                return C_SHQUOTE_E_EOF;
 
-                        got_output = true;
-                        break;
-                }
+        /*
+         * Look for the end of a plain word. Note that once a token produced
+         * output, comment characters are no longer special, so we only stop at
+         * quotes, escapes, and whitespace. If the word ends at a whitespace
+         * character or the end of the input, it is the entire token and can
+         * be returned verbatim.
+         */
+        len = c_shquote_strncspn(in, n_in, C_SHQUOTE_CLASS_WORD);
+        if (len > 0 && (len == n_in || c_shquote_class_test(in[len], C_SHQUOTE_CLASS_WHITESPACE))) {
+                *tokenp = in;
+                *n_tokenp = len;
+                *flagsp = 0;
+
+                c_shquote_skip_str(&in, &n_in, len);
+                c_shquote_discard_whitespace(&in, &n_in);
+
+                *inp = in;
+                *n_inp = n_in;
+                return 0;
         }
 
-out:
-        if (!got_output)
-                return C_SHQUOTE_E_EOF;
+        r = c_shquote_parse_next(&out, &n_out, &in, &n_in);
+        if (r)
+                return r;
+
+        *tokenp = *outp;
+        *n_tokenp = *n_outp - n_out;
+        *flagsp = C_SHQUOTE_TOKEN_COPIED;
 
         *outp = out;
         *n_outp = n_out;
@@ -562,63 +2383,107 @@ out:
 }
 
 /**
- * c_shquote_parse_argv() - Parse Shell Command-Line
- * @argvp:              output array
- * @argcp:              length of output array
- * @input:              input string
- * @n_input:            length of input string
- *
- * This parses a Shell Command-Line into an argument array. That is, it splits
- * the input string according to POSIX Shell Command-Line rules, and returns
- * the argument array in @argvp to the caller. This is similar to calling
- * c_shquote_parse_next() in a loop and placing everything into a dynamically
- * allocated argument array.
+ * c_shquote_validate() - Validate Shell Command-Line
+ * @n_tokensp:          output variable for the number of tokens
+ * @n_bytesp:           output variable for the total length of all tokens
+ * @n_errorp:           output variable for the offset of invalid quotes
+ * @in:                 input string
+ * @n_in:               length of input string
  *
- * On success, @argvp contains a pointer to an allocated string-array with all
- * strings placed in a single buffer together with the array. That is, the
- * caller is responsible to free(3) the pointer returned in @argvp when done.
- * @argcp will contain the number of arguments that were put into the array.
+ * This checks the input string like calling c_shquote_parse_next() on it
+ * until C_SHQUOTE_E_EOF would, but never writes any output. It only counts
+ * the tokens, and the number of bytes they unquote to. The input is run
+ * through the tokenizer DFA of c_shquote_parse_next() without an output
+ * buffer, so both always agree on the grammar. This is useful to reject
+ * invalid input early, or to size buffers up-front.
  *
- * Note that the array in @argvp contains a safety NULL as last argument (not
- * counted in @argcp).
+ * On success, @n_tokensp contains the number of tokens, and @n_bytesp the sum
+ * of their lengths, excluding any terminating zeros. On
+ * C_SHQUOTE_E_BAD_QUOTING, @n_errorp contains the offset of the first quote
+ * that is not terminated. No other output variable is changed in either case.
  *
- * Since string-arrays rely on zero-terminated string, this function is not
- * well-defined if the input string contains embedded NULL characters. Hence,
- * the function will fail with C_SHQUOTE_E_CONTAINS_NULL in that case.
+ * Note that embedded NULL characters are allowed, like in
+ * c_shquote_parse_next(). c_shquote_parse_argv() rejects them, though.
  *
  * Return: 0 on success, negative error code on failure,
- *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes,
- *         C_SHQUOTE_E_CONTAINS_NULL if the input contains a literal embedded
- *         NULL character.
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes.
  */
-_c_public_ int c_shquote_parse_argv(char ***argvp,
-                                    size_t *argcp,
-                                    const char *input,
-                                    size_t n_input) {
-        _c_cleanup_(c_shquote_freep) char **argv = NULL, *buffer = NULL;
-        size_t i, n_in, n_out, argc = 0;
-        const char *in;
-        char *out;
+_c_public_ int c_shquote_validate(size_t *n_tokensp,
+                                  size_t *n_bytesp,
+                                  size_t *n_errorp,
+                                  const char *in,
+                                  size_t n_in) {
+        const char *input = in, *start, *end;
+        size_t n_tokens = 0, n_bytes = 0;
         int r;
 
-        if (n_input > 0 && memchr(input, '\0', n_input))
-                return C_SHQUOTE_E_CONTAINS_NULL;
+        for (;;) {
+                char *out = NULL;
+                size_t n_out = SIZE_MAX;
 
-        buffer = malloc(n_input + 1);
-        if (!buffer)
-                return -ENOMEM;
+                /* inlined, so the unused output is folded away */
+                r = c_shquote_dfa_run(&out, &n_out, &in, &n_in, &start, &end, 0, true);
+                if (r) {
+                        if (r == C_SHQUOTE_E_EOF)
+                                break;
+
+                        if (r == C_SHQUOTE_E_BAD_QUOTING)
+                                *n_errorp = start - input;
+                        return r;
+                }
 
-        in = input;
-        out = buffer;
-        n_in = n_input;
-        n_out = n_input + 1;
+                ++n_tokens;
+                n_bytes += SIZE_MAX - n_out;
+        }
+
+        *n_tokensp = n_tokens;
+        *n_bytesp = n_bytes;
+        return 0;
+}
+
+/**
+ * c_shquote_parse_argv_fill() - Parse Shell Command-Line into argv block
+ * @argv:               argument array to fill
+ * @n_argv:             number of argument slots in @argv
+ * @starts:             array to fill with token start offsets, or NULL
+ * @ends:               array to fill with token end offsets, or NULL
+ * @out:                string buffer for the tokens
+ * @n_out:              size of @out
+ * @in:                 input string
+ * @n_in:               length of input string
+ * @argcp:              output variable for the number of arguments
+ *
+ * This tokenizes @in straight into @out, terminating each token with a zero
+ * byte, and records pointers to the tokens in @argv, followed by a safety
+ * NULL. The caller must size @argv and @out to fit the result. This is the
+ * common backend of all argv-parsers, and does not allocate.
+ *
+ * If @starts and @ends are given, they must have @n_argv slots as well, and
+ * @n_in must fit into 32 bits. The source of every token, as returned by
+ * c_shquote_parse_next_span(), is recorded as offsets into @in.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes.
+ */
+int c_shquote_parse_argv_fill(char **argv,
+                              size_t n_argv,
+                              uint32_t *starts,
+                              uint32_t *ends,
+                              char *out,
+                              size_t n_out,
+                              const char *in,
+                              size_t n_in,
+                              size_t *argcp) {
+        const char *input = in, *start, *end;
+        size_t argc = 0;
+        int r;
+
+        c_assert(!starts || n_in <= UINT32_MAX);
 
-        /*
-         * Verify the correctness of the input, and count the number of tokens
-         * produced.
-         */
         for (;;) {
-                r = c_shquote_parse_next(&out, &n_out, &in, &n_in);
+                char *token = out;
+
+                r = c_shquote_parse_next_span(&out, &n_out, &in, &n_in, &start, &end, 0);
                 if (r) {
                         if (r == C_SHQUOTE_E_EOF)
                                 break;
@@ -627,7 +2492,14 @@ _c_public_ int c_shquote_parse_argv(char ***argvp,
                         return r;
                 }
 
-                ++argc;
+                c_assert(argc < n_argv);
+
+                if (starts) {
+                        starts[argc] = start - input;
+                        ends[argc] = end - input;
+                }
+
+                argv[argc++] = token;
 
                 /*
                  * We put a terminating zero after each token, so we can point
@@ -638,35 +2510,371 @@ _c_public_ int c_shquote_parse_argv(char ***argvp,
                 r = c_shquote_append_char(&out, &n_out, '\0');
                 c_assert(!r);
         }
+        argv[argc] = NULL;
+
+        *argcp = argc;
+        return 0;
+}
+
+/*
+ * This allocates a single block for the argument array, the optional offset
+ * arrays, and the strings, and parses the input into it. It is the backend of
+ * all allocating argv-parsers.
+ */
+static int c_shquote_parse_argv_block(char ***argvp,
+                                      size_t *argcp,
+                                      uint32_t **startsp,
+                                      uint32_t **endsp,
+                                      const char *input,
+                                      size_t n_input,
+                                      const CShquoteAllocator *allocator) {
+        size_t n_argv, n_argv_mem, n_offsets_mem = 0, argc;
+        uint32_t *starts = NULL, *ends = NULL;
+        char **argv;
+        int r;
+
+        if (n_input > 0 && memchr(input, '\0', n_input))
+                return C_SHQUOTE_E_CONTAINS_NULL;
+
+        /*
+         * Calculate an upper bound for the number of tokens, so we can
+         * allocate the argument-array and the strings in one go, and tokenize
+         * straight into the final buffer. Tokens must be separated by
+         * whitespace, so there cannot be more tokens than whitespace
+         * characters plus one. Furthermore, every token consumes at least one
+         * character, so there cannot be more tokens than half the input.
+         * We also reserve +1 space in the array to place a safety terminating
+         * NULL.
+         */
+        n_argv = c_shquote_strncount(input, n_input, C_SHQUOTE_CLASS_WHITESPACE) + 1;
+        n_argv = c_min(n_argv, n_input / 2 + 1);
 
         /*
-         * We now know the number of arguments in the split command-line. We
-         * allocate a string-array to contain the array plus all the strings
-         * trailing. We also reserve +1 space in the array to place a safety
-         * terminating NULL.
+         * The unquoted tokens are never longer than the input, and every
+         * terminating zero we append after a token replaces at least one
+         * separating whitespace. The only exception is the last token, so we
+         * need n_input + 1 bytes for the strings. If requested, the start and
+         * end offsets are placed as two separate arrays between the
+         * argument-array and the strings.
          */
-        n_out = out - buffer;
+        if (startsp && __builtin_mul_overflow(n_argv, 2 * sizeof(uint32_t), &n_offsets_mem))
+                return -ENOMEM;
+        if (__builtin_mul_overflow(n_argv + 1, sizeof(char *), &n_argv_mem) ||
+            __builtin_add_overflow(n_argv_mem, n_offsets_mem, &n_argv_mem) ||
+            __builtin_add_overflow(n_argv_mem, n_input + 1, &n_argv_mem))
+                return -ENOMEM;
 
-        argv = malloc(sizeof(char *) * (argc + 1) + n_out);
+        if (allocator)
+                argv = allocator->alloc(allocator->userdata, n_argv_mem);
+        else
+                argv = malloc(n_argv_mem);
         if (!argv)
                 return -ENOMEM;
 
-        out = (char *)(argv + argc + 1);
-        c_memcpy(out, buffer, n_out);
+        if (startsp) {
+                starts = (uint32_t *)(argv + n_argv + 1);
+                ends = starts + n_argv;
+        }
+
+        r = c_shquote_parse_argv_fill(argv,
+                                      n_argv,
+                                      starts,
+                                      ends,
+                                      (char *)(argv + n_argv + 1) + n_offsets_mem,
+                                      n_input + 1,
+                                      input,
+                                      n_input,
+                                      &argc);
+        if (r) {
+                if (!allocator)
+                        free(argv);
+                else if (allocator->free)
+                        allocator->free(allocator->userdata, argv);
+                return r;
+        }
+
+        if (startsp) {
+                *startsp = starts;
+                *endsp = ends;
+        }
+
+        *argvp = argv;
+        *argcp = argc;
+        return 0;
+}
+
+/**
+ * c_shquote_parse_argv_with_allocator() - Parse Shell Command-Line
+ * @argvp:              output array
+ * @argcp:              length of output array
+ * @input:              input string
+ * @n_input:            length of input string
+ * @allocator:          allocator to use, or NULL
+ *
+ * This is like c_shquote_parse_argv(), but the memory for the argument array
+ * is requested from @allocator rather than malloc(3). If @allocator is NULL,
+ * malloc(3) and free(3) are used.
+ *
+ * Exactly one allocation of at most `(n_input / 2 + 2) * sizeof(char *) +
+ * n_input + 1` bytes is requested per successful call. It must be suitably
+ * aligned to store pointers. The returned array is owned by the caller and
+ * must be released with the same allocator. The free callback is only ever
+ * called to release the allocation on failure. It may be NULL, which is
+ * useful for region-based allocators that release memory in bulk. In that
+ * case, the allocation is simply dropped on failure.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes,
+ *         C_SHQUOTE_E_CONTAINS_NULL if the input contains a literal embedded
+ *         NULL character.
+ */
+_c_public_ int c_shquote_parse_argv_with_allocator(char ***argvp,
+                                                   size_t *argcp,
+                                                   const char *input,
+                                                   size_t n_input,
+                                                   const CShquoteAllocator *allocator) {
+        return c_shquote_parse_argv_block(argvp, argcp, NULL, NULL, input, n_input, allocator);
+}
+
+/**
+ * c_shquote_parse_argv_with_offsets() - Parse Shell Command-Line with offsets
+ * @argvp:              output array
+ * @argcp:              length of output array
+ * @startsp:            output variable for the start offsets
+ * @endsp:              output variable for the end offsets
+ * @input:              input string
+ * @n_input:            length of input string
+ *
+ * This is like c_shquote_parse_argv(), but additionally returns where in
+ * @input each argument came from. @startsp and @endsp point to two arrays
+ * with one entry per argument, each. The argument @argvp[i] was parsed from
+ * the bytes of @input starting at offset @startsp[i] up to, but excluding,
+ * offset @endsp[i]. Leading whitespace, comments, and escaped newlines are
+ * not part of this range, but all quotes and escapes of the argument are.
+ * The offsets are recorded while parsing, so the input is not scanned again.
+ *
+ * Both arrays are placed in the same allocation as the argument array. That
+ * is, the caller must only free(3) the pointer returned in @argvp, and must
+ * not free @startsp and @endsp.
+ *
+ * Since offsets are stored in 32 bits, @n_input must not exceed UINT32_MAX.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         -EOVERFLOW if the input is too long for 32-bit offsets,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes,
+ *         C_SHQUOTE_E_CONTAINS_NULL if the input contains a literal embedded
+ *         NULL character.
+ */
+_c_public_ int c_shquote_parse_argv_with_offsets(char ***argvp,
+                                                 size_t *argcp,
+                                                 uint32_t **startsp,
+                                                 uint32_t **endsp,
+                                                 const char *input,
+                                                 size_t n_input) {
+        if (n_input > UINT32_MAX)
+                return -EOVERFLOW;
+
+        return c_shquote_parse_argv_block(argvp, argcp, startsp, endsp, input, n_input, NULL);
+}
+
+/**
+ * c_shquote_parse_argv_into() - Parse Shell Command-Line into buffer
+ * @argvp:              output array
+ * @argcp:              length of output array
+ * @n_usedp:            output variable for the used or required buffer size
+ * @buffer:             buffer to place the argument array in
+ * @n_buffer:           size of @buffer
+ * @input:              input string
+ * @n_input:            length of input string
+ *
+ * This is like c_shquote_parse_argv(), but places the argument array and
+ * all strings in the caller-provided buffer @buffer rather than allocating
+ * memory. @buffer must be suitably aligned to store pointers.
+ *
+ * This function never allocates memory and is async-signal-safe. It can thus
+ * be used in signal handlers, or after fork(2) in multi-threaded programs.
+ * The one exception are builds with statistics enabled: the first access to
+ * the thread-local counters of a thread may allocate in the dynamic loader,
+ * so such builds must not rely on this in signal handlers.
+ *
+ * On success, @argvp points into @buffer, and @n_usedp contains the number of
+ * bytes of @buffer that were used. If @buffer is too small,
+ * C_SHQUOTE_E_NO_SPACE is returned and @n_usedp contains the exact number of
+ * bytes required. @buffer might have been written to in that case. A buffer
+ * of `(n_input / 2 + 2) * sizeof(char *) + n_input + 1` bytes is always
+ * sufficient.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         C_SHQUOTE_E_NO_SPACE if the buffer is too small,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes,
+ *         C_SHQUOTE_E_CONTAINS_NULL if the input contains a literal embedded
+ *         NULL character.
+ */
+_c_public_ int c_shquote_parse_argv_into(char ***argvp,
+                                         size_t *argcp,
+                                         size_t *n_usedp,
+                                         void *buffer,
+                                         size_t n_buffer,
+                                         const char *input,
+                                         size_t n_input) {
+        size_t n_argv, n_strings, n_used, n_error, argc;
+        char **argv = buffer;
+        int r;
+
+        c_assert(!((uintptr_t)buffer % _Alignof(char *)));
+
+        if (n_input > 0 && memchr(input, '\0', n_input))
+                return C_SHQUOTE_E_CONTAINS_NULL;
+
+        /*
+         * If the buffer fits the upper bound of the argument array, as
+         * calculated by c_shquote_parse_argv_with_allocator(), we can
+         * tokenize straight into it with a single pass over the input. The
+         * tail of the argument array is then left unused.
+         */
+        n_argv = c_shquote_strncount(input, n_input, C_SHQUOTE_CLASS_WHITESPACE) + 1;
+        n_argv = c_min(n_argv, n_input / 2 + 1);
+
+        if (!__builtin_mul_overflow(n_argv + 1, sizeof(char *), &n_used) &&
+            !__builtin_add_overflow(n_used, n_input + 1, &n_used) &&
+            n_used <= n_buffer) {
+                r = c_shquote_parse_argv_fill(argv,
+                                              n_argv,
+                                              NULL,
+                                              NULL,
+                                              (char *)(argv + n_argv + 1),
+                                              n_input + 1,
+                                              input,
+                                              n_input,
+                                              &argc);
+                if (r)
+                        return r;
+
+                if (argc > 0)
+                        n_used = argv[argc - 1] + strlen(argv[argc - 1]) + 1 - (char *)buffer;
+                else
+                        n_used = (char *)(argv + n_argv + 1) - (char *)buffer;
+
+                goto out;
+        }
+
+        /*
+         * Otherwise, count the tokens and the bytes they need without
+         * writing anything, and place them tightly. Every token needs one
+         * more byte for its terminating zero.
+         */
+        r = c_shquote_validate(&n_argv, &n_strings, &n_error, input, n_input);
+        if (r)
+                return r;
+
+        n_strings += n_argv;
 
         /*
-         * We now have the argv-array pre-allocated and the tokenized strings
-         * in @out. All that is left is to traverse them and make the
-         * argv-array point to each string-start.
+         * Neither the number of tokens nor their total size can exceed the
+         * input length plus one, so this can only overflow on absurd inputs.
          */
-        for (i = 0; i < argc; ++i) {
-                argv[i] = out;
-                out += strlen(out) + 1;
+        if (__builtin_mul_overflow(n_argv + 1, sizeof(char *), &n_used) ||
+            __builtin_add_overflow(n_used, n_strings, &n_used))
+                return -ENOMEM;
+
+        if (n_used > n_buffer) {
+                C_SHQUOTE_STATS_ADD(n_no_space, 1);
+                *n_usedp = n_used;
+                return C_SHQUOTE_E_NO_SPACE;
         }
-        argv[i] = NULL;
 
+        r = c_shquote_parse_argv_fill(argv,
+                                      n_argv,
+                                      NULL,
+                                      NULL,
+                                      (char *)(argv + n_argv + 1),
+                                      n_strings,
+                                      input,
+                                      n_input,
+                                      &argc);
+        c_assert(!r);
+        c_assert(argc == n_argv);
+
+out:
         *argvp = argv;
         *argcp = argc;
-        argv = NULL;
+        *n_usedp = n_used;
+        return 0;
+}
+
+/**
+ * c_shquote_parse_argv() - Parse Shell Command-Line
+ * @argvp:              output array
+ * @argcp:              length of output array
+ * @input:              input string
+ * @n_input:            length of input string
+ *
+ * This parses a Shell Command-Line into an argument array. That is, it splits
+ * the input string according to POSIX Shell Command-Line rules, and returns
+ * the argument array in @argvp to the caller. This is similar to calling
+ * c_shquote_parse_next() in a loop and placing everything into a dynamically
+ * allocated argument array.
+ *
+ * On success, @argvp contains a pointer to an allocated string-array with all
+ * strings placed in a single buffer together with the array. That is, the
+ * caller is responsible to free(3) the pointer returned in @argvp when done.
+ * @argcp will contain the number of arguments that were put into the array.
+ *
+ * Note that the array in @argvp contains a safety NULL as last argument (not
+ * counted in @argcp).
+ *
+ * Since string-arrays rely on zero-terminated string, this function is not
+ * well-defined if the input string contains embedded NULL characters. Hence,
+ * the function will fail with C_SHQUOTE_E_CONTAINS_NULL in that case.
+ *
+ * See c_shquote_parse_argv_with_allocator() to use a custom allocator,
+ * c_shquote_parse_argv_into() to parse into a caller-provided buffer, and
+ * c_shquote_parse_argv_with_offsets() to map arguments back to the input.
+ *
+ * Return: 0 on success, negative error code on failure,
+ *         C_SHQUOTE_E_BAD_QUOTING if the input contains invalid quotes,
+ *         C_SHQUOTE_E_CONTAINS_NULL if the input contains a literal embedded
+ *         NULL character.
+ */
+_c_public_ int c_shquote_parse_argv(char ***argvp,
+                                    size_t *argcp,
+                                    const char *input,
+                                    size_t n_input) {
+        return c_shquote_parse_argv_with_allocator(argvp, argcp, input, n_input, NULL);
+}
+
+#ifdef C_SHQUOTE_STATS
+void c_shquote_stats_merge(CShquoteStats *to, const CShquoteStats *from) {
+        __atomic_fetch_add(&to->n_scanned, from->n_scanned, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&to->n_segments, from->n_segments, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&to->n_escapes, from->n_escapes, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&to->n_quotes, from->n_quotes, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&to->n_comments, from->n_comments, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&to->n_no_space, from->n_no_space, __ATOMIC_RELAXED);
+}
+#endif
+
+/**
+ * c_shquote_stats_read() - Read parser statistics
+ * @statsp:             output variable for the statistics
+ *
+ * This returns the statistics of the calling thread in @statsp. The counters
+ * start at zero for every thread, and are never reset. Callers interested in
+ * a single operation should read the statistics before and after it, and
+ * subtract. Work done by the helper threads of c_shquote_parse_lines() is
+ * accounted to the thread that called it.
+ *
+ * Statistics are only collected if the library was built with the `stats`
+ * option. Otherwise, the counters are not compiled in, and this function
+ * fails with -EOPNOTSUPP.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+_c_public_ int c_shquote_stats_read(CShquoteStats *statsp) {
+#ifdef C_SHQUOTE_STATS
+        *statsp = c_shquote_stats;
         return 0;
+#else
+        return -EOPNOTSUPP;
+#endif
 }
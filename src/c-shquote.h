@@ -4,7 +4,8 @@
  * POSIX Shell Compatible Argument Parser
  *
  * This library provides a argument parsing API, that is fully implemented in
- * ISO-C11 and has no external dependencies.
+ * ISO-C11. Apart from the C library, its only dependency is POSIX threads,
+ * which c_shquote_parse_lines() uses to parse in parallel.
  */
 
 #ifdef __cplusplus
@@ -12,6 +13,7 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 
 enum {
         _C_SHQUOTE_E_SUCCESS,
@@ -24,22 +26,243 @@ enum {
         _C_SHQUOTE_E_N,
 };
 
+typedef struct CShquoteAllocator CShquoteAllocator;
+typedef struct CShquoteBlob CShquoteBlob;
+typedef struct CShquoteCache CShquoteCache;
+typedef struct CShquoteCacheBuilder CShquoteCacheBuilder;
+typedef struct CShquoteIter CShquoteIter;
+typedef struct CShquoteLine CShquoteLine;
+typedef struct CShquoteStats CShquoteStats;
+typedef struct CShquoteTokenizer CShquoteTokenizer;
+
+enum {
+        C_SHQUOTE_STYLE_SINGLE,
+        C_SHQUOTE_STYLE_DOUBLE,
+        C_SHQUOTE_STYLE_BACKSLASH,
+        C_SHQUOTE_STYLE_BARE,
+        C_SHQUOTE_STYLE_AUTO,
+        C_SHQUOTE_STYLE_ANSI_C,
+        _C_SHQUOTE_STYLE_N,
+};
+
+enum {
+        C_SHQUOTE_FLAG_ANSI_C                   = (1U << 0),
+};
+
+enum {
+        C_SHQUOTE_TOKEN_COPIED                  = (1U << 0),
+};
+
+/**
+ * struct CShquoteAllocator - Memory allocator
+ * @alloc:              callback to allocate @size bytes, or return NULL
+ * @free:               callback to release an allocation, or NULL
+ * @userdata:           context passed to the callbacks
+ */
+struct CShquoteAllocator {
+        void *(*alloc)(void *userdata, size_t size);
+        void (*free)(void *userdata, void *p);
+        void *userdata;
+};
+
+/**
+ * struct CShquoteLine - Parsed command-line
+ * @argv:               argument array, terminated by a safety NULL
+ * @argc:               number of arguments in @argv
+ */
+struct CShquoteLine {
+        char **argv;
+        size_t argc;
+};
+
+/**
+ * struct CShquoteStats - Parser statistics
+ * @n_scanned:          number of bytes scanned for special characters
+ * @n_segments:         number of segments copied to the output
+ * @n_escapes:          number of escape sequences handled
+ * @n_quotes:           number of quoted strings opened
+ * @n_comments:         number of comments skipped
+ * @n_no_space:         number of times C_SHQUOTE_E_NO_SPACE was returned
+ */
+struct CShquoteStats {
+        uint64_t n_scanned;
+        uint64_t n_segments;
+        uint64_t n_escapes;
+        uint64_t n_quotes;
+        uint64_t n_comments;
+        uint64_t n_no_space;
+};
+
 int c_shquote_quote(char **outp,
                     size_t *n_outp,
                     const char *in,
                     size_t n_in);
+int c_shquote_quote_len(size_t *n_outp,
+                        const char *in,
+                        size_t n_in);
+int c_shquote_quote_ex(char **outp,
+                       size_t *n_outp,
+                       const char *in,
+                       size_t n_in,
+                       unsigned int style);
+int c_shquote_quote_ex_len(size_t *n_outp,
+                           const char *in,
+                           size_t n_in,
+                           unsigned int style);
+int c_shquote_quote_argv_len(size_t *n_outp,
+                             const char * const *argv,
+                             size_t argc);
+int c_shquote_quote_argv(char **outp,
+                         size_t *n_outp,
+                         const char * const *argv,
+                         size_t argc);
+int c_shquote_quote_argv_alloc(char **linep,
+                               size_t *n_linep,
+                               const char * const *argv,
+                               size_t argc);
 int c_shquote_unquote(char **outp,
                       size_t *n_outp,
                       const char *in,
                       size_t n_in);
+int c_shquote_unquote_ex(char **outp,
+                         size_t *n_outp,
+                         const char *in,
+                         size_t n_in,
+                         unsigned int flags);
+int c_shquote_unquote_len(size_t *n_outp,
+                          const char *in,
+                          size_t n_in);
+int c_shquote_unquote_inplace(char *string,
+                              size_t *n_stringp);
 int c_shquote_parse_next(char **outp,
                          size_t *n_outp,
                          const char **inp,
                          size_t *n_inp);
+int c_shquote_parse_next_ex(char **outp,
+                            size_t *n_outp,
+                            const char **inp,
+                            size_t *n_inp,
+                            unsigned int flags);
+int c_shquote_parse_next_inplace(char **tokenp,
+                                 size_t *n_tokenp,
+                                 char **inp,
+                                 size_t *n_inp);
+int c_shquote_parse_next_view(const char **tokenp,
+                              size_t *n_tokenp,
+                              unsigned int *flagsp,
+                              char **outp,
+                              size_t *n_outp,
+                              const char **inp,
+                              size_t *n_inp);
+int c_shquote_validate(size_t *n_tokensp,
+                       size_t *n_bytesp,
+                       size_t *n_errorp,
+                       const char *in,
+                       size_t n_in);
 int c_shquote_parse_argv(char ***argvp,
                          size_t *argcp,
                          const char *in,
                          size_t n_in);
+int c_shquote_parse_argv_with_allocator(char ***argvp,
+                                        size_t *argcp,
+                                        const char *in,
+                                        size_t n_in,
+                                        const CShquoteAllocator *allocator);
+int c_shquote_parse_argv_with_offsets(char ***argvp,
+                                      size_t *argcp,
+                                      uint32_t **startsp,
+                                      uint32_t **endsp,
+                                      const char *in,
+                                      size_t n_in);
+int c_shquote_parse_argv_into(char ***argvp,
+                              size_t *argcp,
+                              size_t *n_usedp,
+                              void *buffer,
+                              size_t n_buffer,
+                              const char *in,
+                              size_t n_in);
+int c_shquote_parse_argv_blob(CShquoteBlob **blobp,
+                              size_t *n_blobp,
+                              const char *in,
+                              size_t n_in);
+
+int c_shquote_blob_verify(const CShquoteBlob *blob, size_t n_blob);
+size_t c_shquote_blob_get_size(const CShquoteBlob *blob);
+size_t c_shquote_blob_get_argc(const CShquoteBlob *blob);
+const char *c_shquote_blob_get_arg(const CShquoteBlob *blob,
+                                   size_t i,
+                                   size_t *n_argp);
+
+int c_shquote_cache_builder_new(CShquoteCacheBuilder **builderp);
+CShquoteCacheBuilder *c_shquote_cache_builder_free(CShquoteCacheBuilder *builder);
+int c_shquote_cache_builder_add(CShquoteCacheBuilder *builder,
+                                const char *in,
+                                size_t n_in);
+int c_shquote_cache_builder_finish(CShquoteCacheBuilder *builder,
+                                   void **datap,
+                                   size_t *n_datap);
+
+int c_shquote_cache_new(CShquoteCache **cachep, const void *data, size_t n_data);
+CShquoteCache *c_shquote_cache_free(CShquoteCache *cache);
+int c_shquote_cache_lookup(const CShquoteCache *cache,
+                           const CShquoteBlob **blobp,
+                           const char *in,
+                           size_t n_in);
+int c_shquote_cache_parse_argv(const CShquoteCache *cache,
+                               const CShquoteBlob **blobp,
+                               CShquoteBlob **parsedp,
+                               const char *in,
+                               size_t n_in);
+
+int c_shquote_parse_lines(CShquoteLine **linesp,
+                          size_t *n_linesp,
+                          const char *in,
+                          size_t n_in,
+                          unsigned int n_threads);
+
+int c_shquote_stats_read(CShquoteStats *statsp);
+
+int c_shquote_tokenizer_new(CShquoteTokenizer **tokenizerp);
+CShquoteTokenizer *c_shquote_tokenizer_free(CShquoteTokenizer *tokenizer);
+void c_shquote_tokenizer_feed(CShquoteTokenizer *tokenizer,
+                              const char *in,
+                              size_t n_in);
+void c_shquote_tokenizer_finish(CShquoteTokenizer *tokenizer);
+int c_shquote_tokenizer_next_token(CShquoteTokenizer *tokenizer,
+                                   const char **tokenp,
+                                   size_t *n_tokenp);
+
+int c_shquote_iter_new(CShquoteIter **iterp, const char *in, size_t n_in);
+CShquoteIter *c_shquote_iter_free(CShquoteIter *iter);
+int c_shquote_iter_next(CShquoteIter *iter,
+                        const char **tokenp,
+                        size_t *n_tokenp);
+int c_shquote_iter_skip_token(CShquoteIter *iter);
+void c_shquote_iter_get_remaining(CShquoteIter *iter,
+                                  const char **inp,
+                                  size_t *n_inp);
+
+/* inline helpers */
+
+static inline void c_shquote_tokenizer_freep(CShquoteTokenizer **tokenizer) {
+        if (*tokenizer)
+                c_shquote_tokenizer_free(*tokenizer);
+}
+
+static inline void c_shquote_iter_freep(CShquoteIter **iter) {
+        if (*iter)
+                c_shquote_iter_free(*iter);
+}
+
+static inline void c_shquote_cache_builder_freep(CShquoteCacheBuilder **builder) {
+        if (*builder)
+                c_shquote_cache_builder_free(*builder);
+}
+
+static inline void c_shquote_cache_freep(CShquoteCache **cache) {
+        if (*cache)
+                c_shquote_cache_free(*cache);
+}
 
 #ifdef __cplusplus
 }
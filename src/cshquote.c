@@ -0,0 +1,554 @@
+/*
+ * Command-Line Tool
+ *
+ * This exposes the library to shell pipelines. The input is either a file,
+ * which is mapped into memory and processed in one go, or standard input,
+ * which is streamed in large chunks. All output is collected in a large
+ * buffer and written with as few write(2) calls as possible.
+ *
+ * Commands:
+ *
+ *  * split: Parse the input as shell command-lines and write every token
+ *    followed by a NUL byte, suitable for `xargs -0`.
+ *
+ *  * join: Read NUL-terminated arguments and write them as a single quoted
+ *    command-line, followed by a newline.
+ *
+ *  * quote: Quote every input line, and write it followed by a newline.
+ *
+ *  * unquote: Unquote every input line, and write it followed by a newline.
+ *
+ * With --null, lines are NUL-terminated rather than newline-terminated, both
+ * for input and output of quote and unquote. With --style=ansi-c, quote
+ * escapes everything that is not printable, so every quoted line is a single
+ * line, and unquote accepts ANSI-C quotes.
+ */
+
+#include <c-stdaux.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "c-shquote.h"
+
+#define CSHQUOTE_BUFFER_SIZE (1024 * 1024)
+
+enum {
+        CSHQUOTE_COMMAND_SPLIT,
+        CSHQUOTE_COMMAND_JOIN,
+        CSHQUOTE_COMMAND_QUOTE,
+        CSHQUOTE_COMMAND_UNQUOTE,
+        _CSHQUOTE_COMMAND_N,
+};
+
+typedef struct CShquoteInput {
+        int fd;
+        const char *map;
+        size_t n_map;
+        char *buffer;
+        size_t n_buffer;
+        size_t z_buffer;
+        bool eof : 1;
+} CShquoteInput;
+
+typedef struct CShquoteOutput {
+        int fd;
+        char *buffer;
+        size_t n_buffer;
+        size_t z_buffer;
+} CShquoteOutput;
+
+static const char *cshquote_commands[_CSHQUOTE_COMMAND_N] = {
+        [CSHQUOTE_COMMAND_SPLIT] = "split",
+        [CSHQUOTE_COMMAND_JOIN] = "join",
+        [CSHQUOTE_COMMAND_QUOTE] = "quote",
+        [CSHQUOTE_COMMAND_UNQUOTE] = "unquote",
+};
+
+static const char *cshquote_styles[_C_SHQUOTE_STYLE_N] = {
+        [C_SHQUOTE_STYLE_SINGLE] = "single",
+        [C_SHQUOTE_STYLE_DOUBLE] = "double",
+        [C_SHQUOTE_STYLE_BACKSLASH] = "backslash",
+        [C_SHQUOTE_STYLE_BARE] = "bare",
+        [C_SHQUOTE_STYLE_AUTO] = "auto",
+        [C_SHQUOTE_STYLE_ANSI_C] = "ansi-c",
+};
+
+static int cshquote_output_flush(CShquoteOutput *output) {
+        size_t n = 0;
+        ssize_t l;
+
+        while (n < output->n_buffer) {
+                l = write(output->fd, output->buffer + n, output->n_buffer - n);
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                n += l;
+        }
+
+        output->n_buffer = 0;
+        return 0;
+}
+
+/*
+ * Make room for @n bytes in the output buffer, and return a pointer to it.
+ * The buffer is flushed if necessary, and grown if @n exceeds its size.
+ */
+static int cshquote_output_reserve(CShquoteOutput *output, size_t n, char **bufferp) {
+        int r;
+
+        if (n > output->z_buffer - output->n_buffer) {
+                r = cshquote_output_flush(output);
+                if (r)
+                        return r;
+
+                if (n > output->z_buffer) {
+                        char *buffer;
+
+                        buffer = realloc(output->buffer, n);
+                        if (!buffer)
+                                return -ENOMEM;
+
+                        output->buffer = buffer;
+                        output->z_buffer = n;
+                }
+        }
+
+        *bufferp = output->buffer + output->n_buffer;
+        return 0;
+}
+
+static int cshquote_output_write(CShquoteOutput *output, const char *data, size_t n_data) {
+        char *buffer;
+        int r;
+
+        /* large writes bypass the buffer, once it was flushed */
+        if (n_data >= output->z_buffer) {
+                r = cshquote_output_flush(output);
+                if (r)
+                        return r;
+
+                while (n_data > 0) {
+                        ssize_t l;
+
+                        l = write(output->fd, data, n_data);
+                        if (l < 0) {
+                                if (errno == EINTR)
+                                        continue;
+
+                                return -errno;
+                        }
+
+                        data += l;
+                        n_data -= l;
+                }
+
+                return 0;
+        }
+
+        r = cshquote_output_reserve(output, n_data, &buffer);
+        if (r)
+                return r;
+
+        c_memcpy(buffer, data, n_data);
+        output->n_buffer += n_data;
+        return 0;
+}
+
+static int cshquote_input_open(CShquoteInput *input, const char *path) {
+        struct stat st;
+        void *map;
+        int r;
+
+        if (!path || !strcmp(path, "-")) {
+                input->fd = STDIN_FILENO;
+        } else {
+                input->fd = open(path, O_RDONLY | O_CLOEXEC);
+                if (input->fd < 0)
+                        return -errno;
+        }
+
+        r = fstat(input->fd, &st);
+        if (r < 0)
+                return -errno;
+
+        /*
+         * Regular files are mapped in one go. Everything else, including
+         * empty files, is streamed via read(2).
+         */
+        if (S_ISREG(st.st_mode) && st.st_size > 0 && (uintmax_t)st.st_size <= SIZE_MAX) {
+                map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, input->fd, 0);
+                if (map != MAP_FAILED) {
+                        (void)madvise(map, st.st_size, MADV_SEQUENTIAL);
+                        input->map = map;
+                        input->n_map = st.st_size;
+                        return 0;
+                }
+        }
+
+        input->z_buffer = CSHQUOTE_BUFFER_SIZE;
+        input->buffer = malloc(input->z_buffer);
+        if (!input->buffer)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static void cshquote_input_close(CShquoteInput *input) {
+        if (input->map)
+                munmap((void *)input->map, input->n_map);
+        free(input->buffer);
+        if (input->fd > STDIN_FILENO)
+                close(input->fd);
+}
+
+/*
+ * Read the next chunk of input. For mapped files, the entire file is
+ * returned as a single chunk. Otherwise, the @n_keep bytes at @keep, which
+ * must be the tail of the previous chunk, are moved to the front of the
+ * buffer, unless they are there already, and the chunk is extended by another
+ * read(2). The buffer is doubled once the retained bytes fill half of it, so
+ * a long record costs amortized constant time per byte. Once the input is
+ * exhausted, no more bytes are added.
+ */
+static int cshquote_input_read(CShquoteInput *input, const char *keep, size_t n_keep, const char **chunkp, size_t *n_chunkp) {
+        ssize_t l;
+
+        if (input->map) {
+                *chunkp = input->eof ? NULL : input->map;
+                *n_chunkp = input->eof ? 0 : input->n_map;
+                input->eof = true;
+                return 0;
+        }
+
+        if (n_keep && keep != input->buffer)
+                memmove(input->buffer, keep, n_keep);
+        input->n_buffer = n_keep;
+
+        if (input->n_buffer >= input->z_buffer / 2) {
+                char *buffer;
+
+                buffer = realloc(input->buffer, input->z_buffer * 2);
+                if (!buffer)
+                        return -ENOMEM;
+
+                input->buffer = buffer;
+                input->z_buffer *= 2;
+        }
+
+        while (!input->eof) {
+                l = read(input->fd, input->buffer + input->n_buffer, input->z_buffer - input->n_buffer);
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                if (l == 0)
+                        input->eof = true;
+
+                input->n_buffer += l;
+                break;
+        }
+
+        *chunkp = input->buffer;
+        *n_chunkp = input->n_buffer;
+        return 0;
+}
+
+static int cshquote_split(CShquoteInput *input, CShquoteOutput *output) {
+        _c_cleanup_(c_shquote_tokenizer_freep) CShquoteTokenizer *tokenizer = NULL;
+        const char *chunk, *token;
+        size_t n_chunk, n_token;
+        bool finished = false;
+        int r;
+
+        r = c_shquote_tokenizer_new(&tokenizer);
+        if (r)
+                return r;
+
+        for (;;) {
+                r = c_shquote_tokenizer_next_token(tokenizer, &token, &n_token);
+                if (r == C_SHQUOTE_E_EOF) {
+                        if (finished)
+                                break;
+
+                        /* the previous chunk is consumed, so we can reuse it */
+                        r = cshquote_input_read(input, NULL, 0, &chunk, &n_chunk);
+                        if (r)
+                                return r;
+
+                        if (n_chunk) {
+                                c_shquote_tokenizer_feed(tokenizer, chunk, n_chunk);
+                        } else {
+                                c_shquote_tokenizer_finish(tokenizer);
+                                finished = true;
+                        }
+
+                        continue;
+                } else if (r) {
+                        return r;
+                }
+
+                if (memchr(token, '\0', n_token))
+                        return C_SHQUOTE_E_CONTAINS_NULL;
+
+                r = cshquote_output_write(output, token, n_token);
+                if (r)
+                        return r;
+
+                r = cshquote_output_write(output, "", 1);
+                if (r)
+                        return r;
+        }
+
+        return 0;
+}
+
+/*
+ * Call @fn for every record terminated by @delimiter. A trailing record
+ * without delimiter is passed as well.
+ */
+static int cshquote_records(CShquoteInput *input,
+                            CShquoteOutput *output,
+                            char delimiter,
+                            int (*fn)(CShquoteOutput *output, const char *record, size_t n_record, void *userdata),
+                            void *userdata) {
+        const char *chunk = NULL, *end;
+        size_t n_chunk = 0, n_searched = 0;
+        int r;
+
+        do {
+                r = cshquote_input_read(input, chunk, n_chunk, &chunk, &n_chunk);
+                if (r)
+                        return r;
+
+                /* the retained bytes contain no delimiter, so skip them */
+                while ((end = memchr(chunk + n_searched, delimiter, n_chunk - n_searched))) {
+                        r = fn(output, chunk, end - chunk, userdata);
+                        if (r)
+                                return r;
+
+                        n_chunk -= end + 1 - chunk;
+                        chunk = end + 1;
+                        n_searched = 0;
+                }
+
+                n_searched = n_chunk;
+        } while (!input->eof);
+
+        if (n_chunk) {
+                r = fn(output, chunk, n_chunk, userdata);
+                if (r)
+                        return r;
+        }
+
+        return 0;
+}
+
+typedef struct CShquoteRecordArgs {
+        unsigned int style;
+        char delimiter;
+        bool first;
+} CShquoteRecordArgs;
+
+static int cshquote_quote_append(CShquoteOutput *output, const char *record, size_t n_record, unsigned int style) {
+        size_t n_out;
+        char *out;
+        int r;
+
+        r = c_shquote_quote_ex_len(&n_out, record, n_record, style);
+        if (r)
+                return r;
+
+        r = cshquote_output_reserve(output, n_out, &out);
+        if (r)
+                return r;
+
+        output->n_buffer += n_out;
+
+        r = c_shquote_quote_ex(&out, &n_out, record, n_record, style);
+        c_assert(!r);
+        c_assert(!n_out);
+        return 0;
+}
+
+static int cshquote_quote_one(CShquoteOutput *output, const char *record, size_t n_record, void *userdata) {
+        CShquoteRecordArgs *args = userdata;
+        int r;
+
+        r = cshquote_quote_append(output, record, n_record, args->style);
+        if (r)
+                return r;
+
+        return cshquote_output_write(output, &args->delimiter, 1);
+}
+
+static int cshquote_unquote_one(CShquoteOutput *output, const char *record, size_t n_record, void *userdata) {
+        CShquoteRecordArgs *args = userdata;
+        unsigned int flags = 0;
+        size_t n_out;
+        char *out;
+        int r;
+
+        if (args->style == C_SHQUOTE_STYLE_ANSI_C)
+                flags |= C_SHQUOTE_FLAG_ANSI_C;
+
+        /* the unquoted string is never longer than its input */
+        r = cshquote_output_reserve(output, n_record + 1, &out);
+        if (r)
+                return r;
+
+        n_out = n_record;
+        r = c_shquote_unquote_ex(&out, &n_out, record, n_record, flags);
+        if (r)
+                return r;
+
+        *out = args->delimiter;
+        output->n_buffer += n_record - n_out + 1;
+        return 0;
+}
+
+static int cshquote_join_one(CShquoteOutput *output, const char *record, size_t n_record, void *userdata) {
+        CShquoteRecordArgs *args = userdata;
+        int r;
+
+        if (!args->first) {
+                r = cshquote_output_write(output, " ", 1);
+                if (r)
+                        return r;
+        }
+
+        args->first = false;
+        return cshquote_quote_append(output, record, n_record, args->style);
+}
+
+static void cshquote_help(void) {
+        printf("cshquote [OPTIONS...] {split|join|quote|unquote} [FILE]\n\n"
+               "Split, join, quote, and unquote POSIX shell command-lines.\n\n"
+               "  -h --help            Show this help\n"
+               "  -z --null            Use NUL-terminated lines for quote and unquote\n"
+               "  -s --style=STYLE     Quoting style: single, double, backslash, bare, auto,\n"
+               "                       ansi-c (default: single). With ansi-c, unquote\n"
+               "                       accepts $'...' as well\n");
+}
+
+int main(int argc, char **argv) {
+        static const struct option options[] = {
+                { "help",       no_argument,            NULL,   'h' },
+                { "null",       no_argument,            NULL,   'z' },
+                { "style",      required_argument,      NULL,   's' },
+                {}
+        };
+        CShquoteRecordArgs args = { .style = C_SHQUOTE_STYLE_SINGLE, .delimiter = '\n', .first = true };
+        CShquoteInput input = {};
+        CShquoteOutput output = { .fd = STDOUT_FILENO };
+        unsigned int command;
+        int c, r;
+
+        while ((c = getopt_long(argc, argv, "hzs:", options, NULL)) >= 0) {
+                switch (c) {
+                case 'h':
+                        cshquote_help();
+                        return 0;
+                case 'z':
+                        args.delimiter = '\0';
+                        break;
+                case 's':
+                        for (args.style = 0; args.style < _C_SHQUOTE_STYLE_N; ++args.style)
+                                if (!strcmp(optarg, cshquote_styles[args.style]))
+                                        break;
+                        if (args.style >= _C_SHQUOTE_STYLE_N) {
+                                fprintf(stderr, "cshquote: invalid style: %s\n", optarg);
+                                return 1;
+                        }
+                        break;
+                default:
+                        return 1;
+                }
+        }
+
+        if (optind >= argc || argc - optind > 2) {
+                fprintf(stderr, "cshquote: expected command and optional file\n");
+                return 1;
+        }
+
+        for (command = 0; command < _CSHQUOTE_COMMAND_N; ++command)
+                if (!strcmp(argv[optind], cshquote_commands[command]))
+                        break;
+        if (command >= _CSHQUOTE_COMMAND_N) {
+                fprintf(stderr, "cshquote: unknown command: %s\n", argv[optind]);
+                return 1;
+        }
+
+        output.z_buffer = CSHQUOTE_BUFFER_SIZE;
+        output.buffer = malloc(output.z_buffer);
+        if (!output.buffer) {
+                r = -ENOMEM;
+                goto exit;
+        }
+
+        r = cshquote_input_open(&input, argv[optind + 1]);
+        if (r)
+                goto exit;
+
+        switch (command) {
+        case CSHQUOTE_COMMAND_SPLIT:
+                r = cshquote_split(&input, &output);
+                break;
+        case CSHQUOTE_COMMAND_JOIN:
+                r = cshquote_records(&input, &output, '\0', cshquote_join_one, &args);
+                if (!r && !args.first)
+                        r = cshquote_output_write(&output, "\n", 1);
+                break;
+        case CSHQUOTE_COMMAND_QUOTE:
+                r = cshquote_records(&input, &output, args.delimiter, cshquote_quote_one, &args);
+                break;
+        case CSHQUOTE_COMMAND_UNQUOTE:
+                r = cshquote_records(&input, &output, args.delimiter, cshquote_unquote_one, &args);
+                break;
+        default:
+                c_assert(0);
+        }
+
+        if (!r)
+                r = cshquote_output_flush(&output);
+
+exit:
+        cshquote_input_close(&input);
+        free(output.buffer);
+
+        switch (r) {
+        case 0:
+                return 0;
+        case C_SHQUOTE_E_BAD_QUOTING:
+                fprintf(stderr, "cshquote: input contains invalid quoting\n");
+                break;
+        case C_SHQUOTE_E_CONTAINS_NULL:
+                fprintf(stderr, "cshquote: token contains NUL byte\n");
+                break;
+        case C_SHQUOTE_E_NO_SPACE:
+                fprintf(stderr, "cshquote: input too large\n");
+                break;
+        case -EPIPE:
+                break;
+        default:
+                fprintf(stderr, "cshquote: %s\n", strerror(-r));
+                break;
+        }
+
+        return 1;
+}
@@ -6,18 +6,30 @@
 
 #undef NDEBUG
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "c-shquote.h"
 
 static void test_api(void) {
-        char *out = NULL;
-        size_t n_out = 0;
-        const char *in = NULL;
-        size_t n_in = 0;
+        CShquoteTokenizer *tokenizer;
+        CShquoteCacheBuilder *builder;
+        const CShquoteBlob *cached;
+        CShquoteCache *cache;
+        CShquoteBlob *blob;
+        void *data;
+        CShquoteIter *iter;
+        char *out = NULL, *mutable = NULL, *mutable_token;
+        size_t n_out = 0, n_mutable = 0;
+        const char *in = NULL, *token;
+        size_t n_in = 0, n_token;
+        CShquoteStats stats;
+        CShquoteLine *lines;
+        uint32_t *starts, *ends;
         char **argv;
-        size_t argc;
+        size_t argc, len;
+        unsigned int flags;
         int r;
 
         assert(_C_SHQUOTE_E_SUCCESS == 0);
@@ -26,12 +38,86 @@ static void test_api(void) {
         r = c_shquote_quote(&out, &n_out, NULL, 0);
         assert(r == C_SHQUOTE_E_NO_SPACE);
 
+        r = c_shquote_quote_len(&len, NULL, 0);
+        assert(!r);
+        assert(len == 2);
+
+        r = c_shquote_quote_ex(&out, &n_out, NULL, 0, C_SHQUOTE_STYLE_AUTO);
+        assert(r == C_SHQUOTE_E_NO_SPACE);
+
+        r = c_shquote_quote_ex_len(&len, NULL, 0, C_SHQUOTE_STYLE_SINGLE);
+        assert(!r);
+        assert(len == 2);
+
+        r = c_shquote_quote_argv_len(&len, NULL, 0);
+        assert(!r);
+        assert(len == 0);
+
+        r = c_shquote_quote_argv(&out, &n_out, NULL, 0);
+        assert(!r);
+
+        r = c_shquote_quote_argv_alloc(&out, &len, NULL, 0);
+        assert(!r);
+        assert(!strcmp(out, ""));
+        free(out);
+        out = NULL;
+
         r = c_shquote_unquote(&out, &n_out, "'", 1);
         assert(r == C_SHQUOTE_E_BAD_QUOTING);
 
+        r = c_shquote_unquote_len(&len, "'", 1);
+        assert(r == C_SHQUOTE_E_BAD_QUOTING);
+
+        r = c_shquote_unquote_ex(&out, &n_out, "$'", 2, C_SHQUOTE_FLAG_ANSI_C);
+        assert(r == C_SHQUOTE_E_BAD_QUOTING);
+
+        len = 0;
+        r = c_shquote_unquote_inplace(mutable, &len);
+        assert(!r);
+        assert(len == 0);
+
         r = c_shquote_parse_next(&out, &n_out, &in, &n_in);
         assert(r == C_SHQUOTE_E_EOF);
 
+        r = c_shquote_parse_next_ex(&out, &n_out, &in, &n_in, C_SHQUOTE_FLAG_ANSI_C);
+        assert(r == C_SHQUOTE_E_EOF);
+
+        r = c_shquote_parse_next_inplace(&mutable_token, &n_token, &mutable, &n_mutable);
+        assert(r == C_SHQUOTE_E_EOF);
+
+        r = c_shquote_parse_next_view(&token, &n_token, &flags, &out, &n_out, &in, &n_in);
+        assert(r == C_SHQUOTE_E_EOF);
+
+        r = c_shquote_validate(&argc, &len, &n_token, "foo bar", strlen("foo bar"));
+        assert(!r);
+        assert(argc == 2);
+        assert(len == 6);
+
+        r = c_shquote_tokenizer_new(&tokenizer);
+        assert(!r);
+        c_shquote_tokenizer_feed(tokenizer, "foo", 3);
+        r = c_shquote_tokenizer_next_token(tokenizer, &token, &n_token);
+        assert(r == C_SHQUOTE_E_EOF);
+        c_shquote_tokenizer_finish(tokenizer);
+        r = c_shquote_tokenizer_next_token(tokenizer, &token, &n_token);
+        assert(!r);
+        assert(n_token == 3);
+        tokenizer = c_shquote_tokenizer_free(tokenizer);
+        assert(!tokenizer);
+
+        r = c_shquote_iter_new(&iter, "foo 'bar'", strlen("foo 'bar'"));
+        assert(!r);
+        r = c_shquote_iter_skip_token(iter);
+        assert(!r);
+        r = c_shquote_iter_next(iter, &token, &n_token);
+        assert(!r);
+        assert(n_token == 3);
+        c_shquote_iter_get_remaining(iter, &in, &n_in);
+        assert(!n_in);
+        in = NULL;
+        iter = c_shquote_iter_free(iter);
+        assert(!iter);
+
         r = c_shquote_parse_argv(&argv, &argc, "foo", strlen("foo"));
         fprintf(stderr, "%d\n", r);
         assert(!r);
@@ -39,6 +125,66 @@ static void test_api(void) {
         assert(!strcmp(argv[0], "foo"));
 
         free(argv);
+
+        r = c_shquote_parse_argv_with_allocator(&argv, &argc, "foo", strlen("foo"), NULL);
+        assert(!r);
+        assert(argc == 1);
+
+        free(argv);
+
+        r = c_shquote_parse_argv_with_offsets(&argv, &argc, &starts, &ends, " foo", strlen(" foo"));
+        assert(!r);
+        assert(argc == 1);
+        assert(starts[0] == 1 && ends[0] == 4);
+
+        free(argv);
+
+        r = c_shquote_parse_lines(&lines, &len, "foo\nbar", strlen("foo\nbar"), 1);
+        assert(!r);
+        assert(len == 2);
+        assert(lines[1].argc == 1);
+        free(lines);
+
+        r = c_shquote_stats_read(&stats);
+        assert(!r || r == -EOPNOTSUPP);
+
+        r = c_shquote_parse_argv_into(&argv, &argc, &len, NULL, 0, "foo", strlen("foo"));
+        assert(r == C_SHQUOTE_E_NO_SPACE);
+        assert(len == 2 * sizeof(char *) + 4);
+
+        r = c_shquote_parse_argv_blob(&blob, &len, "foo", strlen("foo"));
+        assert(!r);
+        assert(len == 16);
+        r = c_shquote_blob_verify(blob, len);
+        assert(!r);
+        assert(c_shquote_blob_get_size(blob) == len);
+        assert(c_shquote_blob_get_argc(blob) == 1);
+        assert(!strcmp(c_shquote_blob_get_arg(blob, 0, &n_token), "foo"));
+        assert(n_token == 3);
+        free(blob);
+
+        r = c_shquote_cache_builder_new(&builder);
+        assert(!r);
+        r = c_shquote_cache_builder_add(builder, "foo", strlen("foo"));
+        assert(!r);
+        r = c_shquote_cache_builder_finish(builder, &data, &len);
+        assert(!r);
+        builder = c_shquote_cache_builder_free(builder);
+        assert(!builder);
+
+        r = c_shquote_cache_new(&cache, data, len);
+        assert(!r);
+        r = c_shquote_cache_lookup(cache, &cached, "foo", strlen("foo"));
+        assert(!r);
+        assert(c_shquote_blob_get_argc(cached) == 1);
+        r = c_shquote_cache_parse_argv(cache, &cached, &blob, "bar", strlen("bar"));
+        assert(!r);
+        assert(c_shquote_blob_get_argc(cached) == 1);
+        assert((const CShquoteBlob *)blob == cached);
+        free(blob);
+        cache = c_shquote_cache_free(cache);
+        assert(!cache);
+        free(data);
 }
 
 int main(void) {
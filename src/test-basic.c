@@ -6,10 +6,14 @@
 #undef NDEBUG
 #include <assert.h>
 #include <c-stdaux.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "c-shquote.h"
+#include "c-shquote-inline.h"
 
 static void test_quote(void) {
         char buf[1024];
@@ -39,6 +43,206 @@ static void test_quote(void) {
         c_assert(!memcmp(buf, "''\\'''", 6));
 }
 
+static void test_quote_len_one(const char *string) {
+        char buf[1024];
+        char *out = buf;
+        size_t n_out = sizeof(buf), len;
+        int r;
+
+        r = c_shquote_quote_len(&len, string, strlen(string));
+        c_assert(!r);
+
+        r = c_shquote_quote(&out, &n_out, string, strlen(string));
+        c_assert(!r);
+        c_assert(len == sizeof(buf) - n_out);
+
+        /* a buffer of the calculated size must always be sufficient */
+        out = buf;
+        n_out = len;
+        r = c_shquote_quote(&out, &n_out, string, strlen(string));
+        c_assert(!r);
+        c_assert(!n_out);
+}
+
+static void test_quote_len(void) {
+        test_quote_len_one("");
+        test_quote_len_one("a");
+        test_quote_len_one("'");
+        test_quote_len_one("a'b''c'''d''''e'''''f''''''g");
+        test_quote_len_one("foo'bar \"baz\" 'qux'\n");
+}
+
+static void test_quote_ex_one(const char *string, unsigned int style, const char *expected) {
+        unsigned int flags = (style == C_SHQUOTE_STYLE_ANSI_C) ? C_SHQUOTE_FLAG_ANSI_C : 0;
+        char buf[1024], unquoted[1024];
+        char *out = buf, *token;
+        const char *in;
+        size_t n_out = sizeof(buf), n_in, n_token, len;
+        int r;
+
+        r = c_shquote_quote_ex_len(&len, string, strlen(string), style);
+        c_assert(!r);
+
+        r = c_shquote_quote_ex(&out, &n_out, string, strlen(string), style);
+        c_assert(!r);
+        c_assert(out == buf + len);
+        c_assert(n_out == sizeof(buf) - len);
+        if (expected)
+                c_assert(len == strlen(expected) && !memcmp(buf, expected, len));
+
+        /* the result must parse back into exactly one token equal to @string */
+        in = buf;
+        n_in = len;
+        token = unquoted;
+        n_token = sizeof(unquoted);
+        r = c_shquote_parse_next_ex(&token, &n_token, &in, &n_in, flags);
+        c_assert(!r);
+        c_assert(!n_in);
+        c_assert(token - unquoted == (ptrdiff_t)strlen(string));
+        c_assert(!memcmp(unquoted, string, strlen(string)));
+
+        /* ...and unquote to @string as a whole */
+        token = unquoted;
+        n_token = sizeof(unquoted);
+        r = c_shquote_unquote_ex(&token, &n_token, buf, len, flags);
+        c_assert(!r);
+        c_assert(token - unquoted == (ptrdiff_t)strlen(string));
+        c_assert(!memcmp(unquoted, string, strlen(string)));
+
+        /* a buffer one byte short must be rejected without writing anything */
+        out = buf;
+        n_out = len - 1;
+        memset(buf, 0, sizeof(buf));
+        r = c_shquote_quote_ex(&out, &n_out, string, strlen(string), style);
+        c_assert(r == C_SHQUOTE_E_NO_SPACE);
+        c_assert(out == buf);
+        c_assert(n_out == len - 1);
+        c_assert(!buf[0]);
+}
+
+static void test_quote_ex(void) {
+        const char *strings[] = {
+                "", "a", "/usr/bin/foo", "a=b", "~", "#a", "a b", "'", "\"", "\\", "$a", "`a`",
+                "\n", "a\nb", "it's", "\"$HOME\"", "a'b\"c\\d$e`f\ng h", "\xff\x01",
+        };
+        char buf[16];
+        char *out;
+        size_t n_out;
+        int r;
+
+        test_quote_ex_one("a", C_SHQUOTE_STYLE_SINGLE, "'a'");
+        test_quote_ex_one("a", C_SHQUOTE_STYLE_DOUBLE, "\"a\"");
+        test_quote_ex_one("a", C_SHQUOTE_STYLE_BACKSLASH, "a");
+        test_quote_ex_one("a", C_SHQUOTE_STYLE_BARE, "a");
+        test_quote_ex_one("a", C_SHQUOTE_STYLE_AUTO, "a");
+
+        test_quote_ex_one("", C_SHQUOTE_STYLE_BACKSLASH, "''");
+        test_quote_ex_one("", C_SHQUOTE_STYLE_BARE, "''");
+        test_quote_ex_one("", C_SHQUOTE_STYLE_AUTO, "''");
+        test_quote_ex_one("a=b", C_SHQUOTE_STYLE_BARE, "'a=b'");
+
+        test_quote_ex_one("a\"$b", C_SHQUOTE_STYLE_DOUBLE, "\"a\\\"\\$b\"");
+        test_quote_ex_one("a b\nc", C_SHQUOTE_STYLE_BACKSLASH, "a\\ b'\n'c");
+        test_quote_ex_one("a b\nc", C_SHQUOTE_STYLE_DOUBLE, "\"a b\nc\"");
+
+        /* single quotes are cheapest in double quotes, everything else in single quotes */
+        test_quote_ex_one("it's", C_SHQUOTE_STYLE_AUTO, "it\\'s");
+        test_quote_ex_one("it's here", C_SHQUOTE_STYLE_AUTO, "\"it's here\"");
+        test_quote_ex_one("$a b", C_SHQUOTE_STYLE_AUTO, "'$a b'");
+        test_quote_ex_one("'$a'", C_SHQUOTE_STYLE_AUTO, "\"'\\$a'\"");
+        test_quote_ex_one("'a'", C_SHQUOTE_STYLE_AUTO, "\"'a'\"");
+
+        /* ANSI-C quotes escape control bytes and invalid UTF-8, but keep valid UTF-8 */
+        test_quote_ex_one("", C_SHQUOTE_STYLE_ANSI_C, "$''");
+        test_quote_ex_one("a b", C_SHQUOTE_STYLE_ANSI_C, "$'a b'");
+        test_quote_ex_one("a\nb'", C_SHQUOTE_STYLE_ANSI_C, "$'a\\nb\\''");
+        test_quote_ex_one("\\\t\r\a\b\v\f\x1b\x7f", C_SHQUOTE_STYLE_ANSI_C, "$'\\\\\\t\\r\\a\\b\\v\\f\\x1b\\x7f'");
+        test_quote_ex_one("\"$a\"", C_SHQUOTE_STYLE_ANSI_C, "$'\"$a\"'");
+        test_quote_ex_one("\xc3\xa4\xff\xc3", C_SHQUOTE_STYLE_ANSI_C, "$'\xc3\xa4\\xff\\xc3'");
+        test_quote_ex_one("\xc2\x85", C_SHQUOTE_STYLE_ANSI_C, "$'\\xc2\\x85'");
+
+        for (size_t i = 0; i < sizeof(strings) / sizeof(*strings); ++i)
+                for (unsigned int style = 0; style < _C_SHQUOTE_STYLE_N; ++style)
+                        test_quote_ex_one(strings[i], style, NULL);
+
+        /* c_shquote_quote() must match the single-quote style */
+        out = buf;
+        n_out = sizeof(buf);
+        r = c_shquote_quote(&out, &n_out, "a'b", 3);
+        c_assert(!r);
+        c_assert(!memcmp(buf, "'a'\\''b'", 8));
+
+        out = buf;
+        n_out = sizeof(buf);
+        r = c_shquote_quote_ex(&out, &n_out, "a", 1, _C_SHQUOTE_STYLE_N);
+        c_assert(r < 0);
+}
+
+static void test_quote_argv_one(const char * const *args, size_t n_args) {
+        char *line, **argv;
+        size_t n_line, argc;
+        int r;
+
+        r = c_shquote_quote_argv_alloc(&line, &n_line, args, n_args);
+        c_assert(!r);
+        c_assert(strlen(line) == n_line);
+
+        /* the command-line must parse back into the exact same arguments */
+        r = c_shquote_parse_argv(&argv, &argc, line, n_line);
+        c_assert(!r);
+        c_assert(argc == n_args);
+        for (size_t i = 0; i < argc; ++i)
+                c_assert(!strcmp(argv[i], args[i]));
+
+        free(argv);
+        free(line);
+}
+
+static void test_quote_argv(void) {
+        const char *args[] = { "/usr/bin/foo", "", "a'b", "#c", "d e", "\"f\\\n", "'" };
+        char buf[256], canary[sizeof(buf)];
+        char *out;
+        size_t n_out, len;
+        int r;
+
+        test_quote_argv_one(args, 0);
+        test_quote_argv_one(args, 1);
+        test_quote_argv_one(args, 2);
+        test_quote_argv_one(args, sizeof(args) / sizeof(*args));
+
+        /* more arguments than the lengths are cached for */
+        {
+                const char *many[64];
+
+                for (size_t i = 0; i < sizeof(many) / sizeof(*many); ++i)
+                        many[i] = args[i % (sizeof(args) / sizeof(*args))];
+
+                test_quote_argv_one(many, sizeof(many) / sizeof(*many));
+        }
+
+        r = c_shquote_quote_argv_len(&len, args, 3);
+        c_assert(!r);
+        c_assert(len == strlen("'/usr/bin/foo' '' 'a'\\''b'"));
+
+        out = buf;
+        n_out = sizeof(buf);
+        r = c_shquote_quote_argv(&out, &n_out, args, 3);
+        c_assert(!r);
+        c_assert(out == buf + len);
+        c_assert(!memcmp(buf, "'/usr/bin/foo' '' 'a'\\''b'", len));
+
+        /* too small buffers must be rejected without writing anything */
+        memset(buf, 0xff, sizeof(buf));
+        memcpy(canary, buf, sizeof(buf));
+        out = buf;
+        n_out = len - 1;
+        r = c_shquote_quote_argv(&out, &n_out, args, 3);
+        c_assert(r == C_SHQUOTE_E_NO_SPACE);
+        c_assert(out == buf);
+        c_assert(n_out == len - 1);
+        c_assert(!memcmp(buf, canary, sizeof(buf)));
+}
+
 static void test_unquote(void) {
         const char *string = "a\\\n\\b\"\\\"\\$c\\d'\"'e\"''f'";
         char buf[1024];
@@ -52,6 +256,132 @@ static void test_unquote(void) {
         c_assert(!memcmp(buf, "ab\"$c\\d'e\"f", 10));
 }
 
+static void test_unquote_ex_one(const char *string, unsigned int flags, int expected_r, const char *expected) {
+        char buf[1024], *out = buf;
+        const char *in = string;
+        size_t n_out = sizeof(buf), n_in = strlen(string);
+        int r;
+
+        r = c_shquote_unquote_ex(&out, &n_out, string, strlen(string), flags);
+        c_assert(r == expected_r);
+        if (!r)
+                c_assert(out - buf == (ptrdiff_t)strlen(expected) && !memcmp(buf, expected, strlen(expected)));
+
+        /* as a single token, the result must be the same */
+        out = buf;
+        n_out = sizeof(buf);
+        r = c_shquote_parse_next_ex(&out, &n_out, &in, &n_in, flags);
+        c_assert(r == expected_r);
+        if (!r)
+                c_assert(out - buf == (ptrdiff_t)strlen(expected) && !memcmp(buf, expected, strlen(expected)));
+}
+
+static void test_unquote_ex(void) {
+        char buf[16], *out;
+        const char *in;
+        size_t n_out, n_in;
+        int r;
+
+        /* without the flag, a dollar sign is an ordinary character */
+        test_unquote_ex_one("$'a\\nb'", 0, 0, "$a\\nb");
+        test_unquote_ex_one("$'a\\nb'", C_SHQUOTE_FLAG_ANSI_C, 0, "a\nb");
+
+        test_unquote_ex_one("$", C_SHQUOTE_FLAG_ANSI_C, 0, "$");
+        test_unquote_ex_one("a$b$", C_SHQUOTE_FLAG_ANSI_C, 0, "a$b$");
+        test_unquote_ex_one("a$'b'c", C_SHQUOTE_FLAG_ANSI_C, 0, "abc");
+        test_unquote_ex_one("'$'\"$'\"\\$'a'", C_SHQUOTE_FLAG_ANSI_C, 0, "$$'$a");
+        test_unquote_ex_one("$'\\a\\b\\e\\E\\f\\n\\r\\t\\v\\\\\\'\\\"\\?'", C_SHQUOTE_FLAG_ANSI_C, 0,
+                            "\a\b\x1b\x1b\f\n\r\t\v\\'\"?");
+        test_unquote_ex_one("$'\\x41\\x4g\\x\\101\\0610\\q'", C_SHQUOTE_FLAG_ANSI_C, 0, "A\x04g\\xA10\\q");
+        test_unquote_ex_one("$'a", C_SHQUOTE_FLAG_ANSI_C, C_SHQUOTE_E_BAD_QUOTING, NULL);
+        test_unquote_ex_one("$'a\\'", C_SHQUOTE_FLAG_ANSI_C, C_SHQUOTE_E_BAD_QUOTING, NULL);
+
+        /* a token ends at blanks outside of the quotes only */
+        in = "$'a b' c";
+        n_in = strlen(in);
+        out = buf;
+        n_out = sizeof(buf);
+        r = c_shquote_parse_next_ex(&out, &n_out, &in, &n_in, C_SHQUOTE_FLAG_ANSI_C);
+        c_assert(!r);
+        c_assert(out - buf == 3 && !memcmp(buf, "a b", 3));
+        c_assert(n_in == 1 && *in == 'c');
+
+        out = buf;
+        n_out = sizeof(buf);
+        r = c_shquote_unquote_ex(&out, &n_out, "a", 1, ~C_SHQUOTE_FLAG_ANSI_C);
+        c_assert(r == -EINVAL);
+
+        in = "a";
+        n_in = 1;
+        r = c_shquote_parse_next_ex(&out, &n_out, &in, &n_in, ~C_SHQUOTE_FLAG_ANSI_C);
+        c_assert(r == -EINVAL);
+}
+
+static void test_unquote_len(void) {
+        const char *string = "a\\\n\\b\"\\\"\\$c\\d'\"'e\"''f'";
+        char buf[1024];
+        char *out = buf;
+        size_t n_out = sizeof(buf), len;
+        int r;
+
+        r = c_shquote_unquote_len(&len, string, strlen(string));
+        c_assert(!r);
+
+        r = c_shquote_unquote(&out, &n_out, string, strlen(string));
+        c_assert(!r);
+        c_assert(len == sizeof(buf) - n_out);
+
+        r = c_shquote_unquote_len(&len, "", 0);
+        c_assert(!r);
+        c_assert(len == 0);
+
+        r = c_shquote_unquote_len(&len, "'a'\"b\"", 6);
+        c_assert(!r);
+        c_assert(len == 2);
+
+        r = c_shquote_unquote_len(&len, "'a", 2);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+
+        r = c_shquote_unquote_len(&len, "\"a\\", 3);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+}
+
+static void test_unquote_inplace(void) {
+        const char *string = "a\\\n\\b\"\\\"\\$c\\d'\"'e\"''f'";
+        char buf[1024], expected[1024];
+        char *out = expected;
+        size_t n_out = sizeof(expected), n_buf;
+        int r;
+
+        r = c_shquote_unquote(&out, &n_out, string, strlen(string));
+        c_assert(!r);
+
+        n_buf = strlen(string);
+        c_memcpy(buf, string, n_buf);
+        r = c_shquote_unquote_inplace(buf, &n_buf);
+        c_assert(!r);
+        c_assert(n_buf == sizeof(expected) - n_out);
+        c_assert(!memcmp(buf, expected, n_buf));
+
+        /* plain strings are left as they are */
+        n_buf = 3;
+        c_memcpy(buf, "foo", n_buf);
+        r = c_shquote_unquote_inplace(buf, &n_buf);
+        c_assert(!r);
+        c_assert(n_buf == 3 && !memcmp(buf, "foo", 3));
+
+        n_buf = 0;
+        r = c_shquote_unquote_inplace(buf, &n_buf);
+        c_assert(!r);
+        c_assert(n_buf == 0);
+
+        n_buf = 4;
+        c_memcpy(buf, "'foo", n_buf);
+        r = c_shquote_unquote_inplace(buf, &n_buf);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+        c_assert(n_buf == 4);
+}
+
 static void test_reverse(void) {
         const char *string = "a\'b\'\'\'\"c\\\"\"";
         char buf1[1024], buf2[1024];
@@ -137,10 +467,978 @@ static void test_parse(void) {
         free(argv);
 }
 
+static void test_parse_view(void) {
+        const char *string = " foo 'b c' #x\nd#e \"\" g\\h\t/usr/bin/x";
+        const char *expected[] = { "foo", "b c", "d#e", "", "gh", "/usr/bin/x" };
+        bool copied[] = { false, true, false, true, true, false };
+        char buf[strlen(string)];
+        const char *in = string, *token;
+        size_t n_in = strlen(string), n_out = sizeof(buf), n_token;
+        unsigned int flags;
+        char *out = buf;
+        int r;
+
+        for (size_t i = 0; i < sizeof(expected) / sizeof(*expected); ++i) {
+                r = c_shquote_parse_next_view(&token, &n_token, &flags, &out, &n_out, &in, &n_in);
+                c_assert(!r);
+                c_assert(n_token == strlen(expected[i]));
+                c_assert(!memcmp(token, expected[i], n_token));
+
+                if (copied[i]) {
+                        c_assert(flags & C_SHQUOTE_TOKEN_COPIED);
+                        c_assert(token >= buf && token + n_token == out);
+                } else {
+                        c_assert(!(flags & C_SHQUOTE_TOKEN_COPIED));
+                        c_assert(token >= string && token + n_token <= string + strlen(string));
+                }
+        }
+
+        r = c_shquote_parse_next_view(&token, &n_token, &flags, &out, &n_out, &in, &n_in);
+        c_assert(r == C_SHQUOTE_E_EOF);
+        c_assert(!n_in);
+
+        /* plain words never need the scratch buffer */
+        in = "foo bar";
+        n_in = strlen(in);
+        out = NULL;
+        n_out = 0;
+        r = c_shquote_parse_next_view(&token, &n_token, &flags, &out, &n_out, &in, &n_in);
+        c_assert(!r);
+        c_assert(n_token == 3 && !memcmp(token, "foo", 3));
+        c_assert(n_in == 3);
+
+        in = "'foo'";
+        n_in = strlen(in);
+        r = c_shquote_parse_next_view(&token, &n_token, &flags, &out, &n_out, &in, &n_in);
+        c_assert(r == C_SHQUOTE_E_NO_SPACE);
+}
+
+static void test_parse_inplace(void) {
+        const char *string = " a ''\"\" 'b c'\nd#e #f\ng\\\nh \t\n\"i\\\"\"j";
+        const char *expected[] = { "a", "", "b c", "d#e", "gh", "i\"j" };
+        char buf[strlen(string)], *in = buf, *token;
+        size_t n_in = sizeof(buf), n_token;
+        int r;
+
+        c_memcpy(buf, string, sizeof(buf));
+
+        for (size_t i = 0; i < sizeof(expected) / sizeof(*expected); ++i) {
+                r = c_shquote_parse_next_inplace(&token, &n_token, &in, &n_in);
+                c_assert(!r);
+                c_assert(token >= buf && token + n_token <= in);
+                c_assert(n_token == strlen(expected[i]));
+                c_assert(!memcmp(token, expected[i], n_token));
+
+                /* tokens followed by whitespace can be terminated in place */
+                if (n_in > 0) {
+                        c_assert(token + n_token < in);
+                        token[n_token] = '\0';
+                        c_assert(!strcmp(token, expected[i]));
+                }
+        }
+
+        r = c_shquote_parse_next_inplace(&token, &n_token, &in, &n_in);
+        c_assert(r == C_SHQUOTE_E_EOF);
+        c_assert(n_in == 0);
+
+        n_in = 6;
+        in = buf;
+        c_memcpy(buf, "a \"b c", n_in);
+        r = c_shquote_parse_next_inplace(&token, &n_token, &in, &n_in);
+        c_assert(!r);
+        r = c_shquote_parse_next_inplace(&token, &n_token, &in, &n_in);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+        c_assert(in == buf + 2 && n_in == 4);
+}
+
+static void test_validate_one(const char *string, size_t n_string) {
+        const char *in = string;
+        size_t n_in = n_string, n_tokens, n_bytes, n_error, n_expected = 0, n_bytes_expected = 0;
+        int r;
+
+        r = c_shquote_validate(&n_tokens, &n_bytes, &n_error, string, n_string);
+        c_assert(!r);
+
+        for (;;) {
+                char *out = NULL;
+                size_t n_out = n_string;
+
+                r = c_shquote_parse_next(&out, &n_out, &in, &n_in);
+                if (r == C_SHQUOTE_E_EOF)
+                        break;
+
+                c_assert(!r);
+                ++n_expected;
+                n_bytes_expected += n_string - n_out;
+        }
+
+        c_assert(n_tokens == n_expected);
+        c_assert(n_bytes == n_bytes_expected);
+}
+
+static void test_validate(void) {
+        static const struct {
+                const char *string;
+                size_t n_error;
+        } invalid[] = {
+                { "'", 0 },
+                { "a 'b", 2 },
+                { "'a' \"b", 4 },
+                { "\"a\\\"", 0 },
+                { "\"a\\", 0 },
+                { "a\\\\'b c", 3 },
+                { "#'\n\"", 3 },
+                { "a\"b\\\"c", 1 },
+                { "''\"\\\\", 2 },
+        };
+        size_t n_tokens, n_bytes, n_error;
+        int r;
+
+        test_validate_one("", 0);
+        test_validate_one("  \t\n", 4);
+        test_validate_one("a", 1);
+        test_validate_one("\\\n", 2);
+        test_validate_one("\\\n #x\n", 6);
+        test_validate_one("a\\", 2);
+        test_validate_one(" a ''\"\" 'b c'\nd#e #f\ng\\\nh \t\n", 29);
+        test_validate_one("\"\\a\\\"\\$\\\n\" '\"' \\'\\ ", 20);
+        test_validate_one("a\0b c", 5);
+
+        for (size_t i = 0; i < sizeof(invalid) / sizeof(*invalid); ++i) {
+                n_error = SIZE_MAX;
+                r = c_shquote_validate(&n_tokens, &n_bytes, &n_error, invalid[i].string, strlen(invalid[i].string));
+                c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+                c_assert(n_error == invalid[i].n_error);
+        }
+}
+
+static void test_inline_one(const char *string, size_t n_string, size_t n_buf) {
+        char buf1[n_buf + 1], buf2[n_buf + 1];
+        const char *in1 = string, *in2 = string;
+        size_t n_in1 = n_string, n_in2 = n_string, n_out1, n_out2;
+        char *out1, *out2;
+        int r1, r2;
+
+        out1 = buf1;
+        out2 = buf2;
+        n_out1 = n_out2 = n_buf;
+        r1 = c_shquote_quote(&out1, &n_out1, string, n_string);
+        r2 = c_shquote_inline_quote(&out2, &n_out2, string, n_string);
+        c_assert(r1 == r2 && n_out1 == n_out2);
+        c_assert(!memcmp(buf1, buf2, n_buf - n_out1));
+
+        out1 = buf1;
+        out2 = buf2;
+        n_out1 = n_out2 = n_buf;
+        r1 = c_shquote_unquote(&out1, &n_out1, string, n_string);
+        r2 = c_shquote_inline_unquote(&out2, &n_out2, string, n_string);
+        c_assert(r1 == r2 && n_out1 == n_out2);
+        c_assert(!memcmp(buf1, buf2, n_buf - n_out1));
+
+        out1 = buf1;
+        out2 = buf2;
+        n_out1 = n_out2 = n_buf;
+        do {
+                r1 = c_shquote_parse_next(&out1, &n_out1, &in1, &n_in1);
+                r2 = c_shquote_inline_parse_next(&out2, &n_out2, &in2, &n_in2);
+                c_assert(r1 == r2 && n_out1 == n_out2 && n_in1 == n_in2);
+                c_assert(!memcmp(buf1, buf2, n_buf - n_out1));
+        } while (!r1);
+}
+
+static void test_inline(void) {
+        static const char *strings[] = {
+                "",
+                "foo",
+                " a ''\"\" 'b c'\nd#e #f\ng\\\nh \t\n",
+                "\"\\a\\\"\\$\\\n\" '\"' \\'\\ ",
+                "\\\n #x\n\\",
+                "a'b'c\"d\"e\\f",
+                "'a",
+                "\"a\\",
+                "a \"b",
+        };
+
+        for (size_t i = 0; i < sizeof(strings) / sizeof(*strings); ++i) {
+                test_inline_one(strings[i], strlen(strings[i]), 4 * strlen(strings[i]) + 2);
+                for (size_t n = 0; n < strlen(strings[i]); ++n)
+                        test_inline_one(strings[i], strlen(strings[i]), n);
+        }
+}
+
+static int test_tokenizer_split(const char *string, size_t n_split, size_t n_chunk,
+                                char **tokens, size_t *n_tokens) {
+        _c_cleanup_(c_shquote_tokenizer_freep) CShquoteTokenizer *tokenizer = NULL;
+        const char *token;
+        size_t n_string = strlen(string), n_token, i;
+        int r;
+
+        r = c_shquote_tokenizer_new(&tokenizer);
+        c_assert(!r);
+
+        /*
+         * Feed the input in one chunk up to @n_split, and then in chunks of
+         * @n_chunk bytes, and concatenate all tokens zero-separated.
+         */
+        *n_tokens = 0;
+        for (i = 0; ; n_split = n_chunk) {
+                size_t n = n_split;
+
+                n = c_min(n, n_string - i);
+                c_shquote_tokenizer_feed(tokenizer, string + i, n);
+                i += n;
+
+                if (i == n_string)
+                        c_shquote_tokenizer_finish(tokenizer);
+
+                while (!(r = c_shquote_tokenizer_next_token(tokenizer, &token, &n_token))) {
+                        memcpy(*tokens, token, n_token);
+                        *tokens += n_token;
+                        *(*tokens)++ = '\0';
+                        ++*n_tokens;
+                }
+
+                if (r != C_SHQUOTE_E_EOF || i == n_string)
+                        break;
+        }
+
+        return r == C_SHQUOTE_E_EOF ? 0 : r;
+}
+
+static void test_tokenizer_one(const char *string) {
+        char expected[strlen(string) * 2 + 1], tokens[strlen(string) * 2 + 1];
+        char *out, **argv;
+        size_t argc, n_tokens, n_expected;
+        int r, r_argv;
+
+        r_argv = c_shquote_parse_argv(&argv, &argc, string, strlen(string));
+
+        out = expected;
+        for (size_t i = 0; !r_argv && i < argc; ++i)
+                out = stpcpy(out, argv[i]) + 1;
+        n_expected = out - expected;
+
+        /* every split point and chunk size must produce the same tokens */
+        for (size_t n_split = 0; n_split <= strlen(string); ++n_split) {
+                for (size_t n_chunk = 1; n_chunk <= 3; ++n_chunk) {
+                        out = tokens;
+                        r = test_tokenizer_split(string, n_split, n_chunk, &out, &n_tokens);
+                        c_assert(r == r_argv);
+
+                        if (!r) {
+                                c_assert(n_tokens == argc);
+                                c_assert((size_t)(out - tokens) == n_expected);
+                                c_assert(!memcmp(tokens, expected, n_expected));
+                        }
+                }
+        }
+
+        if (!r_argv)
+                free(argv);
+}
+
+static void test_tokenizer(void) {
+        test_tokenizer_one("");
+        test_tokenizer_one("foo");
+        test_tokenizer_one(" a ''\"\" 'b c'\nd#e #f\ng\\\nh \t\n");
+        test_tokenizer_one("foo 'bar baz' \"a\\\"b\\c\\\n\" q\\ x");
+        test_tokenizer_one("#only a comment");
+        test_tokenizer_one("trailing\\");
+        test_tokenizer_one("\\\n#comment\nfoo");
+        test_tokenizer_one("'open");
+        test_tokenizer_one("\"open\\\"");
+        test_tokenizer_one("\"a\\");
+}
+
+static void test_iter_one(const char *string) {
+        _c_cleanup_(c_shquote_iter_freep) CShquoteIter *iter = NULL;
+        const char *token, *rest;
+        size_t n_string = strlen(string), argc, n_token, n_rest;
+        char **argv;
+        int r, r_argv;
+
+        r_argv = c_shquote_parse_argv(&argv, &argc, string, n_string);
+
+        /* every token must match, no matter how many were skipped before */
+        for (size_t n_skip = 0; n_skip <= (r_argv ? 2 : argc); ++n_skip) {
+                r = c_shquote_iter_new(&iter, string, n_string);
+                c_assert(!r);
+
+                for (size_t i = 0; ; ++i) {
+                        if (i < n_skip) {
+                                r = c_shquote_iter_skip_token(iter);
+                        } else {
+                                r = c_shquote_iter_next(iter, &token, &n_token);
+                                if (!r && !r_argv) {
+                                        c_assert(n_token == strlen(argv[i]));
+                                        c_assert(!memcmp(token, argv[i], n_token));
+                                }
+                        }
+
+                        if (r) {
+                                c_assert(r == (r_argv ?: C_SHQUOTE_E_EOF));
+                                c_assert(r_argv || i == argc);
+                                break;
+                        }
+                }
+
+                /* failures must not move the iterator */
+                c_shquote_iter_get_remaining(iter, &rest, &n_rest);
+                c_assert(rest + n_rest == string + n_string);
+                r = c_shquote_iter_skip_token(iter);
+                c_assert(r == (r_argv ?: C_SHQUOTE_E_EOF));
+
+                iter = c_shquote_iter_free(iter);
+        }
+
+        if (!r_argv)
+                free(argv);
+}
+
+static void test_iter(void) {
+        _c_cleanup_(c_shquote_iter_freep) CShquoteIter *iter = NULL;
+        const char *token, *rest;
+        size_t n_token, n_rest;
+        char string[4096];
+        int r;
+
+        test_iter_one("");
+        test_iter_one("foo");
+        test_iter_one(" a ''\"\" 'b c'\nd#e #f\ng\\\nh \t\n");
+        test_iter_one("foo 'bar baz' \"a\\\"b\\c\\\n\" q\\ x");
+        test_iter_one("#only a comment");
+        test_iter_one("trailing\\");
+        test_iter_one("a 'open");
+        test_iter_one("a \"open\\\"");
+
+        /*
+         * Route on the first token of a line with a long, quoted payload. The
+         * payload must not be looked at, and growing the buffer for a long
+         * token must keep the iterator consistent.
+         */
+        memcpy(string, "cmd \"", 5);
+        memset(string + 5, 'x', sizeof(string) - 6);
+        string[sizeof(string) - 1] = '"';
+
+        r = c_shquote_iter_new(&iter, string, sizeof(string) - 1);
+        c_assert(!r);
+        r = c_shquote_iter_next(iter, &token, &n_token);
+        c_assert(!r);
+        c_assert(n_token == 3 && !memcmp(token, "cmd", 3));
+        c_shquote_iter_get_remaining(iter, &rest, &n_rest);
+        c_assert(rest == string + 4);
+        c_assert(n_rest == sizeof(string) - 5);
+        r = c_shquote_iter_next(iter, &token, &n_token);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+        c_shquote_iter_get_remaining(iter, &rest, &n_rest);
+        c_assert(rest == string + 4);
+        iter = c_shquote_iter_free(iter);
+
+        r = c_shquote_iter_new(&iter, string, sizeof(string));
+        c_assert(!r);
+        r = c_shquote_iter_skip_token(iter);
+        c_assert(!r);
+        r = c_shquote_iter_next(iter, &token, &n_token);
+        c_assert(!r);
+        c_assert(n_token == sizeof(string) - 6);
+        c_assert(token[0] == 'x' && token[n_token - 1] == 'x');
+        r = c_shquote_iter_next(iter, &token, &n_token);
+        c_assert(r == C_SHQUOTE_E_EOF);
+}
+
+static void test_parse_argv_one(const char *string, size_t n_expected) {
+        char **argv;
+        size_t argc;
+        int r;
+
+        r = c_shquote_parse_argv(&argv, &argc, string, strlen(string));
+        c_assert(!r);
+        c_assert(argc == n_expected);
+        c_assert(!argv[argc]);
+
+        free(argv);
+}
+
+static void test_parse_argv(void) {
+        /* verify the pre-allocated argument-array is always big enough */
+        test_parse_argv_one("", 0);
+        test_parse_argv_one(" ", 0);
+        test_parse_argv_one("a", 1);
+        test_parse_argv_one("a b", 2);
+        test_parse_argv_one("a b ", 2);
+        test_parse_argv_one("'' '' ''", 3);
+        test_parse_argv_one("\"\"\t''\n\"\"", 3);
+        test_parse_argv_one("a b c d e f g h i j k l m n o p", 16);
+        test_parse_argv_one("#a b c", 0);
+        test_parse_argv_one("a #b c\nd", 2);
+}
+
+static void test_parse_argv_offsets(void) {
+        const char *string = " a ''\"\" 'b c'\nd#e #f\ng\\\nh \t\n\\\n  i\\";
+        const char *expected[] = { "a", "", "b c", "d#e", "gh", "i" };
+        const char *sources[] = { "a", "''\"\"", "'b c'", "d#e", "g\\\nh", "i\\" };
+        uint32_t *starts, *ends;
+        char **argv;
+        size_t argc;
+        int r;
+
+        r = c_shquote_parse_argv_with_offsets(&argv, &argc, &starts, &ends, string, strlen(string));
+        c_assert(!r);
+        c_assert(argc == sizeof(expected) / sizeof(*expected));
+        c_assert(!argv[argc]);
+
+        for (size_t i = 0; i < argc; ++i) {
+                c_assert(!strcmp(argv[i], expected[i]));
+                c_assert(starts[i] < ends[i] && ends[i] <= strlen(string));
+                c_assert(ends[i] - starts[i] == strlen(sources[i]));
+                c_assert(!memcmp(string + starts[i], sources[i], ends[i] - starts[i]));
+        }
+
+        free(argv);
+
+        r = c_shquote_parse_argv_with_offsets(&argv, &argc, &starts, &ends, "", 0);
+        c_assert(!r);
+        c_assert(argc == 0);
+        free(argv);
+
+        r = c_shquote_parse_argv_with_offsets(&argv, &argc, &starts, &ends, "a 'b", 4);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+}
+
+static void test_parse_argv_into_one(const char *string) {
+        char *buffer[256];
+        char **argv, **argv_ref;
+        size_t argc, argc_ref, n_used, n_required;
+        int r;
+
+        r = c_shquote_parse_argv(&argv_ref, &argc_ref, string, strlen(string));
+        c_assert(!r);
+
+        /* query the exact size with an empty buffer */
+        r = c_shquote_parse_argv_into(&argv, &argc, &n_required, buffer, 0, string, strlen(string));
+        c_assert(r == C_SHQUOTE_E_NO_SPACE);
+        c_assert(n_required >= sizeof(char *));
+        c_assert(n_required <= sizeof(buffer));
+
+        r = c_shquote_parse_argv_into(&argv, &argc, &n_used, buffer, n_required - 1, string, strlen(string));
+        c_assert(r == C_SHQUOTE_E_NO_SPACE);
+        c_assert(n_used == n_required);
+
+        /* the exact size must suffice, as must a big buffer */
+        for (size_t n_buffer = n_required; ; n_buffer = sizeof(buffer)) {
+                memset(buffer, 0xff, sizeof(buffer));
+                r = c_shquote_parse_argv_into(&argv, &argc, &n_used, buffer, n_buffer, string, strlen(string));
+                c_assert(!r);
+                c_assert(argv == buffer);
+                c_assert(n_used <= n_buffer);
+                c_assert(argc == argc_ref);
+                c_assert(!argv[argc]);
+                for (size_t i = 0; i < argc; ++i) {
+                        c_assert(!strcmp(argv[i], argv_ref[i]));
+                        c_assert(argv[i] + strlen(argv[i]) < (char *)buffer + n_used);
+                }
+
+                if (n_buffer == sizeof(buffer))
+                        break;
+        }
+
+        free(argv_ref);
+}
+
+static void test_parse_argv_into(void) {
+        char *buffer[4];
+        char **argv;
+        size_t argc, n_used;
+        int r;
+
+        test_parse_argv_into_one("");
+        test_parse_argv_into_one(" ");
+        test_parse_argv_into_one("a");
+        test_parse_argv_into_one("a b c");
+        test_parse_argv_into_one("'' \"\" ''");
+        test_parse_argv_into_one("foo 'bar baz' \"a\\\"b\" c\\ d # comment");
+        test_parse_argv_into_one("'a'\"b\"c\\\nd\te\n\n#f\ng");
+
+        r = c_shquote_parse_argv_into(&argv, &argc, &n_used, buffer, sizeof(buffer), "'", 1);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+        r = c_shquote_parse_argv_into(&argv, &argc, &n_used, buffer, 0, "a '", 3);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+        r = c_shquote_parse_argv_into(&argv, &argc, &n_used, buffer, sizeof(buffer), "a\0", 2);
+        c_assert(r == C_SHQUOTE_E_CONTAINS_NULL);
+}
+
+static void test_parse_argv_blob_one(const char *string) {
+        _c_cleanup_(c_freep) CShquoteBlob *blob = NULL;
+        _c_cleanup_(c_freep) char *copy = NULL;
+        char **argv_ref;
+        size_t argc_ref, n_blob, n_expected, n_arg;
+        const char *arg;
+        int r;
+
+        r = c_shquote_parse_argv(&argv_ref, &argc_ref, string, strlen(string));
+        c_assert(!r);
+
+        r = c_shquote_parse_argv_blob(&blob, &n_blob, string, strlen(string));
+        c_assert(!r);
+        c_assert(!c_shquote_blob_verify(blob, n_blob));
+        c_assert(c_shquote_blob_get_size(blob) == n_blob);
+        c_assert(c_shquote_blob_get_argc(blob) == argc_ref);
+
+        /* the blob is tightly packed, with one 32-bit offset per argument */
+        n_expected = 8;
+        for (size_t i = 0; i < argc_ref; ++i)
+                n_expected += 4 + strlen(argv_ref[i]) + 1;
+        c_assert(n_blob == n_expected);
+
+        /* a copy at an unaligned address must be usable as is */
+        copy = malloc(n_blob + 1);
+        c_assert(copy);
+        memcpy(copy + 1, blob, n_blob);
+        memset(blob, 0, n_blob);
+        c_assert(!c_shquote_blob_verify((CShquoteBlob *)(copy + 1), n_blob));
+
+        for (size_t i = 0; i < argc_ref; ++i) {
+                arg = c_shquote_blob_get_arg((CShquoteBlob *)(copy + 1), i, &n_arg);
+                c_assert(n_arg == strlen(argv_ref[i]));
+                c_assert(!strcmp(arg, argv_ref[i]));
+                c_assert(arg == c_shquote_blob_get_arg((CShquoteBlob *)(copy + 1), i, NULL));
+        }
+
+        /* every truncation and every flipped bit must be caught, or be harmless */
+        for (size_t i = 0; i < n_blob; ++i)
+                c_assert(c_shquote_blob_verify((CShquoteBlob *)(copy + 1), i) == -EBADMSG);
+
+        for (size_t i = 0; i < n_blob * 8; ++i) {
+                copy[1 + i / 8] ^= 1 << (i % 8);
+                r = c_shquote_blob_verify((CShquoteBlob *)(copy + 1), n_blob);
+                c_assert(r == -EBADMSG || (!r && i / 8 >= 8 && i / 8 < n_blob - 4 * argc_ref));
+                copy[1 + i / 8] ^= 1 << (i % 8);
+        }
+
+        free(argv_ref);
+}
+
+static void test_parse_argv_blob(void) {
+        static const char expected[] = "\x16\0\0\0\x02\0\0\0a\0b c\0\x08\0\0\0\x0a\0\0\0";
+        _c_cleanup_(c_freep) CShquoteBlob *blob = NULL;
+        size_t n_blob;
+        int r;
+
+        test_parse_argv_blob_one("");
+        test_parse_argv_blob_one(" ");
+        test_parse_argv_blob_one("a");
+        test_parse_argv_blob_one("a b c");
+        test_parse_argv_blob_one("'' \"\" ''");
+        test_parse_argv_blob_one("foo 'bar baz' \"a\\\"b\" c\\ d # comment");
+        test_parse_argv_blob_one("'a'\"b\"c\\\nd\te\n\n#f\ng");
+
+        /* the format is fixed, regardless of the machine */
+        r = c_shquote_parse_argv_blob(&blob, &n_blob, "a 'b c'", 7);
+        c_assert(!r);
+        c_assert(n_blob == sizeof(expected) - 1);
+        c_assert(!memcmp(blob, expected, n_blob));
+
+        r = c_shquote_parse_argv_blob(&blob, &n_blob, "a '", 3);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+        r = c_shquote_parse_argv_blob(&blob, &n_blob, "a\0", 2);
+        c_assert(r == C_SHQUOTE_E_CONTAINS_NULL);
+}
+
+static void test_cache_check(const CShquoteCache *cache, const char *string, bool cached) {
+        const CShquoteBlob *blob, *blob2;
+        CShquoteBlob *parsed;
+        char **argv;
+        size_t argc;
+        int r;
+
+        r = c_shquote_cache_lookup(cache, &blob, string, strlen(string));
+        c_assert(r == (cached ? 0 : -ENOENT));
+
+        r = c_shquote_cache_parse_argv(cache, &blob2, &parsed, string, strlen(string));
+        c_assert(!r);
+        c_assert(cached ? blob2 == blob && !parsed : blob2 == parsed);
+
+        r = c_shquote_parse_argv(&argv, &argc, string, strlen(string));
+        c_assert(!r);
+        c_assert(!c_shquote_blob_verify(blob2, c_shquote_blob_get_size(blob2)));
+        c_assert(c_shquote_blob_get_argc(blob2) == argc);
+        for (size_t i = 0; i < argc; ++i)
+                c_assert(!strcmp(c_shquote_blob_get_arg(blob2, i, NULL), argv[i]));
+
+        free(parsed);
+        free(argv);
+}
+
+static void test_cache(void) {
+        static const char *strings[] = {
+                "", "a", "a b", "/usr/bin/foo --bar 'baz qux'", "\"a\\\"b\" c\\ d # comment",
+                "a\n\nb", "a b", "  a   b  ",
+        };
+        _c_cleanup_(c_shquote_cache_builder_freep) CShquoteCacheBuilder *builder = NULL;
+        _c_cleanup_(c_shquote_cache_freep) CShquoteCache *cache = NULL;
+        _c_cleanup_(c_freep) void *data = NULL, *data2 = NULL;
+        _c_cleanup_(c_freep) char *copy = NULL;
+        size_t n_data, n_data2;
+        int r;
+
+        r = c_shquote_cache_builder_new(&builder);
+        c_assert(!r);
+
+        /* an empty cache file is valid, and parses everything on demand */
+        r = c_shquote_cache_builder_finish(builder, &data, &n_data);
+        c_assert(!r);
+        r = c_shquote_cache_new(&cache, data, n_data);
+        c_assert(!r);
+        test_cache_check(cache, "a b", false);
+        cache = c_shquote_cache_free(cache);
+        free(data);
+
+        for (size_t i = 0; i < sizeof(strings) / sizeof(*strings); ++i) {
+                r = c_shquote_cache_builder_add(builder, strings[i], strlen(strings[i]));
+                c_assert(!r);
+        }
+
+        r = c_shquote_cache_builder_add(builder, "a '", 3);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+
+        r = c_shquote_cache_builder_finish(builder, &data, &n_data);
+        c_assert(!r);
+        builder = c_shquote_cache_builder_free(builder);
+
+        /* the result must not depend on the order, nor on duplicates */
+        r = c_shquote_cache_builder_new(&builder);
+        c_assert(!r);
+        for (size_t i = sizeof(strings) / sizeof(*strings); i-- > 0; ) {
+                r = c_shquote_cache_builder_add(builder, strings[i], strlen(strings[i]));
+                c_assert(!r);
+        }
+        r = c_shquote_cache_builder_finish(builder, &data2, &n_data2);
+        c_assert(!r);
+        c_assert(n_data2 == n_data);
+        c_assert(!memcmp(data2, data, n_data));
+
+        /* use the file in place, at an unaligned address */
+        copy = malloc(n_data + 1);
+        c_assert(copy);
+        memcpy(copy + 1, data, n_data);
+
+        r = c_shquote_cache_new(&cache, copy + 1, n_data);
+        c_assert(!r);
+        for (size_t i = 0; i < sizeof(strings) / sizeof(*strings); ++i)
+                test_cache_check(cache, strings[i], true);
+        test_cache_check(cache, "a  b", false);
+        test_cache_check(cache, "a b c", false);
+        test_cache_check(cache, "a\n\n", false);
+
+        r = c_shquote_cache_parse_argv(cache, &(const CShquoteBlob *){ NULL }, &(CShquoteBlob *){ NULL }, "a '", 3);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+        cache = c_shquote_cache_free(cache);
+
+        /* every truncation and every flipped bit must be caught */
+        for (size_t i = 0; i < n_data; ++i) {
+                r = c_shquote_cache_new(&cache, copy + 1, i);
+                c_assert(r == -EBADMSG);
+        }
+
+        for (size_t i = 0; i < n_data * 8; ++i) {
+                copy[1 + i / 8] ^= 1 << (i % 8);
+                r = c_shquote_cache_new(&cache, copy + 1, n_data);
+                c_assert(r == ((i / 8 >= 8 && i / 8 < 12) ? -ESTALE : -EBADMSG));
+                copy[1 + i / 8] ^= 1 << (i % 8);
+        }
+
+        r = c_shquote_cache_new(&cache, NULL, 0);
+        c_assert(!r);
+        test_cache_check(cache, "a b", false);
+}
+
+static void test_parse_lines_one(const char *string, size_t n_string, size_t n_expected) {
+        for (unsigned int n_threads = 0; n_threads <= 4; ++n_threads) {
+                CShquoteLine *lines;
+                char **argv;
+                size_t n_lines, argc, k = 0;
+                int r;
+
+                r = c_shquote_parse_lines(&lines, &n_lines, string, n_string, n_threads);
+                c_assert(!r);
+                c_assert(n_lines == n_expected);
+
+                /* the lines must yield exactly the tokens of the whole input */
+                r = c_shquote_parse_argv(&argv, &argc, string, n_string);
+                c_assert(!r);
+
+                for (size_t i = 0; i < n_lines; ++i) {
+                        c_assert(!lines[i].argv[lines[i].argc]);
+                        for (size_t j = 0; j < lines[i].argc; ++j, ++k) {
+                                c_assert(k < argc);
+                                c_assert(!strcmp(lines[i].argv[j], argv[k]));
+                        }
+                }
+                c_assert(k == argc);
+
+                free(argv);
+                free(lines);
+        }
+}
+
+static void test_parse_lines(void) {
+        _c_cleanup_(c_freep) char *script = NULL;
+        const char *chunks[] = {
+                "foo bar\n", "'a\nb' c\n", "\"d\\\"\ne\"\n", "f\\\ng\n",
+                "# comment 'x\n", "h #i 'j\n", "k#'l\nm'\n", "\n", "  \t\n",
+        };
+        CShquoteLine *lines;
+        size_t n_script = 0, n_lines;
+        int r;
+
+        test_parse_lines_one("", 0, 0);
+        test_parse_lines_one("\n", 1, 1);
+        test_parse_lines_one("a", 1, 1);
+        test_parse_lines_one("a\nb", 3, 2);
+        test_parse_lines_one("a\nb\n", 4, 2);
+        test_parse_lines_one("a\n\nb\n", 5, 3);
+
+        /* enough lines to hand out batches to multiple threads */
+        script = malloc(4096 * 16);
+        c_assert(script);
+        for (size_t i = 0; i < 4096; ++i) {
+                const char *chunk = chunks[i % (sizeof(chunks) / sizeof(*chunks))];
+
+                c_memcpy(script + n_script, chunk, strlen(chunk));
+                n_script += strlen(chunk);
+        }
+
+        test_parse_lines_one(script, n_script, 4096);
+
+        /*
+         * Enough input for multiple chunks, with long quoted strings, some of
+         * which span the boundaries of chunks.
+         */
+        for (size_t q = 0; q < 2; ++q) {
+                _c_cleanup_(c_freep) char *big = NULL;
+                size_t n_big = 0, n_expected = 0;
+
+                big = malloc(512 * 1024);
+                c_assert(big);
+
+                while (n_big < 256 * 1024) {
+                        const char *chunk = chunks[n_expected % (sizeof(chunks) / sizeof(*chunks))];
+
+                        if (n_expected % 1000 == 999) {
+                                big[n_big++] = "'\""[q];
+                                for (size_t i = 0; i < 10000; ++i) {
+                                        big[n_big++] = 'x';
+                                        big[n_big++] = '\n';
+                                }
+                                big[n_big++] = "'\""[q];
+                                big[n_big++] = '\n';
+                        } else {
+                                c_memcpy(big + n_big, chunk, strlen(chunk));
+                                n_big += strlen(chunk);
+                        }
+
+                        ++n_expected;
+                }
+
+                test_parse_lines_one(big, n_big, n_expected);
+        }
+
+        /* errors are propagated, even if only the last line fails */
+        for (unsigned int n_threads = 0; n_threads <= 4; ++n_threads) {
+                script[n_script - 1] = '\'';
+                r = c_shquote_parse_lines(&lines, &n_lines, script, n_script, n_threads);
+                c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+
+                script[0] = '\0';
+                r = c_shquote_parse_lines(&lines, &n_lines, script, n_script, n_threads);
+                c_assert(r == C_SHQUOTE_E_CONTAINS_NULL);
+                script[0] = 'f';
+        }
+}
+
+typedef struct TestArena {
+        _Alignas(max_align_t) char buffer[4096];
+        size_t n_used;
+        size_t n_allocs;
+        size_t n_frees;
+} TestArena;
+
+static void test_stats_diff(CShquoteStats *diff, const CShquoteStats *before) {
+        CShquoteStats after;
+        int r;
+
+        r = c_shquote_stats_read(&after);
+        c_assert(!r);
+
+        diff->n_scanned = after.n_scanned - before->n_scanned;
+        diff->n_segments = after.n_segments - before->n_segments;
+        diff->n_escapes = after.n_escapes - before->n_escapes;
+        diff->n_quotes = after.n_quotes - before->n_quotes;
+        diff->n_comments = after.n_comments - before->n_comments;
+        diff->n_no_space = after.n_no_space - before->n_no_space;
+}
+
+static void test_stats(void) {
+        const char *string = "a 'b' \\c \"d\\e\" #f\n";
+        _c_cleanup_(c_freep) char *input = NULL;
+        CShquoteStats before, single, parallel;
+        size_t n_out, n_lines, argc, n_input = 0;
+        CShquoteLine *lines;
+        char buf[1], *out, **argv;
+        int r;
+
+        r = c_shquote_stats_read(&before);
+        if (r == -EOPNOTSUPP)
+                return;
+        c_assert(!r);
+
+        r = c_shquote_parse_argv(&argv, &argc, string, strlen(string));
+        c_assert(!r);
+        c_assert(argc == 4);
+        free(argv);
+
+        test_stats_diff(&single, &before);
+        c_assert(single.n_scanned > 0);
+        c_assert(single.n_segments > 0);
+        c_assert(single.n_escapes == 2);
+        c_assert(single.n_quotes == 2);
+        c_assert(single.n_comments == 1);
+        c_assert(single.n_no_space == 0);
+
+        r = c_shquote_stats_read(&before);
+        c_assert(!r);
+
+        out = buf;
+        n_out = sizeof(buf);
+        r = c_shquote_unquote(&out, &n_out, "foo", 3);
+        c_assert(r == C_SHQUOTE_E_NO_SPACE);
+
+        test_stats_diff(&single, &before);
+        c_assert(single.n_no_space == 1);
+
+        /* work of helper threads is accounted to the caller */
+        input = malloc(1024 * strlen(string));
+        c_assert(input);
+
+        for (size_t i = 0; i < 1024; ++i) {
+                c_memcpy(input + n_input, string, strlen(string));
+                n_input += strlen(string);
+        }
+
+        r = c_shquote_stats_read(&before);
+        c_assert(!r);
+        r = c_shquote_parse_lines(&lines, &n_lines, input, n_input, 1);
+        c_assert(!r);
+        free(lines);
+        test_stats_diff(&single, &before);
+
+        r = c_shquote_stats_read(&before);
+        c_assert(!r);
+        r = c_shquote_parse_lines(&lines, &n_lines, input, n_input, 4);
+        c_assert(!r);
+        free(lines);
+        test_stats_diff(&parallel, &before);
+
+        c_assert(single.n_escapes == 2 * 1024);
+        c_assert(!memcmp(&single, &parallel, sizeof(single)));
+}
+
+static void *test_arena_alloc(void *userdata, size_t size) {
+        TestArena *arena = userdata;
+        void *p;
+
+        ++arena->n_allocs;
+        size = (size + 15) & ~(size_t)15;
+        if (size > sizeof(arena->buffer) - arena->n_used)
+                return NULL;
+
+        p = arena->buffer + arena->n_used;
+        arena->n_used += size;
+        return p;
+}
+
+static void test_arena_free(void *userdata, void *p) {
+        TestArena *arena = userdata;
+
+        ++arena->n_frees;
+}
+
+static void test_parse_argv_allocator(void) {
+        TestArena arena = {};
+        CShquoteAllocator allocator = {
+                .alloc = test_arena_alloc,
+                .userdata = &arena,
+        };
+        char *long_line;
+        char **argv, **argv2;
+        size_t argc;
+        int r;
+
+        r = c_shquote_parse_argv_with_allocator(&argv, &argc, "a 'b c' d", 9, &allocator);
+        c_assert(!r);
+        c_assert(argc == 3);
+        c_assert(!strcmp(argv[0], "a"));
+        c_assert(!strcmp(argv[1], "b c"));
+        c_assert(!strcmp(argv[2], "d"));
+        c_assert(!argv[3]);
+        c_assert((char *)argv == arena.buffer);
+        c_assert(arena.n_allocs == 1);
+
+        /* subsequent blocks are carved out of the same region */
+        r = c_shquote_parse_argv_with_allocator(&argv2, &argc, "e", 1, &allocator);
+        c_assert(!r);
+        c_assert(argc == 1);
+        c_assert((char *)argv2 > (char *)argv);
+        c_assert((char *)argv2 < arena.buffer + sizeof(arena.buffer));
+        c_assert(!strcmp(argv[1], "b c"));
+        c_assert(arena.n_allocs == 2);
+
+        /* without free callback, failures simply drop the allocation */
+        r = c_shquote_parse_argv_with_allocator(&argv, &argc, "'", 1, &allocator);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+        c_assert(arena.n_allocs == 3);
+
+        allocator.free = test_arena_free;
+        r = c_shquote_parse_argv_with_allocator(&argv, &argc, "a '", 3, &allocator);
+        c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+        c_assert(arena.n_allocs == 4);
+        c_assert(arena.n_frees == 1);
+
+        /* allocation failures are propagated */
+        long_line = malloc(sizeof(arena.buffer));
+        c_assert(long_line);
+        memset(long_line, 'a', sizeof(arena.buffer));
+        r = c_shquote_parse_argv_with_allocator(&argv, &argc, long_line, sizeof(arena.buffer), &allocator);
+        c_assert(r == -ENOMEM);
+        c_assert(arena.n_allocs == 5);
+        c_assert(arena.n_frees == 1);
+        free(long_line);
+}
+
 int main(void) {
         test_quote();
+        test_quote_len();
+        test_quote_ex();
+        test_quote_argv();
         test_unquote();
+        test_unquote_ex();
+        test_unquote_len();
+        test_unquote_inplace();
         test_reverse();
         test_parse();
+        test_parse_inplace();
+        test_parse_view();
+        test_validate();
+        test_inline();
+        test_tokenizer();
+        test_iter();
+        test_parse_argv();
+        test_parse_argv_allocator();
+        test_parse_argv_offsets();
+        test_parse_argv_into();
+        test_parse_argv_blob();
+        test_cache();
+        test_parse_lines();
+        test_stats();
         return 0;
 }
@@ -0,0 +1,309 @@
+/*
+ * Tests for the Command-Line Tool
+ * This test runs the cshquote binary, whose path is passed as first argument,
+ * on fixed inputs and compares its output byte for byte. Every input is fed
+ * once as a regular file, which the tool maps, and once through a pipe on
+ * standard input, which the tool streams in chunks.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <c-stdaux.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* must match the chunk size of cshquote.c */
+#define TEST_CSHQUOTE_BUFFER_SIZE (1024 * 1024)
+
+static const char *test_binary;
+
+static void test_write_all(int fd, const char *data, size_t n_data) {
+        ssize_t l;
+
+        while (n_data > 0) {
+                l = write(fd, data, n_data);
+                if (l < 0 && errno == EINTR)
+                        continue;
+                c_assert(l > 0);
+
+                data += l;
+                n_data -= l;
+        }
+}
+
+/*
+ * Run the tool with the NULL-terminated @args and the input @in. If @mapped
+ * is true, the input is passed as path to a regular file, otherwise it is
+ * written to a pipe on standard input. Returns the exit code of the tool, and
+ * its standard output in @outp, which the caller must free.
+ */
+static int test_run(const char *const *args, bool mapped, const char *in, size_t n_in, char **outp, size_t *n_outp) {
+        char path[4096], *argv[16], *out;
+        const char *tmpdir;
+        pid_t tool, writer = -1;
+        int fd_in, fd_out, p[2], status, status_writer, r;
+        size_t n_argv = 0;
+        struct stat st;
+        ssize_t l;
+        FILE *f;
+
+        argv[n_argv++] = (char *)test_binary;
+        for ( ; *args; ++args) {
+                c_assert(n_argv < C_ARRAY_SIZE(argv) - 2);
+                argv[n_argv++] = (char *)*args;
+        }
+
+        f = tmpfile();
+        c_assert(f);
+        fd_out = fileno(f);
+
+        if (mapped) {
+                tmpdir = getenv("TMPDIR") ?: "/tmp";
+                r = snprintf(path, sizeof(path), "%s/test-cshquote-XXXXXX", tmpdir);
+                c_assert(r > 0 && (size_t)r < sizeof(path));
+
+                fd_in = mkstemp(path);
+                c_assert(fd_in >= 0);
+                test_write_all(fd_in, in, n_in);
+                c_close(fd_in);
+
+                argv[n_argv++] = path;
+        } else {
+                r = pipe(p);
+                c_assert(!r);
+
+                writer = fork();
+                c_assert(writer >= 0);
+                if (!writer) {
+                        c_close(p[0]);
+                        test_write_all(p[1], in, n_in);
+                        _exit(0);
+                }
+
+                c_close(p[1]);
+                fd_in = p[0];
+        }
+
+        argv[n_argv] = NULL;
+
+        tool = fork();
+        c_assert(tool >= 0);
+        if (!tool) {
+                if (!mapped)
+                        c_assert(dup2(fd_in, STDIN_FILENO) == STDIN_FILENO);
+                c_assert(dup2(fd_out, STDOUT_FILENO) == STDOUT_FILENO);
+                execv(test_binary, argv);
+                _exit(127);
+        }
+
+        r = waitpid(tool, &status, 0);
+        c_assert(r == tool);
+        c_assert(WIFEXITED(status));
+
+        if (mapped) {
+                r = unlink(path);
+                c_assert(!r);
+        } else {
+                /* the tool might bail out before it read all of its input */
+                c_close(fd_in);
+                r = waitpid(writer, &status_writer, 0);
+                c_assert(r == writer);
+                c_assert((WIFEXITED(status_writer) && !WEXITSTATUS(status_writer)) ||
+                         (WIFSIGNALED(status_writer) && WTERMSIG(status_writer) == SIGPIPE));
+        }
+
+        r = fstat(fd_out, &st);
+        c_assert(!r);
+
+        out = malloc(st.st_size + 1);
+        c_assert(out);
+        l = pread(fd_out, out, st.st_size, 0);
+        c_assert(l == st.st_size);
+        fclose(f);
+
+        *outp = out;
+        *n_outp = st.st_size;
+        return WEXITSTATUS(status);
+}
+
+/*
+ * Run the tool on @in with both kinds of input, and verify that it succeeds
+ * and writes exactly @expected.
+ */
+static void test_cshquote(const char *const *args, const char *in, size_t n_in, const char *expected, size_t n_expected) {
+        size_t i, n_out;
+        char *out;
+        int r;
+
+        for (i = 0; i < 2; ++i) {
+                r = test_run(args, i, in, n_in, &out, &n_out);
+                c_assert(!r);
+                c_assert(n_out == n_expected);
+                c_assert(!memcmp(out, expected, n_out));
+                free(out);
+        }
+}
+
+/*
+ * Run the tool on @in with both kinds of input, and verify that it fails.
+ */
+static void test_cshquote_fail(const char *const *args, const char *in, size_t n_in) {
+        size_t i, n_out;
+        char *out;
+        int r;
+
+        for (i = 0; i < 2; ++i) {
+                r = test_run(args, i, in, n_in, &out, &n_out);
+                c_assert(r == 1);
+                free(out);
+        }
+}
+
+#define TEST_ARGS(...) ((const char *const []){ __VA_ARGS__, NULL })
+#define TEST_STR(_x) (_x), sizeof(_x) - 1
+
+static void test_split(void) {
+        test_cshquote(TEST_ARGS("split"), TEST_STR(""), TEST_STR(""));
+        test_cshquote(TEST_ARGS("split"), TEST_STR("  \n\t "), TEST_STR(""));
+        test_cshquote(TEST_ARGS("split"),
+                      TEST_STR("a 'b c' \"d\\\"e\"\nf\\\ng h\\ i"),
+                      TEST_STR("a\0b c\0d\"e\0fg\0h i\0"));
+        test_cshquote(TEST_ARGS("split"), TEST_STR("a\n'b\nc'\n"), TEST_STR("a\0b\nc\0"));
+
+        test_cshquote_fail(TEST_ARGS("split"), TEST_STR("a 'b"));
+        test_cshquote_fail(TEST_ARGS("split"), TEST_STR("a \"b\\"));
+}
+
+static void test_join(void) {
+        test_cshquote(TEST_ARGS("join"), TEST_STR(""), TEST_STR(""));
+        test_cshquote(TEST_ARGS("join"),
+                      TEST_STR("a\0b c\0it's\0"),
+                      TEST_STR("'a' 'b c' 'it'\\''s'\n"));
+        test_cshquote(TEST_ARGS("join"),
+                      TEST_STR("a\0b c"),
+                      TEST_STR("'a' 'b c'\n"));
+        test_cshquote(TEST_ARGS("join", "--style=double"),
+                      TEST_STR("a\0$b\0"),
+                      TEST_STR("\"a\" \"\\$b\"\n"));
+        test_cshquote(TEST_ARGS("join", "--style", "bare"),
+                      TEST_STR("a\0b\0"),
+                      TEST_STR("a b\n"));
+}
+
+static void test_quote(void) {
+        test_cshquote(TEST_ARGS("quote"), TEST_STR(""), TEST_STR(""));
+        test_cshquote(TEST_ARGS("quote"),
+                      TEST_STR("a b\nit's\n\n"),
+                      TEST_STR("'a b'\n'it'\\''s'\n''\n"));
+        test_cshquote(TEST_ARGS("quote"), TEST_STR("a\nb"), TEST_STR("'a'\n'b'\n"));
+        test_cshquote(TEST_ARGS("quote", "--null"),
+                      TEST_STR("a\nb\0c\0"),
+                      TEST_STR("'a\nb'\0'c'\0"));
+        test_cshquote(TEST_ARGS("quote", "-z", "-s", "ansi-c"),
+                      TEST_STR("a\nb\0c\0"),
+                      TEST_STR("$'a\\nb'\0$'c'\0"));
+        test_cshquote(TEST_ARGS("quote", "--style=backslash"),
+                      TEST_STR("a b\n"),
+                      TEST_STR("a\\ b\n"));
+}
+
+static void test_unquote(void) {
+        test_cshquote(TEST_ARGS("unquote"), TEST_STR(""), TEST_STR(""));
+        test_cshquote(TEST_ARGS("unquote"),
+                      TEST_STR("'a b'\n\"c\\\"d\"\ne\\ f\n\n"),
+                      TEST_STR("a b\nc\"d\ne f\n\n"));
+        test_cshquote(TEST_ARGS("unquote"), TEST_STR("a\n'b'"), TEST_STR("a\nb\n"));
+        test_cshquote(TEST_ARGS("unquote"), TEST_STR("$'a'\n"), TEST_STR("$a\n"));
+        test_cshquote(TEST_ARGS("unquote", "--style=ansi-c"),
+                      TEST_STR("$'a\\tb'\n'c'\n"),
+                      TEST_STR("a\tb\nc\n"));
+        test_cshquote(TEST_ARGS("unquote", "--null"),
+                      TEST_STR("'a\nb'\0c\0"),
+                      TEST_STR("a\nb\0c\0"));
+
+        test_cshquote_fail(TEST_ARGS("unquote"), TEST_STR("a\n'b\n"));
+}
+
+static void test_options(void) {
+        size_t n_out;
+        char *out;
+        int r;
+
+        r = test_run(TEST_ARGS("--style=invalid", "quote"), false, TEST_STR(""), &out, &n_out);
+        c_assert(r == 1 && !n_out);
+        free(out);
+
+        r = test_run(TEST_ARGS("invalid"), false, TEST_STR(""), &out, &n_out);
+        c_assert(r == 1 && !n_out);
+        free(out);
+
+        r = test_run(TEST_ARGS("--help"), false, TEST_STR(""), &out, &n_out);
+        c_assert(!r && n_out > 0);
+        free(out);
+}
+
+/*
+ * Feed records that exceed the chunk size of the tool, so the streaming input
+ * has to retain and grow its buffer. A short record precedes and follows the
+ * long one, and the last one has no delimiter.
+ */
+static void test_long(void) {
+        size_t i, n_record = 2 * TEST_CSHQUOTE_BUFFER_SIZE + 17;
+        char *in, *quoted, *p;
+
+        in = malloc(n_record + 5);
+        quoted = malloc(n_record + 12);
+        c_assert(in && quoted);
+
+        p = in;
+        *p++ = 'a';
+        *p++ = '\n';
+        for (i = 0; i < n_record; ++i)
+                *p++ = 'x' + i % 3;
+        *p++ = '\n';
+        *p++ = 'b';
+        *p++ = '\n';
+
+        p = quoted;
+        p = stpcpy(p, "'a'\n'");
+        c_memcpy(p, in + 2, n_record);
+        p += n_record;
+        p = stpcpy(p, "'\n'b'\n");
+
+        test_cshquote(TEST_ARGS("quote"), in, n_record + 4, quoted, p - quoted);
+        /* the output terminates the last record */
+        test_cshquote(TEST_ARGS("unquote"), quoted, p - quoted, in, n_record + 5);
+
+        /* the same as tokens, which the tokenizer carries across chunks */
+        in[1] = ' ';
+        in[n_record + 2] = ' ';
+        c_memcpy(quoted, in, n_record + 4);
+        quoted[1] = '\0';
+        quoted[n_record + 2] = '\0';
+        quoted[n_record + 4] = '\0';
+        test_cshquote(TEST_ARGS("split"), in, n_record + 4, quoted, n_record + 5);
+
+        free(quoted);
+        free(in);
+}
+
+int main(int argc, char **argv) {
+        c_assert(argc == 2);
+        test_binary = argv[1];
+
+        test_split();
+        test_join();
+        test_quote();
+        test_unquote();
+        test_options();
+        test_long();
+        return 0;
+}
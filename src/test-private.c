@@ -5,6 +5,7 @@
 #undef NDEBUG
 #include <assert.h>
 #include <c-stdaux.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,6 +28,17 @@ static void test_append_str(void) {
 
         r = c_shquote_append_str(&out, &n_out, string, 1);
         c_assert(r == C_SHQUOTE_E_NO_SPACE);
+
+        /* without output buffer, only the size is accounted for */
+        out = NULL;
+        n_out = strlen(string);
+        r = c_shquote_append_str(&out, &n_out, string, strlen(string));
+        c_assert(!r);
+        c_assert(!out);
+        c_assert(n_out == 0);
+
+        r = c_shquote_append_str(&out, &n_out, string, 1);
+        c_assert(r == C_SHQUOTE_E_NO_SPACE);
 }
 
 static void test_append_char(void) {
@@ -137,42 +149,273 @@ static void test_consume_char(void) {
 static void test_strnspn(void) {
         size_t len;
 
-        len = c_shquote_strnspn(NULL, 0, "a");
+        len = c_shquote_strnspn(NULL, 0, C_SHQUOTE_CLASS_WHITESPACE);
         c_assert(len == 0);
 
-        len = c_shquote_strnspn("a", 1, "");
+        len = c_shquote_strnspn("a", 1, C_SHQUOTE_CLASS_WHITESPACE);
         c_assert(len == 0);
 
-        len = c_shquote_strnspn("ab", 2, "ac");
-        c_assert(len == 1);
+        len = c_shquote_strnspn(" \ta", 3, C_SHQUOTE_CLASS_WHITESPACE);
+        c_assert(len == 2);
 
-        len = c_shquote_strnspn("ab", 2, "bc");
-        c_assert(len == 0);
+        len = c_shquote_strnspn("\n\n", 2, C_SHQUOTE_CLASS_WHITESPACE);
+        c_assert(len == 2);
 
-        len = c_shquote_strnspn("ab", 2, "\xff");
+        len = c_shquote_strnspn("\xff", 1, C_SHQUOTE_CLASS_TOKEN);
         c_assert(len == 0);
 }
 
 static void test_strncspn(void) {
         size_t len;
 
-        len = c_shquote_strncspn(NULL, 0, "a");
+        len = c_shquote_strncspn(NULL, 0, C_SHQUOTE_CLASS_SINGLE);
         c_assert(len == 0);
 
-        len = c_shquote_strncspn("a", 1, "");
-        c_assert(len == 1);
-
-        len = c_shquote_strncspn("ab", 2, "ac");
+        len = c_shquote_strncspn("'", 1, C_SHQUOTE_CLASS_SINGLE);
         c_assert(len == 0);
 
-        len = c_shquote_strncspn("ab", 2, "bc");
+        len = c_shquote_strncspn("a'", 2, C_SHQUOTE_CLASS_SINGLE);
         c_assert(len == 1);
 
-        len = c_shquote_strncspn("ab", 2, "cd");
+        len = c_shquote_strncspn("a\"", 2, C_SHQUOTE_CLASS_DOUBLE);
+        c_assert(len == 1);
+
+        len = c_shquote_strncspn("ab", 2, C_SHQUOTE_CLASS_TOKEN);
+        c_assert(len == 2);
+
+        len = c_shquote_strncspn("a#", 2, C_SHQUOTE_CLASS_UNQUOTE);
         c_assert(len == 2);
 
-        len = c_shquote_strncspn("ab", 2, "\xff");
+        len = c_shquote_strncspn("ab", 2, C_SHQUOTE_CLASS_NEWLINE);
         c_assert(len == 2);
+
+        len = c_shquote_strncspn("\xff", 1, C_SHQUOTE_CLASS_TOKEN);
+        c_assert(len == 1);
+}
+
+static void test_class(void) {
+        const char *members[_C_SHQUOTE_CLASS_N] = {
+                [C_SHQUOTE_CLASS_TOKEN] = "'\"\\ \t\n#",
+                [C_SHQUOTE_CLASS_WORD] = "'\"\\ \t\n",
+                [C_SHQUOTE_CLASS_DOUBLE] = "\\\"",
+                [C_SHQUOTE_CLASS_UNQUOTE] = "'\"\\",
+                [C_SHQUOTE_CLASS_WHITESPACE] = " \t\n",
+                [C_SHQUOTE_CLASS_SINGLE] = "'",
+                [C_SHQUOTE_CLASS_NEWLINE] = "\n",
+                [C_SHQUOTE_CLASS_DOUBLE_ESCAPE] = "\"\\$`",
+                [C_SHQUOTE_CLASS_LINE] = "'\"\\#\n",
+                [C_SHQUOTE_CLASS_WORD_DOLLAR] = "'\"\\ \t\n$",
+                [C_SHQUOTE_CLASS_UNQUOTE_DOLLAR] = "'\"\\$",
+                [C_SHQUOTE_CLASS_ANSI_C] = "'\\",
+        };
+
+        for (unsigned int class = 0; class < _C_SHQUOTE_CLASS_N; ++class) {
+                const CShquoteClass *desc = &c_shquote_classes[class];
+
+                c_assert(desc->n_chars == strlen(members[class]));
+                c_assert(desc->n_chars <= C_SHQUOTE_CLASS_CHARS_MAX);
+                c_assert(!memcmp(desc->chars, members[class], desc->n_chars));
+
+                for (unsigned int c = 0; c <= UCHAR_MAX; ++c)
+                        c_assert(c_shquote_class_test(c, class) ==
+                                 (c && strchr(members[class], c)));
+        }
+}
+
+static size_t test_scan_naive(const char *string,
+                              size_t n_string,
+                              unsigned int class,
+                              bool reject) {
+        const CShquoteClass *desc = &c_shquote_classes[class];
+
+        for (size_t i = 0; i < n_string; ++i)
+                if (!!memchr(desc->chars, string[i], desc->n_chars) == reject)
+                        return i;
+
+        return n_string;
+}
+
+static void test_scan_one(CShquoteScanFn fn) {
+        char string[97];
+
+        /*
+         * Build a string with the interesting characters placed at positions
+         * around the block boundaries of all kernels, and compare against a
+         * naive implementation for all offsets and lengths.
+         */
+        for (size_t i = 0; i < sizeof(string); ++i)
+                string[i] = "ab \t\n'\"\\#\xff\x80"[(i * 7) % 11];
+
+        for (unsigned int class = 0; class < _C_SHQUOTE_CLASS_N; ++class) {
+                for (size_t o = 0; o < 33; ++o) {
+                        for (size_t n = 0; n + o <= sizeof(string); ++n) {
+                                c_assert(fn(string + o, n, class, true) ==
+                                         test_scan_naive(string + o, n, class, true));
+                                c_assert(fn(string + o, n, class, false) ==
+                                         test_scan_naive(string + o, n, class, false));
+                        }
+                }
+        }
+
+        /* long runs without any match must be skipped entirely */
+        memset(string, 'a', sizeof(string));
+        c_assert(fn(string, sizeof(string), C_SHQUOTE_CLASS_DOUBLE, true) == sizeof(string));
+        c_assert(fn(string, sizeof(string), C_SHQUOTE_CLASS_DOUBLE, false) == 0);
+        string[sizeof(string) - 1] = '"';
+        c_assert(fn(string, sizeof(string), C_SHQUOTE_CLASS_DOUBLE, true) == sizeof(string) - 1);
+        memset(string, ' ', sizeof(string) - 1);
+        c_assert(fn(string, sizeof(string), C_SHQUOTE_CLASS_WHITESPACE, false) == sizeof(string) - 1);
+}
+
+static void test_scan(void) {
+        test_scan_one(c_shquote_scan_swar);
+        test_scan_one(c_shquote_scan);
+
+#if defined(C_SHQUOTE_SCAN_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))
+                test_scan_one(c_shquote_scan_sse2);
+        if (__builtin_cpu_supports("avx2"))
+                test_scan_one(c_shquote_scan_avx2);
+#endif
+}
+
+static void test_strncount(void) {
+        const char *string = "'a''\"\\'''''''\\\"'x'''";
+        size_t n;
+
+        n = c_shquote_strncount(NULL, 0, C_SHQUOTE_CLASS_SINGLE);
+        c_assert(n == 0);
+
+        for (size_t i = 0; i <= strlen(string); ++i) {
+                size_t n_single = 0, n_double = 0;
+
+                for (size_t j = 0; j < i; ++j) {
+                        n_single += string[j] == '\'';
+                        n_double += string[j] == '\\' || string[j] == '"';
+                }
+
+                n = c_shquote_strncount(string, i, C_SHQUOTE_CLASS_SINGLE);
+                c_assert(n == n_single);
+                n = c_shquote_strncount(string, i, C_SHQUOTE_CLASS_DOUBLE);
+                c_assert(n == n_double);
+        }
+}
+
+static void test_mask_one(CShquoteMaskFn fn) {
+        CShquoteMasks masks;
+        char block[C_SHQUOTE_MASK_BLOCK];
+
+        for (size_t o = 0; o < 13; ++o) {
+                for (size_t i = 0; i < sizeof(block); ++i)
+                        block[i] = "ab\\\"$`\n'\0\xff\\\\\""[(i * 7 + o) % 13];
+
+                fn(&masks, block);
+
+                for (size_t i = 0; i < sizeof(block); ++i) {
+                        c_assert(!!(masks.backslashes & (UINT64_C(1) << i)) == (block[i] == '\\'));
+                        c_assert(!!(masks.quotes & (UINT64_C(1) << i)) == (block[i] == '"'));
+                        c_assert(!!(masks.specials & (UINT64_C(1) << i)) ==
+                                 (block[i] && !!strchr("\"\\$`\n", block[i])));
+                }
+        }
+}
+
+static void test_mask(void) {
+        test_mask_one(c_shquote_mask_double_swar);
+        test_mask_one(c_shquote_mask_double);
+
+#if defined(C_SHQUOTE_SCAN_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))
+                test_mask_one(c_shquote_mask_double_sse2);
+        if (__builtin_cpu_supports("avx2"))
+                test_mask_one(c_shquote_mask_double_avx2);
+#endif
+
+        /* every run of backslashes at every offset, compared to a naive walk */
+        for (size_t o = 0; o < 64; ++o) {
+                for (size_t n = 1; o + n <= 64; ++n) {
+                        uint64_t backslashes, escapes = 0;
+
+                        backslashes = ((n == 64 ? 0 : UINT64_C(1) << n) - 1) << o;
+                        backslashes |= UINT64_C(0x8001000100010001) & ~(backslashes << 1) & ~(backslashes >> 1);
+
+                        for (size_t i = 0; i < 64; ++i) {
+                                if (backslashes & (UINT64_C(1) << i)) {
+                                        escapes |= UINT64_C(1) << i;
+                                        ++i;
+                                }
+                        }
+
+                        c_assert(c_shquote_mask_escapes(backslashes) == escapes);
+                }
+        }
+}
+
+static void test_scan_escape_one(CShquoteScanEscapeFn fn) {
+        char string[97];
+
+        /* all bytes that need an escape, around the block boundaries */
+        for (size_t i = 0; i < sizeof(string); ++i)
+                string[i] = "ab\x1f \x7f~'\\\n\0\xff\x80"[(i * 7) % 12];
+
+        for (size_t o = 0; o < 33; ++o) {
+                for (size_t n = 0; n + o <= sizeof(string); ++n) {
+                        size_t expected = 0;
+
+                        while (expected < n) {
+                                unsigned char c = string[o + expected];
+
+                                if (c < 0x20 || c >= 0x7f || c == '\'' || c == '\\')
+                                        break;
+
+                                ++expected;
+                        }
+
+                        c_assert(fn(string + o, n) == expected);
+                }
+        }
+
+        /* every byte value on its own, at the end of a long run */
+        memset(string, 'a', sizeof(string));
+        for (unsigned int c = 0; c <= UCHAR_MAX; ++c) {
+                string[sizeof(string) - 1] = c;
+                c_assert(fn(string, sizeof(string)) ==
+                         sizeof(string) - (c < 0x20 || c >= 0x7f || c == '\'' || c == '\\'));
+        }
+}
+
+static void test_scan_escape(void) {
+        test_scan_escape_one(c_shquote_scan_escape_swar);
+        test_scan_escape_one(c_shquote_scan_escape);
+
+#if defined(C_SHQUOTE_SCAN_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))
+                test_scan_escape_one(c_shquote_scan_escape_sse2);
+        if (__builtin_cpu_supports("avx2"))
+                test_scan_escape_one(c_shquote_scan_escape_avx2);
+#endif
+}
+
+static void test_utf8_len(void) {
+        c_assert(c_shquote_utf8_len("a", 1) == 1);
+        c_assert(c_shquote_utf8_len("\x7f", 1) == 0);
+        c_assert(c_shquote_utf8_len("\n", 1) == 0);
+        c_assert(c_shquote_utf8_len("\xc3\xa4", 2) == 2);
+        c_assert(c_shquote_utf8_len("\xc3\xa4", 1) == 0);
+        c_assert(c_shquote_utf8_len("\xc2\x85", 2) == 0);
+        c_assert(c_shquote_utf8_len("\xc2\xa0", 2) == 2);
+        c_assert(c_shquote_utf8_len("\xc0\xaf", 2) == 0);
+        c_assert(c_shquote_utf8_len("\xe2\x82\xac", 3) == 3);
+        c_assert(c_shquote_utf8_len("\xe0\x80\xaf", 3) == 0);
+        c_assert(c_shquote_utf8_len("\xed\xa0\x80", 3) == 0);
+        c_assert(c_shquote_utf8_len("\xf0\x9f\x98\x80", 4) == 4);
+        c_assert(c_shquote_utf8_len("\xf0\x9f\x98", 3) == 0);
+        c_assert(c_shquote_utf8_len("\xf4\x90\x80\x80", 4) == 0);
+        c_assert(c_shquote_utf8_len("\x80", 1) == 0);
+        c_assert(c_shquote_utf8_len("\xff", 1) == 0);
 }
 
 static void test_discard_comment(void) {
@@ -386,6 +629,205 @@ static void test_unquote_double(void) {
         c_assert(!memcmp(buf, "fo\"obar", strlen(string) - 3));
 }
 
+static void test_unquote_double_block(void) {
+        char string[256], expected[256], buf[256], *out;
+        const char *in;
+        size_t n_string, n_expected, n_in, n_out;
+        int r;
+
+        /*
+         * Place runs of backslashes of all lengths so they cross the block
+         * boundaries at every offset, and verify the result against the
+         * expected output built alongside.
+         */
+        for (size_t o = 0; o < 72; ++o) {
+                for (size_t n = 0; n < 6; ++n) {
+                        n_string = 0;
+                        n_expected = 0;
+
+                        string[n_string++] = '"';
+                        for (size_t i = 0; i < o; ++i) {
+                                string[n_string++] = 'a';
+                                expected[n_expected++] = 'a';
+                        }
+                        for (size_t i = 0; i < n / 2; ++i) {
+                                string[n_string++] = '\\';
+                                string[n_string++] = '\\';
+                                expected[n_expected++] = '\\';
+                        }
+                        if (n % 2) {
+                                string[n_string++] = '\\';
+                                string[n_string++] = '"';
+                                expected[n_expected++] = '"';
+                        }
+                        string[n_string++] = '\\';
+                        string[n_string++] = 'b';
+                        expected[n_expected++] = '\\';
+                        expected[n_expected++] = 'b';
+                        string[n_string++] = '"';
+                        string[n_string++] = 'c';
+
+                        in = string;
+                        n_in = n_string;
+                        out = buf;
+                        n_out = sizeof(buf);
+                        r = c_shquote_unquote_double(&out, &n_out, &in, &n_in);
+                        c_assert(!r);
+                        c_assert(n_in == 1 && *in == 'c');
+                        c_assert((size_t)(out - buf) == n_expected);
+                        c_assert(!memcmp(buf, expected, n_expected));
+
+                        /* without the closing quote, or in a lone backslash */
+                        for (size_t i = 2; i < 4; ++i) {
+                                in = string;
+                                n_in = n_string - i;
+                                out = buf;
+                                n_out = sizeof(buf);
+                                r = c_shquote_unquote_double(&out, &n_out, &in, &n_in);
+                                c_assert(r == C_SHQUOTE_E_BAD_QUOTING);
+                        }
+
+                        /* space is exhausted before the missing quote is seen */
+                        in = string;
+                        n_in = n_string - 2;
+                        out = buf;
+                        n_out = n_expected - 1;
+                        r = c_shquote_unquote_double(&out, &n_out, &in, &n_in);
+                        c_assert(r == C_SHQUOTE_E_NO_SPACE);
+                }
+        }
+}
+
+static void test_parse_next_dfa_one(const char *string,
+                                    size_t n_string,
+                                    size_t n_buf,
+                                    unsigned int flags) {
+        char buf[2][256], *out[2];
+        const char *in[2], *start[2], *end[2];
+        size_t n_in[2], n_out[2];
+        int r[2];
+
+        c_assert(n_buf <= sizeof(buf[0]));
+
+        for (size_t i = 0; i < 2; ++i) {
+                in[i] = string;
+                n_in[i] = n_string;
+                out[i] = buf[i];
+                n_out[i] = n_buf;
+        }
+
+        do {
+                for (size_t i = 0; i < 2; ++i) {
+                        start[i] = NULL;
+                        end[i] = NULL;
+                        r[i] = c_shquote_parse_next_dfa(&out[i], &n_out[i], &in[i], &n_in[i], &start[i], &end[i], flags, i);
+                }
+
+                c_assert(r[0] == r[1]);
+                c_assert(in[0] == in[1] && n_in[0] == n_in[1]);
+                c_assert(start[0] == start[1] && end[0] == end[1]);
+                c_assert(n_out[0] == n_out[1]);
+                c_assert(!memcmp(buf[0], buf[1], n_buf - n_out[0]));
+        } while (!r[0]);
+}
+
+static void test_parse_next_dfa(void) {
+        static const char alphabet[] = "a \n'\"\\#$";
+        char string[256];
+        size_t n, k;
+
+        /*
+         * Running the DFA byte by byte is the reference for the version that
+         * skips over runs. Compare them on all short strings over an alphabet
+         * that hits every byte-class, and on long runs of every state.
+         */
+        for (n = 0; n <= 5; ++n) {
+                for (size_t i = 0; i < (size_t)1 << (3 * n); ++i) {
+                        for (k = 0; k < n; ++k)
+                                string[k] = alphabet[(i >> (3 * k)) & 7];
+
+                        test_parse_next_dfa_one(string, n, sizeof(string), 0);
+                        test_parse_next_dfa_one(string, n, i % 4, 0);
+                        test_parse_next_dfa_one(string, n, sizeof(string), C_SHQUOTE_FLAG_ANSI_C);
+                        test_parse_next_dfa_one(string, n, i % 4, C_SHQUOTE_FLAG_ANSI_C);
+                }
+        }
+
+        for (size_t i = 0; i < 4 * 8 * 8; ++i) {
+                n = 0;
+                string[n++] = alphabet[i % 8];
+                for (k = 0; k < 100; ++k)
+                        string[n++] = (k % 37 == 36) ? alphabet[(i / 8) % 8] : "a \n"[i / 64 % 3];
+                string[n++] = alphabet[(i / 8) % 8];
+                string[n++] = alphabet[(i / 64) % 8];
+
+                test_parse_next_dfa_one(string, n, sizeof(string), 0);
+                test_parse_next_dfa_one(string, n, 50, 0);
+                test_parse_next_dfa_one(string, n, sizeof(string), C_SHQUOTE_FLAG_ANSI_C);
+                test_parse_next_dfa_one(string, n, 50, C_SHQUOTE_FLAG_ANSI_C);
+        }
+}
+
+/*
+ * Parse from a constructor of the test. Its order against the constructors of
+ * the library is unspecified, so the tokenizer must not depend on them.
+ */
+static int test_early_r = -1;
+static size_t test_early_argc;
+
+__attribute__((__constructor__))
+static void test_early_parse(void) {
+        char **argv;
+
+        test_early_r = c_shquote_parse_argv(&argv, &test_early_argc, "a 'b c'", 7);
+        if (!test_early_r)
+                free(argv);
+}
+
+static void test_parse_next_dfa_early(void) {
+        c_assert(!test_early_r);
+        c_assert(test_early_argc == 2);
+}
+
+static void test_split_line_one(const char *string,
+                                unsigned int split,
+                                size_t n_expected,
+                                unsigned int split_expected) {
+        size_t n;
+
+        n = c_shquote_split_line(&split, string, strlen(string));
+        c_assert(n == n_expected);
+        c_assert(split == split_expected);
+}
+
+static void test_split_line(void) {
+        test_split_line_one("", C_SHQUOTE_SPLIT_NONE, 0, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("\n", C_SHQUOTE_SPLIT_NONE, 0, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a b", C_SHQUOTE_SPLIT_NONE, 3, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a b\nc", C_SHQUOTE_SPLIT_NONE, 3, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a\\\nb\nc", C_SHQUOTE_SPLIT_NONE, 4, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("'a\nb'\nc", C_SHQUOTE_SPLIT_NONE, 5, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("\"a\nb\\\"\n\"\nc", C_SHQUOTE_SPLIT_NONE, 8, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a #b 'c\nd", C_SHQUOTE_SPLIT_NONE, 7, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("#'\nd", C_SHQUOTE_SPLIT_NONE, 2, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a#'\nb'\nc", C_SHQUOTE_SPLIT_NONE, 6, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("''#'\n'\nc", C_SHQUOTE_SPLIT_NONE, 6, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a\\ #'\n'\nc", C_SHQUOTE_SPLIT_NONE, 7, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one(" \\\n#'\nc", C_SHQUOTE_SPLIT_NONE, 5, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a\\\n#'\n'\nc", C_SHQUOTE_SPLIT_NONE, 7, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a \t#'\nc", C_SHQUOTE_SPLIT_NONE, 5, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("'a", C_SHQUOTE_SPLIT_NONE, 2, C_SHQUOTE_SPLIT_SINGLE);
+        test_split_line_one("\"a\\", C_SHQUOTE_SPLIT_NONE, 3, C_SHQUOTE_SPLIT_DOUBLE);
+        test_split_line_one("a\\", C_SHQUOTE_SPLIT_NONE, 2, C_SHQUOTE_SPLIT_NONE);
+
+        /* resume within quotes */
+        test_split_line_one("a\nb' c\nd", C_SHQUOTE_SPLIT_SINGLE, 6, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a\n\\\"\n\" #'\n", C_SHQUOTE_SPLIT_DOUBLE, 9, C_SHQUOTE_SPLIT_NONE);
+        test_split_line_one("a\n\"b\n", C_SHQUOTE_SPLIT_SINGLE, 5, C_SHQUOTE_SPLIT_SINGLE);
+        test_split_line_one("a\n'b\n", C_SHQUOTE_SPLIT_DOUBLE, 5, C_SHQUOTE_SPLIT_DOUBLE);
+        test_split_line_one("a\"'b\n", C_SHQUOTE_SPLIT_DOUBLE, 5, C_SHQUOTE_SPLIT_SINGLE);
+}
+
 int main(void) {
         test_append_str();
         test_append_char();
@@ -395,11 +837,21 @@ int main(void) {
         test_consume_char();
         test_strnspn();
         test_strncspn();
+        test_class();
+        test_scan();
+        test_strncount();
+        test_mask();
+        test_scan_escape();
+        test_utf8_len();
         test_discard_comment();
         test_discard_whitespace();
         test_unescape_char_quoted();
         test_unescape_char_unquoted();
         test_unquote_single();
         test_unquote_double();
+        test_unquote_double_block();
+        test_parse_next_dfa();
+        test_parse_next_dfa_early();
+        test_split_line();
         return 0;
 }